@@ -0,0 +1,68 @@
+#ifndef ATTACH_LOADER_H
+#define ATTACH_LOADER_H
+
+#include <cstddef>
+#include <vector>
+
+// Skin weights of a mesh, read from one of two files:
+//
+// An .attach text file has a line per vertex with a weight for each of
+// joints 1 ... numJoints - 1 (the root joint has no column). Missing
+// columns count as 0. It is mapped into memory and parsed in place, in
+// parallel chunks when it is large.
+//
+// An .attachb file holds only the non-zero influences, quantized,
+// written by writeBinary():
+//
+//   header   magic "ATTACHB\0", ATTACH_BINARY_VERSION, numJoints,
+//            numVertices, numEntries (influences of all vertices),
+//            influenceCount, weightBits (8 or 16), jointBytes (1 or 2),
+//            weightScale
+//   counts   1 byte per vertex, its number of influences
+//   joints   numEntries, jointBytes each
+//   weights  numEntries, weightBits / 8 bytes each,
+//            w = q * weightScale / ( 2^weightBits - 1 )
+//
+// It is a fraction of the size of the text and is read without parsing.
+//
+// Either way the result is packed with influenceCount slots per vertex:
+// vertex i is attached to joint joints[ s ] with weight weights[ s ] for
+// s in [ i * influenceCount, ( i + 1 ) * influenceCount ), sorted by
+// decreasing weight, with weight 0 in the unused slots.
+class AttachLoader
+{
+public:
+
+	// Layout changes must bump this
+	static const unsigned ATTACH_BINARY_VERSION = 1;
+
+	AttachLoader() : influenceCount( 0 ) { }
+
+	int influenceCount;
+	std::vector< int > joints;
+	std::vector< float > weights;
+
+	size_t numVertices() const
+	{
+		return influenceCount > 0 ? joints.size() / influenceCount : 0;
+	}
+
+	// Replace the contents with an .attach file for a skeleton of
+	// numJoints. Rows with more than maxInfluences non-zero weights keep
+	// the largest ones, rescaled to the same total. Return false, with a
+	// message on stderr, if the file cannot be read.
+	bool load( const char* filename, int numJoints, int maxInfluences );
+	// The same for text in memory
+	bool parse( const char* begin, const char* end, int numJoints, int maxInfluences );
+
+	// Replace the contents with an .attachb file. Return false, with a
+	// message on stderr, if it cannot be read or was written for another
+	// number of joints.
+	bool loadBinary( const char* filename, int numJoints );
+
+	// Write the contents as an .attachb file with 8 or 16 bit weights.
+	// Every row is rounded so that its weights keep their total.
+	bool writeBinary( const char* filename, int numJoints, int weightBits ) const;
+};
+
+#endif // ATTACH_LOADER_H
@@ -0,0 +1,75 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Arrays derived from a source file (an OBJ, skin weights, ...), saved in
+// a binary file next to it so that later runs can skip parsing:
+//
+//   SOURCE.TAG
+//
+// The file starts with a header (magic, MESH_CACHE_VERSION, the size,
+// modification time and a hash of the source, and a key of the caller,
+// e.g. the number of joints the weights were read for), then a table of
+// sections and the raw arrays. A cache whose header does not match the
+// source as it is now is ignored, and rewritten by the next write().
+//
+// open() maps the file into memory; array() points into that mapping, so
+// nothing is copied until the caller does.
+class MeshCache
+{
+public:
+
+	// Layout changes must bump this
+	static const unsigned MESH_CACHE_VERSION = 1;
+
+	// One array to write
+	struct Section
+	{
+		unsigned id;
+		size_t elementSize;
+		size_t count;
+		const void* data;
+	};
+
+	MeshCache();
+	~MeshCache();
+
+	// Maps SOURCE.TAG if it was written for sourceFile as it is now and
+	// for key. Returns false if there is no such cache.
+	bool open( const char* sourceFile, const char* tag, unsigned long long key );
+
+	// Section id of the open cache, or NULL if it has none or its
+	// elements are not elementSize bytes. Valid until the cache is
+	// closed or destroyed.
+	const void* array( unsigned id, size_t elementSize, size_t& count ) const;
+
+	template< class T >
+	const T* array( unsigned id, size_t& count ) const
+	{
+		return static_cast< const T* >( array( id, sizeof( T ), count ) );
+	}
+
+	void close();
+
+	// Writes SOURCE.TAG for sourceFile as it is now. A cache that cannot
+	// be written (e.g. a read-only directory) is skipped quietly.
+	static bool write( const char* sourceFile, const char* tag, unsigned long long key,
+		const std::vector< Section >& sections );
+
+	// Name of the cache file
+	static std::string path( const char* sourceFile, const char* tag );
+
+private:
+	MeshCache( const MeshCache& );
+	MeshCache& operator=( const MeshCache& );
+
+	const char* m_data;
+	size_t m_size;
+	// the file read into memory where it cannot be mapped
+	std::vector< char > m_copy;
+};
+
+#endif // MESH_CACHE_H
@@ -0,0 +1,54 @@
+#ifndef OBJ_LOADER_H
+#define OBJ_LOADER_H
+
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+// Wavefront OBJ geometry as flat arrays, read by mapping the file into
+// memory and parsing the numbers in place. Only v, vn, vt and f lines are
+// read; everything else (comments, groups, materials, ...) is skipped.
+//
+// Faces with more than three corners are split into a fan of triangles.
+// Every corner may be given as v, v/vt, v//vn or v/vt/vn, with indices
+// counted from 1, or from the end of the list so far when negative; 0
+// stands for a missing one. The indices stored here are counted from 0,
+// with -1 where a corner has no texture coordinate or normal.
+//
+// Files larger than a few megabytes are parsed in parallel chunks.
+class ObjLoader
+{
+public:
+
+	struct Corner
+	{
+		int position;
+		int texCoord;
+		int normal;
+	};
+
+	// 3 floats per v line
+	std::vector< float > positions;
+	// 3 floats per vn line
+	std::vector< float > normals;
+	// 2 floats per vt line (a third coordinate is dropped)
+	std::vector< float > texCoords;
+	// 3 corners per triangle
+	std::vector< Corner > corners;
+
+	size_t numPositions() const { return positions.size() / 3; }
+	size_t numNormals() const { return normals.size() / 3; }
+	size_t numTexCoords() const { return texCoords.size() / 2; }
+	size_t numTriangles() const { return corners.size() / 3; }
+
+	// Replace the contents with the file. Return false, with a message
+	// on stderr, if it cannot be read or refers to a missing vertex.
+	bool load( const char* filename );
+	// The same for an open file, e.g. stdin, which does not need to be
+	// seekable
+	bool load( FILE* fp );
+	// The same for text in memory
+	bool parse( const char* begin, const char* end );
+};
+
+#endif // OBJ_LOADER_H
@@ -0,0 +1,349 @@
+#include "AttachLoader.h"
+
+#include "FileData.h"
+
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+
+using namespace std;
+
+namespace
+{
+	// Files smaller than this are parsed on the calling thread, larger ones
+	// in chunks of at least this size
+	const size_t CHUNK_BYTES = 256 << 10;
+
+	const char MAGIC[ 8 ] = { 'A', 'T', 'T', 'A', 'C', 'H', 'B', '\0' };
+
+	struct Header
+	{
+		char magic[ 8 ];
+		uint32_t version;
+		uint32_t numJoints;
+		uint64_t numVertices;
+		// non-zero weights of all vertices
+		uint64_t numEntries;
+		uint32_t influenceCount;
+		uint32_t weightBits;
+		uint32_t jointBytes;
+		// largest weight that can be stored, at least 1
+		float weightScale;
+	};
+
+	// Little-endian unsigned integers of 1 or 2 bytes
+	inline unsigned readUnsigned( const unsigned char* p, unsigned bytes )
+	{
+		return bytes == 2 ? p[ 0 ] | p[ 1 ] << 8 : p[ 0 ];
+	}
+
+	inline void writeUnsigned( unsigned char* p, unsigned bytes, unsigned value )
+	{
+		p[ 0 ] = (unsigned char)( value & 0xff );
+		if( bytes == 2 )
+		{
+			p[ 1 ] = (unsigned char)( value >> 8 );
+		}
+	}
+
+	struct Influence
+	{
+		float weight;
+		int joint;
+	};
+
+	// The rows of one range of lines: the non-zero influences of every
+	// row, largest weight first, one row after the other
+	struct Chunk
+	{
+		const char* begin;
+		const char* end;
+		vector< unsigned > rowSizes;
+		vector< Influence > influences;
+		size_t widest;
+		size_t firstRow;
+	};
+
+	inline bool isSpace( char c )
+	{
+		return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+	}
+
+	void parseChunk( Chunk& chunk, int numJoints )
+	{
+		const char* const end = chunk.end;
+		chunk.widest = 0;
+		// every line is a row, also an empty one
+		for( const char* line = chunk.begin; line < end; )
+		{
+			const char* lineEnd = static_cast< const char* >( memchr( line, '\n', end - line ) );
+			lineEnd = lineEnd ? lineEnd : end;
+			const size_t rowStart = chunk.influences.size();
+			const char* p = line;
+			for( int j = 1; j < numJoints; ++j )
+			{
+				while( p != lineEnd && isSpace( *p ) )
+				{
+					++p;
+				}
+				// from_chars takes no leading plus
+				if( p != lineEnd && *p == '+' )
+				{
+					++p;
+				}
+				float w = 0;
+				from_chars_result r = from_chars( p, lineEnd, w );
+				if( r.ec != errc() )
+				{
+					// like a stream, the rest of the row counts as 0
+					break;
+				}
+				p = r.ptr;
+				if( w == 0 )
+				{
+					continue;
+				}
+				// insert after the weights that are at least as large, so
+				// equal ones stay in joint order
+				Influence in = { w, j };
+				chunk.influences.push_back( in );
+				size_t k = chunk.influences.size() - 1;
+				for( ; k > rowStart && chunk.influences[ k - 1 ].weight < w; --k )
+				{
+					chunk.influences[ k ] = chunk.influences[ k - 1 ];
+				}
+				chunk.influences[ k ] = in;
+			}
+			const size_t rowSize = chunk.influences.size() - rowStart;
+			chunk.rowSizes.push_back( unsigned( rowSize ) );
+			chunk.widest = max( chunk.widest, rowSize );
+			line = lineEnd + 1;
+		}
+	}
+
+	// Packs the rows of chunk into the slots from its first row on
+	void packChunk( const Chunk& chunk, int influenceCount, int* joints, float* weights )
+	{
+		const Influence* row = chunk.influences.data();
+		for( size_t r = 0; r != chunk.rowSizes.size(); ++r )
+		{
+			const size_t rowSize = chunk.rowSizes[ r ];
+			const size_t kept = min( rowSize, size_t( influenceCount ) );
+			float total = 0, keptTotal = 0;
+			for( size_t k = 0; k != rowSize; ++k )
+			{
+				total += row[ k ].weight;
+				if( k < kept )
+				{
+					keptTotal += row[ k ].weight;
+				}
+			}
+			const float scale = kept < rowSize ? total / keptTotal : 1;
+			const size_t slot = ( chunk.firstRow + r ) * influenceCount;
+			for( size_t k = 0; k != kept; ++k )
+			{
+				joints[ slot + k ] = row[ k ].joint;
+				weights[ slot + k ] = row[ k ].weight * scale;
+			}
+			row += rowSize;
+		}
+	}
+}
+
+bool AttachLoader::parse( const char* begin, const char* end, int numJoints, int maxInfluences )
+{
+	const vector< pair< const char*, const char* > > ranges = splitLines( begin, end, CHUNK_BYTES );
+	vector< Chunk > chunks( ranges.size() );
+	for( size_t c = 0; c != chunks.size(); ++c )
+	{
+		chunks[ c ].begin = ranges[ c ].first;
+		chunks[ c ].end = ranges[ c ].second;
+	}
+	runChunks( chunks.size(), [ & ]( size_t c ) { parseChunk( chunks[ c ], numJoints ); } );
+
+	size_t numRows = 0, widest = 0;
+	for( size_t c = 0; c != chunks.size(); ++c )
+	{
+		chunks[ c ].firstRow = numRows;
+		numRows += chunks[ c ].rowSizes.size();
+		widest = max( widest, chunks[ c ].widest );
+	}
+	influenceCount = int( min( widest, size_t( max( maxInfluences, 0 ) ) ) );
+	joints.assign( numRows * influenceCount, 0 );
+	weights.assign( numRows * influenceCount, 0 );
+	runChunks( chunks.size(), [ & ]( size_t c )
+	{
+		packChunk( chunks[ c ], influenceCount, joints.data(), weights.data() );
+	} );
+	return true;
+}
+
+bool AttachLoader::load( const char* filename, int numJoints, int maxInfluences )
+{
+	vector< char > copy;
+	FileData file;
+	if( !file.open( filename, copy ) )
+	{
+		cerr << "Failed to open " << filename << endl;
+		return false;
+	}
+	return parse( file.data, file.data + file.size, numJoints, maxInfluences );
+}
+
+bool AttachLoader::loadBinary( const char* filename, int numJoints )
+{
+	vector< char > copy;
+	FileData file;
+	if( !file.open( filename, copy ) )
+	{
+		cerr << "Failed to open " << filename << endl;
+		return false;
+	}
+	Header header;
+	if( file.size < sizeof( Header ) )
+	{
+		cerr << "Bad .attachb file " << filename << endl;
+		return false;
+	}
+	memcpy( &header, file.data, sizeof( Header ) );
+	const uint64_t entryBytes = header.jointBytes + header.weightBits / 8;
+	if( memcmp( header.magic, MAGIC, sizeof( MAGIC ) ) != 0 ||
+		header.version != ATTACH_BINARY_VERSION ||
+		( header.weightBits != 8 && header.weightBits != 16 ) ||
+		( header.jointBytes != 1 && header.jointBytes != 2 ) ||
+		header.influenceCount > 255 ||
+		!( header.weightScale >= 1 ) ||
+		file.size != sizeof( Header ) + header.numVertices + header.numEntries * entryBytes )
+	{
+		cerr << "Bad .attachb file " << filename << endl;
+		return false;
+	}
+	if( header.numJoints != uint32_t( numJoints ) )
+	{
+		cerr << filename << " is for " << header.numJoints << " joints, not " << numJoints << endl;
+		return false;
+	}
+
+	const unsigned char* counts = reinterpret_cast< const unsigned char* >( file.data + sizeof( Header ) );
+	const unsigned char* jointData = counts + header.numVertices;
+	const unsigned char* weightData = jointData + header.numEntries * header.jointBytes;
+	const unsigned weightBytes = header.weightBits / 8;
+	const float toWeight = header.weightScale / float( ( 1u << header.weightBits ) - 1 );
+	influenceCount = int( header.influenceCount );
+	joints.assign( header.numVertices * influenceCount, 0 );
+	weights.assign( header.numVertices * influenceCount, 0 );
+	uint64_t e = 0;
+	for( size_t v = 0; v != header.numVertices; ++v )
+	{
+		if( counts[ v ] > influenceCount || e + counts[ v ] > header.numEntries )
+		{
+			cerr << "Bad .attachb file " << filename << endl;
+			return false;
+		}
+		for( unsigned k = 0; k != counts[ v ]; ++k, ++e )
+		{
+			const unsigned j = readUnsigned( jointData + e * header.jointBytes, header.jointBytes );
+			if( j >= unsigned( numJoints ) )
+			{
+				cerr << "Bad joint in " << filename << endl;
+				return false;
+			}
+			joints[ v * influenceCount + k ] = int( j );
+			weights[ v * influenceCount + k ] =
+				readUnsigned( weightData + e * weightBytes, weightBytes ) * toWeight;
+		}
+	}
+	return e == header.numEntries;
+}
+
+bool AttachLoader::writeBinary( const char* filename, int numJoints, int weightBits ) const
+{
+	if( ( weightBits != 8 && weightBits != 16 ) || numJoints <= 0 || numJoints > 1 << 16 ||
+		influenceCount > 255 )
+	{
+		cerr << "Cannot write " << weightBits << " bit weights of " << influenceCount <<
+			" influences for " << numJoints << " joints" << endl;
+		return false;
+	}
+	Header header;
+	memset( &header, 0, sizeof( Header ) );
+	memcpy( header.magic, MAGIC, sizeof( MAGIC ) );
+	header.version = ATTACH_BINARY_VERSION;
+	header.numJoints = uint32_t( numJoints );
+	header.numVertices = numVertices();
+	header.influenceCount = uint32_t( influenceCount );
+	header.weightBits = uint32_t( weightBits );
+	header.jointBytes = numJoints <= 256 ? 1 : 2;
+	header.weightScale = 1;
+	for( size_t s = 0; s != weights.size(); ++s )
+	{
+		if( !( weights[ s ] >= 0 ) )
+		{
+			cerr << "Cannot quantize the weight " << weights[ s ] << endl;
+			return false;
+		}
+		header.weightScale = max( header.weightScale, weights[ s ] );
+		header.numEntries += weights[ s ] > 0;
+	}
+
+	const unsigned weightBytes = weightBits / 8;
+	const double toQ = ( ( 1u << weightBits ) - 1 ) / double( header.weightScale );
+	vector< unsigned char > counts( header.numVertices );
+	vector< unsigned char > jointData( header.numEntries * header.jointBytes );
+	vector< unsigned char > weightData( header.numEntries * weightBytes );
+	vector< long > q;
+	vector< pair< double, int > > remainders;
+	size_t e = 0;
+	for( size_t v = 0; v != header.numVertices; ++v )
+	{
+		// the used slots come first; every weight is rounded down, then
+		// the ones that lost most are rounded up until the row has the
+		// total it had, so no weight is off by more than one step
+		const size_t slot = v * influenceCount;
+		int count = 0;
+		double total = 0;
+		long qTotal = 0;
+		q.clear();
+		remainders.clear();
+		for( ; count != influenceCount && weights[ slot + count ] > 0; ++count )
+		{
+			const double scaled = weights[ slot + count ] * toQ;
+			q.push_back( long( floor( scaled ) ) );
+			remainders.push_back( make_pair( scaled - q.back(), count ) );
+			total += scaled;
+			qTotal += q.back();
+		}
+		const size_t roundUp = size_t( min< long >( max( lround( total ) - qTotal, 0l ), count ) );
+		partial_sort( remainders.begin(), remainders.begin() + roundUp, remainders.end(),
+			[]( const pair< double, int >& a, const pair< double, int >& b ) { return a.first > b.first; } );
+		for( size_t r = 0; r != roundUp; ++r )
+		{
+			++q[ remainders[ r ].second ];
+		}
+		counts[ v ] = (unsigned char)count;
+		for( int k = 0; k != count; ++k, ++e )
+		{
+			writeUnsigned( &jointData[ e * header.jointBytes ], header.jointBytes, joints[ slot + k ] );
+			writeUnsigned( &weightData[ e * weightBytes ], weightBytes, unsigned( q[ k ] ) );
+		}
+	}
+
+	FILE* fp = fopen( filename, "wb" );
+	if( !fp )
+	{
+		cerr << "Failed to open " << filename << endl;
+		return false;
+	}
+	bool ok = fwrite( &header, sizeof( Header ), 1, fp ) == 1 &&
+		fwrite( counts.data(), 1, counts.size(), fp ) == counts.size() &&
+		fwrite( jointData.data(), 1, jointData.size(), fp ) == jointData.size() &&
+		fwrite( weightData.data(), 1, weightData.size(), fp ) == weightData.size();
+	ok = fclose( fp ) == 0 && ok;
+	if( !ok )
+	{
+		cerr << "Failed to write " << filename << endl;
+		remove( filename );
+	}
+	return ok;
+}
@@ -0,0 +1,138 @@
+#ifndef FILE_DATA_H
+#define FILE_DATA_H
+
+// Helpers shared by the loaders of this library, not installed with it
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// A whole file in memory: mapped where possible, else read into copy
+class FileData
+{
+public:
+	FileData() : data( NULL ), size( 0 ), m_mapped( false ) { }
+	~FileData() { release(); }
+
+	bool open( const char* filename, std::vector< char >& copy )
+	{
+#ifndef _WIN32
+		int fd = ::open( filename, O_RDONLY );
+		if( fd < 0 )
+		{
+			return false;
+		}
+		struct stat st;
+		if( fstat( fd, &st ) == 0 && st.st_size > 0 )
+		{
+			void* p = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+			if( p != MAP_FAILED )
+			{
+				madvise( p, st.st_size, MADV_SEQUENTIAL );
+				data = static_cast< const char* >( p );
+				size = st.st_size;
+				m_mapped = true;
+			}
+		}
+		::close( fd );
+		if( m_mapped )
+		{
+			return true;
+		}
+#endif
+		FILE* fp = fopen( filename, "rb" );
+		if( !fp )
+		{
+			return false;
+		}
+		copy.clear();
+		char buffer[ 1 << 16 ];
+		size_t n;
+		while( ( n = fread( buffer, 1, sizeof( buffer ), fp ) ) > 0 )
+		{
+			copy.insert( copy.end(), buffer, buffer + n );
+		}
+		fclose( fp );
+		data = copy.data();
+		size = copy.size();
+		return true;
+	}
+
+	// Keep the mapping after this object is gone; whoever took data
+	// unmaps it
+	void detach() { m_mapped = false; }
+
+	void release()
+	{
+#ifndef _WIN32
+		if( m_mapped )
+		{
+			munmap( const_cast< char* >( data ), size );
+		}
+#endif
+		m_mapped = false;
+		data = NULL;
+		size = 0;
+	}
+
+	const char* data;
+	size_t size;
+
+private:
+	FileData( const FileData& );
+	FileData& operator=( const FileData& );
+
+	bool m_mapped;
+};
+
+// Cuts [ begin, end ) into up to one range of whole lines per hardware
+// thread, each at least minChunkBytes long
+inline std::vector< std::pair< const char*, const char* > > splitLines(
+	const char* begin, const char* end, size_t minChunkBytes )
+{
+	const size_t size = end - begin;
+	const size_t numThreads = std::max( 1u, std::thread::hardware_concurrency() );
+	const size_t numChunks = std::max< size_t >( 1, std::min( numThreads, size / minChunkBytes ) );
+	std::vector< std::pair< const char*, const char* > > chunks( numChunks );
+	const char* p = begin;
+	for( size_t c = 0; c != numChunks; ++c )
+	{
+		const char* cut = c + 1 == numChunks ? end : std::max( p, begin + size * ( c + 1 ) / numChunks );
+		const char* newline = static_cast< const char* >( memchr( cut, '\n', end - cut ) );
+		cut = c + 1 == numChunks || !newline ? end : newline + 1;
+		chunks[ c ] = std::make_pair( p, cut );
+		p = cut;
+	}
+	return chunks;
+}
+
+// fn( 0 ) ... fn( n - 1 ), each but the first on a thread of its own
+template< class F >
+void runChunks( size_t n, F fn )
+{
+	std::vector< std::thread > threads;
+	for( size_t c = 1; c < n; ++c )
+	{
+		threads.push_back( std::thread( fn, c ) );
+	}
+	if( n > 0 )
+	{
+		fn( size_t( 0 ) );
+	}
+	for( size_t t = 0; t != threads.size(); ++t )
+	{
+		threads[ t ].join();
+	}
+}
+
+#endif // FILE_DATA_H
@@ -0,0 +1,235 @@
+#include "MeshCache.h"
+
+#include "FileData.h"
+
+#include <cstdint>
+#include <sys/stat.h>
+
+using namespace std;
+
+namespace
+{
+	const char MAGIC[ 8 ] = { 'M', 'E', 'S', 'H', 'C', 'A', 'C', 'H' };
+	// sections start at multiples of this
+	const size_t ALIGNMENT = 16;
+
+	struct Header
+	{
+		char magic[ 8 ];
+		uint32_t version;
+		uint32_t numSections;
+		uint64_t sourceSize;
+		int64_t sourceTime;
+		uint64_t sourceHash;
+		uint64_t key;
+		// of the whole cache, so a truncated one is caught
+		uint64_t fileSize;
+		uint64_t reserved;
+	};
+
+	struct SectionEntry
+	{
+		uint32_t id;
+		uint32_t elementSize;
+		uint64_t offset;
+		uint64_t count;
+	};
+
+	size_t align( size_t offset )
+	{
+		return ( offset + ALIGNMENT - 1 ) / ALIGNMENT * ALIGNMENT;
+	}
+
+	// 64 bits of the whole text, 8 bytes at a time
+	uint64_t hashBytes( const char* data, size_t size )
+	{
+		uint64_t h = 0x9e3779b97f4a7c15ull ^ size;
+		size_t i = 0;
+		for( ; i + 8 <= size; i += 8 )
+		{
+			uint64_t w;
+			memcpy( &w, data + i, 8 );
+			h = ( h ^ w ) * 0xff51afd7ed558ccdull;
+			h ^= h >> 32;
+		}
+		for( ; i < size; ++i )
+		{
+			h = ( h ^ uint8_t( data[ i ] ) ) * 0x100000001b3ull;
+		}
+		return h;
+	}
+
+	// Size, modification time and hash of the source as it is now
+	bool describeSource( const char* sourceFile, Header& header )
+	{
+		struct stat st;
+		if( stat( sourceFile, &st ) != 0 )
+		{
+			return false;
+		}
+		vector< char > copy;
+		FileData source;
+		if( !source.open( sourceFile, copy ) )
+		{
+			return false;
+		}
+		header.sourceSize = source.size;
+		header.sourceTime = int64_t( st.st_mtime );
+		header.sourceHash = hashBytes( source.data, source.size );
+		return true;
+	}
+}
+
+MeshCache::MeshCache() :
+	m_data( NULL ),
+	m_size( 0 )
+{
+}
+
+MeshCache::~MeshCache()
+{
+	close();
+}
+
+string MeshCache::path( const char* sourceFile, const char* tag )
+{
+	return string( sourceFile ) + "." + tag;
+}
+
+bool MeshCache::open( const char* sourceFile, const char* tag, unsigned long long key )
+{
+	close();
+	Header current;
+	if( !describeSource( sourceFile, current ) )
+	{
+		return false;
+	}
+	FileData file;
+	if( !file.open( path( sourceFile, tag ).c_str(), m_copy ) || file.size < sizeof( Header ) )
+	{
+		return false;
+	}
+	Header header;
+	memcpy( &header, file.data, sizeof( Header ) );
+	if( memcmp( header.magic, MAGIC, sizeof( MAGIC ) ) != 0 ||
+		header.version != MESH_CACHE_VERSION ||
+		header.sourceSize != current.sourceSize ||
+		header.sourceTime != current.sourceTime ||
+		header.sourceHash != current.sourceHash ||
+		header.key != key ||
+		header.fileSize != file.size ||
+		sizeof( Header ) + header.numSections * sizeof( SectionEntry ) > file.size )
+	{
+		return false;
+	}
+	const SectionEntry* entries = reinterpret_cast< const SectionEntry* >( file.data + sizeof( Header ) );
+	for( uint32_t s = 0; s != header.numSections; ++s )
+	{
+		if( entries[ s ].offset > file.size ||
+			entries[ s ].count * entries[ s ].elementSize > file.size - entries[ s ].offset )
+		{
+			return false;
+		}
+	}
+	m_data = file.data;
+	m_size = file.size;
+	file.detach();
+	return true;
+}
+
+const void* MeshCache::array( unsigned id, size_t elementSize, size_t& count ) const
+{
+	count = 0;
+	if( !m_data )
+	{
+		return NULL;
+	}
+	Header header;
+	memcpy( &header, m_data, sizeof( Header ) );
+	const SectionEntry* entries = reinterpret_cast< const SectionEntry* >( m_data + sizeof( Header ) );
+	for( uint32_t s = 0; s != header.numSections; ++s )
+	{
+		if( entries[ s ].id == id )
+		{
+			if( entries[ s ].elementSize != elementSize )
+			{
+				return NULL;
+			}
+			count = size_t( entries[ s ].count );
+			return m_data + entries[ s ].offset;
+		}
+	}
+	return NULL;
+}
+
+void MeshCache::close()
+{
+#ifndef _WIN32
+	if( m_data && m_data != m_copy.data() )
+	{
+		munmap( const_cast< char* >( m_data ), m_size );
+	}
+#endif
+	m_data = NULL;
+	m_size = 0;
+	m_copy.clear();
+}
+
+bool MeshCache::write( const char* sourceFile, const char* tag, unsigned long long key,
+	const vector< Section >& sections )
+{
+	Header header;
+	memset( &header, 0, sizeof( Header ) );
+	if( !describeSource( sourceFile, header ) )
+	{
+		return false;
+	}
+	memcpy( header.magic, MAGIC, sizeof( MAGIC ) );
+	header.version = MESH_CACHE_VERSION;
+	header.numSections = uint32_t( sections.size() );
+	header.key = key;
+
+	vector< SectionEntry > entries( sections.size() );
+	size_t offset = align( sizeof( Header ) + sections.size() * sizeof( SectionEntry ) );
+	for( size_t s = 0; s != sections.size(); ++s )
+	{
+		entries[ s ].id = sections[ s ].id;
+		entries[ s ].elementSize = uint32_t( sections[ s ].elementSize );
+		entries[ s ].offset = offset;
+		entries[ s ].count = sections[ s ].count;
+		offset = align( offset + sections[ s ].elementSize * sections[ s ].count );
+	}
+	header.fileSize = offset;
+
+	// write a temporary file and rename it over the cache, so a reader
+	// never sees half of one
+	const string cacheFile = path( sourceFile, tag );
+	const string tempFile = cacheFile + ".tmp";
+	FILE* fp = fopen( tempFile.c_str(), "wb" );
+	if( !fp )
+	{
+		return false;
+	}
+	const char padding[ ALIGNMENT ] = { 0 };
+	bool ok = fwrite( &header, sizeof( Header ), 1, fp ) == 1 &&
+		fwrite( entries.data(), sizeof( SectionEntry ), entries.size(), fp ) == entries.size();
+	size_t written = sizeof( Header ) + entries.size() * sizeof( SectionEntry );
+	for( size_t s = 0; ok && s != sections.size(); ++s )
+	{
+		const size_t bytes = sections[ s ].elementSize * sections[ s ].count;
+		ok = fwrite( padding, 1, entries[ s ].offset - written, fp ) == entries[ s ].offset - written &&
+			fwrite( sections[ s ].data, 1, bytes, fp ) == bytes;
+		written = entries[ s ].offset + bytes;
+	}
+	ok = ok && fwrite( padding, 1, offset - written, fp ) == offset - written;
+	ok = fclose( fp ) == 0 && ok;
+#ifdef _WIN32
+	remove( cacheFile.c_str() );
+#endif
+	if( !ok || rename( tempFile.c_str(), cacheFile.c_str() ) != 0 )
+	{
+		remove( tempFile.c_str() );
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,367 @@
+#include "ObjLoader.h"
+
+#include "FileData.h"
+
+#include <charconv>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+namespace
+{
+	// Files smaller than this are parsed on the calling thread, larger ones
+	// in chunks of at least this size
+	const size_t CHUNK_BYTES = 2 << 20;
+
+	enum CornerField
+	{
+		POSITION,
+		TEX_COORD,
+		NORMAL,
+		NUM_FIELDS
+	};
+
+	// What one thread reads from its range of lines: the geometry with
+	// relative indices still counted from the start of the chunk, and
+	// where those are
+	struct Chunk
+	{
+		const char* begin;
+		const char* end;
+		ObjLoader obj;
+		// for every field, the corners whose index needs the number of
+		// vertices before the chunk added
+		vector< size_t > relative[ NUM_FIELDS ];
+		string error;
+	};
+
+	inline bool isSpace( char c )
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	inline const char* skipSpace( const char* p, const char* end )
+	{
+		while( p != end && isSpace( *p ) )
+		{
+			++p;
+		}
+		return p;
+	}
+
+	// Reads up to n floats from [ p, end ) into out and returns how many
+	// there were, or -1 if something else follows them
+	int readFloats( const char* p, const char* end, int n, float* out )
+	{
+		int count = 0;
+		for( p = skipSpace( p, end ); p != end && count < n; p = skipSpace( p, end ) )
+		{
+			// from_chars takes no leading plus
+			if( *p == '+' )
+			{
+				++p;
+			}
+			from_chars_result r = from_chars( p, end, out[ count ] );
+			if( r.ec != errc() )
+			{
+				return -1;
+			}
+			p = r.ptr;
+			++count;
+		}
+		return count;
+	}
+
+	// Parses one corner of a face starting at p into indices (0-based when
+	// absolute, from the end of the chunk so far when relative) and
+	// sets a bit of relativeMask for every relative one. Returns the end
+	// of the corner, or NULL if it is malformed.
+	const char* readCorner( const char* p, const char* end, const size_t counts[ NUM_FIELDS ],
+		int indices[ NUM_FIELDS ], unsigned& relativeMask )
+	{
+		relativeMask = 0;
+		fill( indices, indices + NUM_FIELDS, -1 );
+		for( int field = 0; field != NUM_FIELDS; ++field )
+		{
+			if( field > 0 )
+			{
+				if( p == end || *p != '/' )
+				{
+					break;
+				}
+				++p;
+				// v//vn leaves out the texture coordinate
+				if( p != end && *p == '/' )
+				{
+					continue;
+				}
+			}
+			int i = 0;
+			from_chars_result r = from_chars( p, end, i );
+			if( r.ec != errc() )
+			{
+				return NULL;
+			}
+			p = r.ptr;
+			if( i == 0 )
+			{
+				// the a0 files write v/0/vn for a missing texture coordinate
+				continue;
+			}
+			else if( i > 0 )
+			{
+				indices[ field ] = i - 1;
+			}
+			else
+			{
+				indices[ field ] = int( counts[ field ] ) + i;
+				relativeMask |= 1u << field;
+			}
+		}
+		return p == end || isSpace( *p ) ? p : NULL;
+	}
+
+	void parseChunk( Chunk& chunk )
+	{
+		const char* const end = chunk.end;
+		ObjLoader& obj = chunk.obj;
+
+		// count the lines first, so the arrays are allocated once
+		size_t numLines[ 4 ] = { 0, 0, 0, 0 };
+		for( const char* p = chunk.begin; p < end; )
+		{
+			const char* lineEnd = static_cast< const char* >( memchr( p, '\n', end - p ) );
+			lineEnd = lineEnd ? lineEnd : end;
+			p = skipSpace( p, lineEnd );
+			if( lineEnd - p > 1 && isSpace( p[ 1 ] ) )
+			{
+				numLines[ 0 ] += p[ 0 ] == 'v';
+				numLines[ 3 ] += p[ 0 ] == 'f';
+			}
+			else if( lineEnd - p > 2 && p[ 0 ] == 'v' && isSpace( p[ 2 ] ) )
+			{
+				numLines[ 1 ] += p[ 1 ] == 'n';
+				numLines[ 2 ] += p[ 1 ] == 't';
+			}
+			p = lineEnd + 1;
+		}
+		obj.positions.reserve( 3 * numLines[ 0 ] );
+		obj.normals.reserve( 3 * numLines[ 1 ] );
+		obj.texCoords.reserve( 2 * numLines[ 2 ] );
+		obj.corners.reserve( 3 * numLines[ 3 ] );
+
+		vector< ObjLoader::Corner > polygon;
+		vector< unsigned > polygonRelative;
+		for( const char* line = chunk.begin; line < end; )
+		{
+			const char* lineEnd = static_cast< const char* >( memchr( line, '\n', end - line ) );
+			lineEnd = lineEnd ? lineEnd : end;
+			const char* p = skipSpace( line, lineEnd );
+			const char* key = p;
+			while( p != lineEnd && !isSpace( *p ) )
+			{
+				++p;
+			}
+			const size_t keyLength = p - key;
+
+			bool ok = true;
+			float f[ 3 ] = { 0, 0, 0 };
+			if( keyLength == 1 && key[ 0 ] == 'v' )
+			{
+				ok = readFloats( p, lineEnd, 3, f ) == 3;
+				obj.positions.insert( obj.positions.end(), f, f + 3 );
+			}
+			else if( keyLength == 2 && key[ 0 ] == 'v' && key[ 1 ] == 'n' )
+			{
+				ok = readFloats( p, lineEnd, 3, f ) == 3;
+				obj.normals.insert( obj.normals.end(), f, f + 3 );
+			}
+			else if( keyLength == 2 && key[ 0 ] == 'v' && key[ 1 ] == 't' )
+			{
+				ok = readFloats( p, lineEnd, 3, f ) >= 1;
+				obj.texCoords.insert( obj.texCoords.end(), f, f + 2 );
+			}
+			else if( keyLength == 1 && key[ 0 ] == 'f' )
+			{
+				const size_t counts[ NUM_FIELDS ] =
+				{
+					obj.numPositions(), obj.numTexCoords(), obj.numNormals()
+				};
+				polygon.clear();
+				polygonRelative.clear();
+				for( p = skipSpace( p, lineEnd ); p != lineEnd; p = skipSpace( p, lineEnd ) )
+				{
+					ObjLoader::Corner c;
+					int indices[ NUM_FIELDS ];
+					unsigned relativeMask;
+					p = readCorner( p, lineEnd, counts, indices, relativeMask );
+					if( !p )
+					{
+						ok = false;
+						break;
+					}
+					c.position = indices[ POSITION ];
+					c.texCoord = indices[ TEX_COORD ];
+					c.normal = indices[ NORMAL ];
+					polygon.push_back( c );
+					polygonRelative.push_back( relativeMask );
+				}
+				ok = ok && polygon.size() >= 3;
+				for( size_t k = 1; ok && k + 1 < polygon.size(); ++k )
+				{
+					const size_t fan[ 3 ] = { 0, k, k + 1 };
+					for( int i = 0; i != 3; ++i )
+					{
+						for( int field = 0; field != NUM_FIELDS; ++field )
+						{
+							if( polygonRelative[ fan[ i ] ] & ( 1u << field ) )
+							{
+								chunk.relative[ field ].push_back( obj.corners.size() );
+							}
+						}
+						obj.corners.push_back( polygon[ fan[ i ] ] );
+					}
+				}
+			}
+			if( !ok )
+			{
+				chunk.error = string( line, min< size_t >( lineEnd - line, 80 ) );
+				return;
+			}
+			line = lineEnd + 1;
+		}
+	}
+
+	bool inRange( int index, size_t count, bool optional )
+	{
+		return optional && index == -1 ? true : index >= 0 && size_t( index ) < count;
+	}
+}
+
+bool ObjLoader::parse( const char* begin, const char* end )
+{
+	const vector< pair< const char*, const char* > > ranges = splitLines( begin, end, CHUNK_BYTES );
+	const size_t numChunks = ranges.size();
+	vector< Chunk > chunks( numChunks );
+	for( size_t c = 0; c != numChunks; ++c )
+	{
+		chunks[ c ].begin = ranges[ c ].first;
+		chunks[ c ].end = ranges[ c ].second;
+	}
+	runChunks( numChunks, [ & ]( size_t c ) { parseChunk( chunks[ c ] ); } );
+
+	size_t total[ NUM_FIELDS + 1 ] = { 0, 0, 0, 0 };
+	for( size_t c = 0; c != numChunks; ++c )
+	{
+		if( !chunks[ c ].error.empty() )
+		{
+			cerr << "Bad OBJ line: " << chunks[ c ].error << endl;
+			return false;
+		}
+		total[ POSITION ] += chunks[ c ].obj.positions.size();
+		total[ TEX_COORD ] += chunks[ c ].obj.texCoords.size();
+		total[ NORMAL ] += chunks[ c ].obj.normals.size();
+		total[ NUM_FIELDS ] += chunks[ c ].obj.corners.size();
+	}
+	if( numChunks == 1 )
+	{
+		positions.swap( chunks[ 0 ].obj.positions );
+		texCoords.swap( chunks[ 0 ].obj.texCoords );
+		normals.swap( chunks[ 0 ].obj.normals );
+		corners.swap( chunks[ 0 ].obj.corners );
+	}
+	else
+	{
+		positions.clear();
+		texCoords.clear();
+		normals.clear();
+		corners.clear();
+		positions.reserve( total[ POSITION ] );
+		texCoords.reserve( total[ TEX_COORD ] );
+		normals.reserve( total[ NORMAL ] );
+		corners.reserve( total[ NUM_FIELDS ] );
+		for( size_t c = 0; c != numChunks; ++c )
+		{
+			// relative indices count from the vertices before the chunk
+			Chunk& chunk = chunks[ c ];
+			const int offsets[ NUM_FIELDS ] =
+			{
+				int( numPositions() ), int( numTexCoords() ), int( numNormals() )
+			};
+			for( int field = 0; field != NUM_FIELDS; ++field )
+			{
+				const vector< size_t >& relative = chunk.relative[ field ];
+				for( size_t r = 0; r != relative.size(); ++r )
+				{
+					Corner& corner = chunk.obj.corners[ relative[ r ] ];
+					int& index = field == POSITION ? corner.position :
+						field == TEX_COORD ? corner.texCoord : corner.normal;
+					index += offsets[ field ];
+				}
+			}
+			positions.insert( positions.end(), chunk.obj.positions.begin(), chunk.obj.positions.end() );
+			texCoords.insert( texCoords.end(), chunk.obj.texCoords.begin(), chunk.obj.texCoords.end() );
+			normals.insert( normals.end(), chunk.obj.normals.begin(), chunk.obj.normals.end() );
+			corners.insert( corners.end(), chunk.obj.corners.begin(), chunk.obj.corners.end() );
+		}
+	}
+
+	for( size_t i = 0; i != corners.size(); ++i )
+	{
+		const Corner& c = corners[ i ];
+		if( !inRange( c.position, numPositions(), false ) ||
+			!inRange( c.texCoord, numTexCoords(), true ) ||
+			!inRange( c.normal, numNormals(), true ) )
+		{
+			cerr << "OBJ triangle " << i / 3 << " refers to a missing vertex" << endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool ObjLoader::load( FILE* fp )
+{
+#ifndef _WIN32
+	// a regular file is mapped like in load( filename ), from where fp is
+	struct stat st;
+	const long offset = ftell( fp );
+	if( offset >= 0 && fstat( fileno( fp ), &st ) == 0 && S_ISREG( st.st_mode ) &&
+		st.st_size > offset )
+	{
+		void* data = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno( fp ), 0 );
+		if( data != MAP_FAILED )
+		{
+			madvise( data, st.st_size, MADV_SEQUENTIAL );
+			const char* text = static_cast< const char* >( data );
+			const bool ok = parse( text + offset, text + st.st_size );
+			munmap( data, st.st_size );
+			fseek( fp, 0, SEEK_END );
+			return ok;
+		}
+	}
+#endif
+	// pipes and the like are read to the end first
+	vector< char > text;
+	char buffer[ 1 << 16 ];
+	size_t n;
+	while( ( n = fread( buffer, 1, sizeof( buffer ), fp ) ) > 0 )
+	{
+		text.insert( text.end(), buffer, buffer + n );
+	}
+	return parse( text.data(), text.data() + text.size() );
+}
+
+bool ObjLoader::load( const char* filename )
+{
+	FILE* fp = fopen( filename, "rb" );
+	if( !fp )
+	{
+		cerr << "Failed to open " << filename << endl;
+		return false;
+	}
+	const bool ok = load( fp );
+	fclose( fp );
+	return ok;
+}
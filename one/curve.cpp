@@ -1,5 +1,6 @@
 #include "curve.h"
 #include "extra.h"
+#include "Trace.h"
 #ifdef WIN32
 #include <windows.h>
 #endif
@@ -90,6 +91,7 @@ Curve evalCommon( const vector< Vector3f >& P,
 
 Curve evalBezier( const vector< Vector3f >& P, unsigned steps )
 {
+    TRACE_SCOPE( "evalBezier" );
     // Check
     if( P.size() < 4 || P.size() % 3 != 1 )
     {
@@ -125,6 +127,7 @@ Curve evalBezier( const vector< Vector3f >& P, unsigned steps )
 
 Curve evalBspline( const vector< Vector3f >& P, unsigned steps )
 {
+    TRACE_SCOPE( "evalBspline" );
     // Check
     if( P.size() < 4 )
     {
@@ -16,6 +16,9 @@
 #include "surf.h"
 #include "extra.h"
 #include "camera.h"
+#include "bitmap.h"
+#include "SoftRasterizer.h"
+#include "Trace.h"
 
 using namespace std;
 
@@ -68,6 +71,7 @@ namespace
     void initRendering();
     void loadObjects(int argc, char *argv[]);
     void makeDisplayLists();
+    bool renderImage(const char *filename, int width, int height);
 
 #ifdef DEBUG
     void display_modelview(GLfloat mat[16]) {
@@ -115,6 +119,11 @@ namespace
         case 'P':
             gPointMode = (gPointMode+1)%2;
             break;            
+#ifdef TRACE
+        case 't':
+            Trace::write("a1_trace.json");
+            break;
+#endif
         default:
             cout << "Unhandled key press " << key << "." << endl;        
         }
@@ -194,6 +203,7 @@ namespace
     // This function is responsible for displaying the object.
     void drawScene(void)
     {
+        TRACE_SCOPE("drawScene");
         // Clear the rendering window
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -276,7 +286,7 @@ namespace
     {
         if (argc < 2)
         {
-            cerr<< "usage: " << argv[0] << " SWPFILE [OBJPREFIX] " << endl;
+            cerr<< "usage: " << argv[0] << " [-render FILE.bmp] SWPFILE [OBJPREFIX] " << endl;
             exit(0);
         }
 
@@ -342,6 +352,7 @@ namespace
 
     void makeDisplayLists()
     {
+        TRACE_SCOPE("makeDisplayLists");
         gCurveLists[1] = glGenLists(1);
         gCurveLists[2] = glGenLists(1);
         gSurfaceLists[1] = glGenLists(1);
@@ -438,6 +449,60 @@ namespace
         glEndList();
 
     }
+
+    // Draws what the window shows at first (shaded surfaces and the
+    // curves) with SoftRasterizer, without a window or a GL context, and
+    // writes it to a BMP file.
+    bool renderImage(const char *filename, int width, int height)
+    {
+        TRACE_SCOPE("renderImage");
+        // gluPerspective() and gluLookAt() as in the camera
+        const Matrix4f projection = Matrix4f::perspectiveProjection(
+            50 * float(M_PI) / 180, float(width) / height, 1, 1000, false);
+        const Matrix4f view = Matrix4f::lookAt(
+            Vector3f(0, 0, camera.GetDistance()), Vector3f::ZERO, Vector3f::UP)
+            * camera.GetRotation() * Matrix4f::translation(-camera.GetCenter());
+
+        SoftRasterizer raster(width, height);
+        raster.setProjection(projection);
+        raster.setModelView(view);
+        const RasterMaterial material = { { 0.4f, 0.4f, 0.4f }, { 0.9f, 0.9f, 0.9f }, 50 };
+        raster.setMaterial(material);
+        raster.clear(0, 0, 0);
+
+        // drawSurface() culls back faces
+        raster.setCulling(true);
+        for (unsigned i=0; i<gSurfaces.size(); i++)
+        {
+            const Surface &surface = gSurfaces[i];
+            if (surface.VF.empty())
+                continue;
+            raster.drawTriangles(&surface.VV[0], &surface.VN[0], sizeof(Vector3f),
+                                 surface.VV.size(), &surface.VF[0][0], surface.VF.size());
+        }
+
+        const float white[] = {1, 1, 1};
+        for (unsigned i=0; i<gCurves.size(); i++)
+        {
+            const Curve &curve = gCurves[i];
+            if (curve.size() < 2)
+                continue;
+            vector<unsigned> lines;
+            for (unsigned j=0; j+1<curve.size(); j++)
+            {
+                lines.push_back(j);
+                lines.push_back(j+1);
+            }
+            raster.drawLines(&curve[0].V, sizeof(CurvePoint), curve.size(),
+                             &lines[0], curve.size() - 1, white);
+        }
+
+        vector<unsigned char> file;
+        encodeBMP(width, height, raster.pixels(), file);
+        ofstream out(filename, ios::binary);
+        out.write(reinterpret_cast<const char *>(&file[0]), file.size());
+        return bool(out);
+    }
     
 }
 
@@ -445,9 +510,36 @@ namespace
 // Set up OpenGL, define the callbacks and start the main loop
 int main( int argc, char* argv[] )
 {
+    // -render FILE.bmp draws the first frame into FILE.bmp and exits,
+    // for machines without a display
+    const char *renderFile = NULL;
+    if (argc > 2 && string(argv[1]) == "-render")
+    {
+        renderFile = argv[2];
+        argv[2] = argv[0];
+        argc -= 2;
+        argv += 2;
+    }
+
+#ifdef TRACE
+    Trace::writeAtExit("a1_trace.json");
+#endif
     // Load in from standard input
     loadObjects(argc, argv);
 
+    if (renderFile)
+    {
+        camera.SetDistance(10);
+        camera.SetCenter(Vector3f(0,0,0));
+        if (!renderImage(renderFile, 600, 600))
+        {
+            cerr << "\acould not write " << renderFile << endl;
+            return -1;
+        }
+        cerr << "wrote " << renderFile << endl;
+        return 0;
+    }
+
     glutInit(&argc,argv);
 
     // We're going to animate it, so double buffer 
@@ -1,5 +1,6 @@
 #include "surf.h"
 #include "extra.h"
+#include "Trace.h"
 #ifdef DEBUG
 #include <cstdio>
 #include <cassert>
@@ -8,6 +9,10 @@ using namespace std;
 
 namespace
 {
+    // Distance in floats between consecutive curve points and vertices,
+    // for the batch transforms
+    const int CP_STRIDE = sizeof(CurvePoint) / sizeof(float);
+    const int V3_STRIDE = sizeof(Vector3f) / sizeof(float);
     
     // We're only implenting swept surfaces where the profile curve is
     // flat on the xy-plane.  This is a check function.
@@ -70,6 +75,7 @@ void buildFace(std::vector<Tup3u> & VF,
 
 Surface makeSurfRev(const Curve &profile, unsigned steps)
 {
+    TRACE_SCOPE("makeSurfRev");
     Surface surface;
     auto & VV = surface.VV;
     auto & VN = surface.VN;
@@ -84,24 +90,23 @@ Surface makeSurfRev(const Curve &profile, unsigned steps)
 
     // Here you should build the surface.  See surf.h for details.
 
-    // Build VV and VN
+    // Build VV and VN, one rotated copy of the profile per step
+    VV.resize(steps * lenProfile);
+    VN.resize(steps * lenProfile);
     for (size_t i = 0; i != steps; ++i) {
-        bool isSingular = true;
         float ang = i * 2*M_PI / (float)steps;
         Matrix3f Ry = Matrix3f::rotateY(ang);  // by default counterclock
-        Matrix3f Ry_inv_t = Ry.inverse(&isSingular).transposed();
-#ifdef DEBUG
-        assert(!isSingular);
-#endif
-        for (size_t j = 0; j != lenProfile; ++j) {
-            Vector3f V = Ry * profile[j].V;
-            // -1 reverses the norm so that it points OUT of face
-            // Note, put -1 outside parenthesis, 
-            //  otherwise N_0 will be zero, weird behavior
-            Vector3f N = -1 * (Ry_inv_t * profile[j].N);
-            VV.push_back(V);
-            VN.push_back(N);
-        }
+        Vector3f *V = &VV[i * lenProfile];
+        Vector3f *N = &VN[i * lenProfile];
+        Ry.transform(&profile[0].V[0], &V[0][0], lenProfile,
+                     CP_STRIDE, V3_STRIDE);
+        // Ry is orthonormal, so its normal matrix, the inverse
+        // transpose, is Ry itself
+        Ry.transform(&profile[0].N[0], &N[0][0], lenProfile,
+                     CP_STRIDE, V3_STRIDE);
+        // reverse the norm so that it points OUT of face
+        for (size_t j = 0; j != lenProfile; ++j)
+            N[j].negate();
     }
 #ifdef DEBUG
     for (size_t i = 0; i != VN.size(); ++i)
@@ -138,6 +143,7 @@ Matrix4f makeFrame(const CurvePoint &cp) {
 //   N2 = M_swp * (M_xyz^-1 * N1)
 Surface makeGenCyl(const Curve &profile, const Curve &sweep )
 {
+    TRACE_SCOPE("makeGenCyl");
     Surface surface;
     auto & VV = surface.VV;
     auto & VN = surface.VN;
@@ -153,8 +159,10 @@ Surface makeGenCyl(const Curve &profile, const Curve &sweep )
 
     // Here you should build the surface.  See surf.h for details.
 
-    Matrix4f F_xyz_inv = Matrix4f::identity().inverse();
+    Matrix4f F_xyz_inv = Matrix4f::identity();
 
+    VV.resize(lenSweep * lenProfile);
+    VN.resize(lenSweep * lenProfile);
     for (size_t i = 0; i != lenSweep; ++i) {
         CurvePoint sp = sweep[i];    // sweep point
         Matrix4f F_swp(makeFrame(sp));
@@ -162,28 +170,16 @@ Surface makeGenCyl(const Curve &profile, const Curve &sweep )
         cout << "F_swp: " << endl;
         F_swp.print();
 #endif
-        for (size_t j = 0; j != lenProfile; ++j) {
-            CurvePoint pp = profile[j];  // profile point
-
-            // VV
-            Vector4f P_abs_1(pp.V, 1);
-            // It's faster to do mat-vec product first
-            Vector4f P_swp = F_swp * (F_xyz_inv * P_abs_1);
-#ifdef DEBUG
-            cout << "P_abs_1: " << endl;
-            P_abs_1.print();
-            cout << "P_swp: " << endl;
-            P_swp.print();
-#endif 
-            VV.push_back(P_swp.xyz());
-
-            // VN
-            Vector3f N = 
-                F_swp.getSubmatrix3x3(0,0) *
-                (F_xyz_inv.getSubmatrix3x3(0,0) * pp.N);
-            N *= -1;  // reverse for pointing out
-            VN.push_back(N);
-        }
+        // One matrix per sweep point, applied to the whole profile
+        Matrix4f M = F_swp * F_xyz_inv;
+        Vector3f *V = &VV[i * lenProfile];
+        Vector3f *N = &VN[i * lenProfile];
+        M.transformPoints(&profile[0].V[0], &V[0][0], lenProfile,
+                          CP_STRIDE, V3_STRIDE);
+        M.transformDirections(&profile[0].N[0], &N[0][0], lenProfile,
+                              CP_STRIDE, V3_STRIDE);
+        for (size_t j = 0; j != lenProfile; ++j)
+            N[j].negate();  // reverse for pointing out
     }
 #ifdef DEBUG
     for (size_t i = 0; i != VN.size(); ++i)
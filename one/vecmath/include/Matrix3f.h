@@ -2,10 +2,12 @@
 #define MATRIX3F_H
 
 #include <cstdio>
+#include <cstring>
+
+#include "Vector3f.h"
 
 class Matrix2f;
 class Quat4f;
-class Vector3f;
 
 // 3x3 Matrix, stored in column major order (OpenGL style)
 class Matrix3f
@@ -46,9 +48,28 @@ public:
 	float determinant() const;
 	Matrix3f inverse( bool* pbIsSingular = NULL, float epsilon = 0.f ) const; // TODO: invert in place as well
 
+	// The inverse of a rotation (or reflection) matrix, its transpose.
+	// Builds with DEBUG defined assert isOrthonormal().
+	Matrix3f inverseOrthonormal() const;
+
+	// true if the columns are unit length and perpendicular, i.e. every
+	// entry of transposed() * this is within epsilon of the identity
+	bool isOrthonormal( float epsilon = 1e-4f ) const;
+
 	void transpose();
 	Matrix3f transposed() const;
 
+	// ---- Batch transforms ----
+	// Multiply n xyz triples from in and write them to out (which may be
+	// the same array). Consecutive triples are inStride / outStride
+	// floats apart.
+	void transform( const float* in, float* out, int n, int inStride = 3, int outStride = 3 ) const;
+	void transform( const Vector3f* in, Vector3f* out, int n ) const;
+
+	// normals: multiplied by the inverse transpose, not renormalized
+	void transformNormals( const float* in, float* out, int n, int inStride = 3, int outStride = 3 ) const;
+	void transformNormals( const Vector3f* in, Vector3f* out, int n ) const;
+
 	// ---- Utility ----
 	operator float* (); // automatic type conversion for GL
 	void print();
@@ -83,4 +104,128 @@ Vector3f operator * ( const Matrix3f& m, const Vector3f& v );
 // Matrix-Matrix multiplication
 Matrix3f operator * ( const Matrix3f& x, const Matrix3f& y );
 
+//////////////////////////////////////////////////////////////////////////
+// Inline definitions
+//////////////////////////////////////////////////////////////////////////
+
+inline Matrix3f::Matrix3f( float fill )
+{
+	for( int i = 0; i < 9; ++i )
+	{
+		m_elements[ i ] = fill;
+	}
+}
+
+inline Matrix3f::Matrix3f( const Matrix3f& rm )
+{
+	memcpy( m_elements, rm.m_elements, 9 * sizeof( float ) );
+}
+
+inline Matrix3f& Matrix3f::operator = ( const Matrix3f& rm )
+{
+	if( this != &rm )
+	{
+		memcpy( m_elements, rm.m_elements, 9 * sizeof( float ) );
+	}
+	return *this;
+}
+
+inline const float& Matrix3f::operator () ( int i, int j ) const
+{
+	return m_elements[ j * 3 + i ];
+}
+
+inline float& Matrix3f::operator () ( int i, int j )
+{
+	return m_elements[ j * 3 + i ];
+}
+
+inline Vector3f Matrix3f::getRow( int i ) const
+{
+	return Vector3f
+	(
+		m_elements[ i ],
+		m_elements[ i + 3 ],
+		m_elements[ i + 6 ]
+	);
+}
+
+inline void Matrix3f::setRow( int i, const Vector3f& v )
+{
+	m_elements[ i ] = v.x();
+	m_elements[ i + 3 ] = v.y();
+	m_elements[ i + 6 ] = v.z();
+}
+
+inline Vector3f Matrix3f::getCol( int j ) const
+{
+	int colStart = 3 * j;
+
+	return Vector3f
+	(
+		m_elements[ colStart ],
+		m_elements[ colStart + 1 ],
+		m_elements[ colStart + 2 ]			
+	);
+}
+
+inline void Matrix3f::setCol( int j, const Vector3f& v )
+{
+	int colStart = 3 * j;
+
+	m_elements[ colStart ] = v.x();
+	m_elements[ colStart + 1 ] = v.y();
+	m_elements[ colStart + 2 ] = v.z();
+}
+
+inline Matrix3f::operator float* ()
+{
+	return m_elements;
+}
+
+inline void Matrix3f::transform( const Vector3f* in, Vector3f* out, int n ) const
+{
+	const int stride = sizeof( Vector3f ) / sizeof( float );
+	transform( reinterpret_cast< const float* >( in ), reinterpret_cast< float* >( out ), n, stride, stride );
+}
+
+inline void Matrix3f::transformNormals( const Vector3f* in, Vector3f* out, int n ) const
+{
+	const int stride = sizeof( Vector3f ) / sizeof( float );
+	transformNormals( reinterpret_cast< const float* >( in ), reinterpret_cast< float* >( out ), n, stride, stride );
+}
+
+inline Vector3f operator * ( const Matrix3f& m, const Vector3f& v )
+{
+	Vector3f output( 0, 0, 0 );
+
+	for( int i = 0; i < 3; ++i )
+	{
+		for( int j = 0; j < 3; ++j )
+		{
+			output[ i ] += m( i, j ) * v[ j ];
+		}
+	}
+
+	return output;
+}
+
+inline Matrix3f operator * ( const Matrix3f& x, const Matrix3f& y )
+{
+	Matrix3f product; // zeroes
+
+	for( int i = 0; i < 3; ++i )
+	{
+		for( int j = 0; j < 3; ++j )
+		{
+			for( int k = 0; k < 3; ++k )
+			{
+				product( i, k ) += x( i, j ) * y( j, k );
+			}
+		}
+	}
+
+	return product;
+}
+
 #endif // MATRIX3F_H
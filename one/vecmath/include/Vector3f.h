@@ -1,9 +1,13 @@
 #ifndef VECTOR_3F_H
 #define VECTOR_3F_H
 
+#include <cmath>
+
+#include "vecmath_simd.h"
+
 class Vector2f;
 
-class Vector3f
+class VECMATH_ALIGN Vector3f
 {
 public:
 
@@ -79,7 +83,12 @@ public:
 
 private:
 
+#ifdef VECMATH_USE_SSE
+	// xyz plus a pad lane that stays 0
+	float m_elements[ 4 ];
+#else
 	float m_elements[ 3 ];
+#endif
 
 };
 
@@ -100,4 +109,324 @@ Vector3f operator / ( const Vector3f& v, float f );
 bool operator == ( const Vector3f& v0, const Vector3f& v1 );
 bool operator != ( const Vector3f& v0, const Vector3f& v1 );
 
+//////////////////////////////////////////////////////////////////////////
+// Inline definitions
+//////////////////////////////////////////////////////////////////////////
+
+// Accessors and arithmetic are defined in the headers so they inline
+// into callers' loops without link-time optimization; the rest of the
+// library is in libvecmath.a.
+
+#ifdef VECMATH_USE_SSE
+inline __m128 vecmath_load( const Vector3f& v )
+{
+	return _mm_load_ps( v );
+}
+
+inline Vector3f vecmath_store3( __m128 a )
+{
+	Vector3f out;
+	_mm_store_ps( out, a );
+	return out;
+}
+#endif
+
+inline Vector3f::Vector3f( float f )
+{
+    m_elements[0] = f;
+    m_elements[1] = f;
+    m_elements[2] = f;
+#ifdef VECMATH_USE_SSE
+	m_elements[3] = 0;
+#endif
+}
+
+inline Vector3f::Vector3f( float x, float y, float z )
+{
+    m_elements[0] = x;
+    m_elements[1] = y;
+    m_elements[2] = z;
+#ifdef VECMATH_USE_SSE
+	m_elements[3] = 0;
+#endif
+}
+
+inline Vector3f::Vector3f( const Vector3f& rv )
+{
+#ifdef VECMATH_USE_SSE
+	_mm_store_ps( m_elements, _mm_load_ps( rv.m_elements ) );
+#else
+    m_elements[0] = rv[0];
+    m_elements[1] = rv[1];
+    m_elements[2] = rv[2];
+#endif
+}
+
+inline Vector3f& Vector3f::operator = ( const Vector3f& rv )
+{
+#ifdef VECMATH_USE_SSE
+	_mm_store_ps( m_elements, _mm_load_ps( rv.m_elements ) );
+#else
+    if( this != &rv )
+    {
+        m_elements[0] = rv[0];
+        m_elements[1] = rv[1];
+        m_elements[2] = rv[2];
+    }
+#endif
+    return *this;
+}
+
+inline const float& Vector3f::operator [] ( int i ) const
+{
+    return m_elements[i];
+}
+
+inline float& Vector3f::operator [] ( int i )
+{
+    return m_elements[i];
+}
+
+inline float& Vector3f::x()
+{
+    return m_elements[0];
+}
+
+inline float& Vector3f::y()
+{
+    return m_elements[1];
+}
+
+inline float& Vector3f::z()
+{
+    return m_elements[2];
+}
+
+inline float Vector3f::x() const
+{
+    return m_elements[0];
+}
+
+inline float Vector3f::y() const
+{
+    return m_elements[1];
+}
+
+inline float Vector3f::z() const
+{
+    return m_elements[2];
+}
+
+inline float Vector3f::abs() const
+{
+	return sqrt( m_elements[0] * m_elements[0] + m_elements[1] * m_elements[1] + m_elements[2] * m_elements[2] );
+}
+
+inline float Vector3f::absSquared() const
+{
+#ifdef VECMATH_USE_SSE
+	__m128 a = _mm_load_ps( m_elements );
+	return vecmath_hsum( _mm_mul_ps( a, a ) );
+#else
+    return
+        (
+            m_elements[0] * m_elements[0] +
+            m_elements[1] * m_elements[1] +
+            m_elements[2] * m_elements[2]
+        );
+#endif
+}
+
+inline void Vector3f::normalize()
+{
+	float norm = abs();
+	m_elements[0] /= norm;
+	m_elements[1] /= norm;
+	m_elements[2] /= norm;
+}
+
+inline Vector3f Vector3f::normalized() const
+{
+	float norm = abs();
+	return Vector3f
+		(
+			m_elements[0] / norm,
+			m_elements[1] / norm,
+			m_elements[2] / norm
+		);
+}
+
+inline void Vector3f::negate()
+{
+	m_elements[0] = -m_elements[0];
+	m_elements[1] = -m_elements[1];
+	m_elements[2] = -m_elements[2];
+}
+
+inline Vector3f::operator const float* () const
+{
+    return m_elements;
+}
+
+inline Vector3f::operator float* ()
+{
+    return m_elements;
+}
+
+inline Vector3f& Vector3f::operator += ( const Vector3f& v )
+{
+#ifdef VECMATH_USE_SSE
+	_mm_store_ps( m_elements, _mm_add_ps( _mm_load_ps( m_elements ), _mm_load_ps( v.m_elements ) ) );
+#else
+	m_elements[ 0 ] += v.m_elements[ 0 ];
+	m_elements[ 1 ] += v.m_elements[ 1 ];
+	m_elements[ 2 ] += v.m_elements[ 2 ];
+#endif
+	return *this;
+}
+
+inline Vector3f& Vector3f::operator -= ( const Vector3f& v )
+{
+#ifdef VECMATH_USE_SSE
+	_mm_store_ps( m_elements, _mm_sub_ps( _mm_load_ps( m_elements ), _mm_load_ps( v.m_elements ) ) );
+#else
+	m_elements[ 0 ] -= v.m_elements[ 0 ];
+	m_elements[ 1 ] -= v.m_elements[ 1 ];
+	m_elements[ 2 ] -= v.m_elements[ 2 ];
+#endif
+	return *this;
+}
+
+inline Vector3f& Vector3f::operator *= ( float f )
+{
+#ifdef VECMATH_USE_SSE
+	_mm_store_ps( m_elements, _mm_mul_ps( _mm_load_ps( m_elements ), _mm_set_ps( 0, f, f, f ) ) );
+#else
+	m_elements[ 0 ] *= f;
+	m_elements[ 1 ] *= f;
+	m_elements[ 2 ] *= f;
+#endif
+	return *this;
+}
+
+// static
+inline float Vector3f::dot( const Vector3f& v0, const Vector3f& v1 )
+{
+#ifdef VECMATH_USE_SSE
+	return vecmath_hsum( _mm_mul_ps( vecmath_load( v0 ), vecmath_load( v1 ) ) );
+#else
+    return v0[0] * v1[0] + v0[1] * v1[1] + v0[2] * v1[2];
+#endif
+}
+
+// static
+inline Vector3f Vector3f::cross( const Vector3f& v0, const Vector3f& v1 )
+{
+#ifdef VECMATH_USE_SSE
+	// ( v0 * v1.yzx - v0.yzx * v1 ).yzx, the pad lane works out to 0
+	__m128 a = vecmath_load( v0 );
+	__m128 b = vecmath_load( v1 );
+	__m128 a_yzx = _mm_shuffle_ps( a, a, _MM_SHUFFLE( 3, 0, 2, 1 ) );
+	__m128 b_yzx = _mm_shuffle_ps( b, b, _MM_SHUFFLE( 3, 0, 2, 1 ) );
+	__m128 c = _mm_sub_ps( _mm_mul_ps( a, b_yzx ), _mm_mul_ps( a_yzx, b ) );
+	return vecmath_store3( _mm_shuffle_ps( c, c, _MM_SHUFFLE( 3, 0, 2, 1 ) ) );
+#else
+    return Vector3f
+        (
+            v0.y() * v1.z() - v0.z() * v1.y(),
+            v0.z() * v1.x() - v0.x() * v1.z(),
+            v0.x() * v1.y() - v0.y() * v1.x()
+        );
+#endif
+}
+
+// static
+inline Vector3f Vector3f::lerp( const Vector3f& v0, const Vector3f& v1, float alpha )
+{
+	return alpha * ( v1 - v0 ) + v0;
+}
+
+inline Vector3f operator + ( const Vector3f& v0, const Vector3f& v1 )
+{
+#ifdef VECMATH_USE_SSE
+	return vecmath_store3( _mm_add_ps( vecmath_load( v0 ), vecmath_load( v1 ) ) );
+#else
+    return Vector3f( v0[0] + v1[0], v0[1] + v1[1], v0[2] + v1[2] );
+#endif
+}
+
+inline Vector3f operator - ( const Vector3f& v0, const Vector3f& v1 )
+{
+#ifdef VECMATH_USE_SSE
+	return vecmath_store3( _mm_sub_ps( vecmath_load( v0 ), vecmath_load( v1 ) ) );
+#else
+    return Vector3f( v0[0] - v1[0], v0[1] - v1[1], v0[2] - v1[2] );
+#endif
+}
+
+inline Vector3f operator * ( const Vector3f& v0, const Vector3f& v1 )
+{
+#ifdef VECMATH_USE_SSE
+	return vecmath_store3( _mm_mul_ps( vecmath_load( v0 ), vecmath_load( v1 ) ) );
+#else
+    return Vector3f( v0[0] * v1[0], v0[1] * v1[1], v0[2] * v1[2] );
+#endif
+}
+
+inline Vector3f operator / ( const Vector3f& v0, const Vector3f& v1 )
+{
+#ifdef VECMATH_USE_SSE
+	// 0 / 0 in the pad lane
+	return vecmath_store3( vecmath_mask3( _mm_div_ps( vecmath_load( v0 ), vecmath_load( v1 ) ) ) );
+#else
+    return Vector3f( v0[0] / v1[0], v0[1] / v1[1], v0[2] / v1[2] );
+#endif
+}
+
+inline Vector3f operator - ( const Vector3f& v )
+{
+#ifdef VECMATH_USE_SSE
+	return vecmath_store3( _mm_xor_ps( vecmath_load( v ), _mm_set_ps( 0.f, -0.f, -0.f, -0.f ) ) );
+#else
+    return Vector3f( -v[0], -v[1], -v[2] );
+#endif
+}
+
+inline Vector3f operator * ( float f, const Vector3f& v )
+{
+#ifdef VECMATH_USE_SSE
+	return vecmath_store3( _mm_mul_ps( vecmath_load( v ), _mm_set_ps( 0, f, f, f ) ) );
+#else
+    return Vector3f( v[0] * f, v[1] * f, v[2] * f );
+#endif
+}
+
+inline Vector3f operator * ( const Vector3f& v, float f )
+{
+#ifdef VECMATH_USE_SSE
+	return vecmath_store3( _mm_mul_ps( vecmath_load( v ), _mm_set_ps( 0, f, f, f ) ) );
+#else
+    return Vector3f( v[0] * f, v[1] * f, v[2] * f );
+#endif
+}
+
+inline Vector3f operator / ( const Vector3f& v, float f )
+{
+#ifdef VECMATH_USE_SSE
+	return vecmath_store3( _mm_div_ps( vecmath_load( v ), _mm_set_ps( 1, f, f, f ) ) );
+#else
+    return Vector3f( v[0] / f, v[1] / f, v[2] / f );
+#endif
+}
+
+inline bool operator == ( const Vector3f& v0, const Vector3f& v1 )
+{
+    return( v0.x() == v1.x() && v0.y() == v1.y() && v0.z() == v1.z() );
+}
+
+inline bool operator != ( const Vector3f& v0, const Vector3f& v1 )
+{
+    return !( v0 == v1 );
+}
+
 #endif // VECTOR_3F_H
@@ -11,14 +11,6 @@
 #include "Vector3f.h"
 #include "Vector4f.h"
 
-Matrix4f::Matrix4f( float fill )
-{
-	for( int i = 0; i < 16; ++i )
-	{
-		m_elements[ i ] = fill;
-	}
-}
-
 Matrix4f::Matrix4f( float m00, float m01, float m02, float m03,
 				   float m10, float m11, float m12, float m13,
 				   float m20, float m21, float m22, float m23,
@@ -47,9 +39,17 @@ Matrix4f::Matrix4f( float m00, float m01, float m02, float m03,
 
 Matrix4f& Matrix4f::operator/=(float d)
 {
+#ifdef VECMATH_USE_SSE
+	__m128 dd = _mm_set1_ps( d );
+	for( int j = 0; j < 16; j += 4 )
+	{
+		_mm_store_ps( m_elements + j, _mm_div_ps( _mm_load_ps( m_elements + j ), dd ) );
+	}
+#else
 	for(int ii=0;ii<16;ii++){
 		m_elements[ii]/=d;
 	}
+#endif
 	return *this;
 }
 
@@ -71,72 +71,6 @@ Matrix4f::Matrix4f( const Vector4f& v0, const Vector4f& v1, const Vector4f& v2,
 	}
 }
 
-Matrix4f::Matrix4f( const Matrix4f& rm )
-{
-	memcpy( m_elements, rm.m_elements, 16 * sizeof( float ) );
-}
-
-Matrix4f& Matrix4f::operator = ( const Matrix4f& rm )
-{
-	if( this != &rm )
-	{
-		memcpy( m_elements, rm.m_elements, 16 * sizeof( float ) );
-	}
-	return *this;
-}
-
-const float& Matrix4f::operator () ( int i, int j ) const
-{
-	return m_elements[ j * 4 + i ];
-}
-
-float& Matrix4f::operator () ( int i, int j )
-{
-	return m_elements[ j * 4 + i ];
-}
-
-Vector4f Matrix4f::getRow( int i ) const
-{
-	return Vector4f
-	(
-		m_elements[ i ],
-		m_elements[ i + 4 ],
-		m_elements[ i + 8 ],
-		m_elements[ i + 12 ]
-	);
-}
-
-void Matrix4f::setRow( int i, const Vector4f& v )
-{
-	m_elements[ i ] = v.x();
-	m_elements[ i + 4 ] = v.y();
-	m_elements[ i + 8 ] = v.z();
-	m_elements[ i + 12 ] = v.w();
-}
-
-Vector4f Matrix4f::getCol( int j ) const
-{
-	int colStart = 4 * j;
-
-	return Vector4f
-	(
-		m_elements[ colStart ],
-		m_elements[ colStart + 1 ],
-		m_elements[ colStart + 2 ],
-		m_elements[ colStart + 3 ]
-	);
-}
-
-void Matrix4f::setCol( int j, const Vector4f& v )
-{
-	int colStart = 4 * j;
-
-	m_elements[ colStart ] = v.x();
-	m_elements[ colStart + 1 ] = v.y();
-	m_elements[ colStart + 2 ] = v.z();
-	m_elements[ colStart + 3 ] = v.w();
-}
-
 Matrix2f Matrix4f::getSubmatrix2x2( int i0, int j0 ) const
 {
 	Matrix2f out;
@@ -291,6 +225,129 @@ Matrix4f Matrix4f::inverse( bool* pbIsSingular, float epsilon ) const
 	}
 }
 
+#ifdef DEBUG
+// Whether the last row of m is ( 0 0 0 1 )
+static bool isAffine( const Matrix4f& m )
+{
+	return m( 3, 0 ) == 0 && m( 3, 1 ) == 0 && m( 3, 2 ) == 0 && m( 3, 3 ) == 1;
+}
+#endif
+
+#ifdef VECMATH_USE_SSE
+// a x b, lane w is 0 if it is in a and b
+static inline __m128 cross( __m128 a, __m128 b )
+{
+	__m128 aYZX = _mm_shuffle_ps( a, a, _MM_SHUFFLE( 3, 0, 2, 1 ) );
+	__m128 bYZX = _mm_shuffle_ps( b, b, _MM_SHUFFLE( 3, 0, 2, 1 ) );
+	__m128 aZXY = _mm_shuffle_ps( a, a, _MM_SHUFFLE( 3, 1, 0, 2 ) );
+	__m128 bZXY = _mm_shuffle_ps( b, b, _MM_SHUFFLE( 3, 1, 0, 2 ) );
+	return _mm_sub_ps( _mm_mul_ps( aYZX, bZXY ), _mm_mul_ps( aZXY, bYZX ) );
+}
+
+// Writes the affine transform whose 3x3 block has rows r0, r1, r2 (with
+// w lanes of 0) and whose translation is -( that block ) * t
+static inline void storeAffine( float* out, __m128 r0, __m128 r1, __m128 r2, const float* t )
+{
+	__m128 r3 = _mm_setzero_ps();
+	_MM_TRANSPOSE4_PS( r0, r1, r2, r3 );
+	__m128 c3 = _mm_mul_ps( r0, _mm_set1_ps( t[ 0 ] ) );
+	c3 = _mm_add_ps( c3, _mm_mul_ps( r1, _mm_set1_ps( t[ 1 ] ) ) );
+	c3 = _mm_add_ps( c3, _mm_mul_ps( r2, _mm_set1_ps( t[ 2 ] ) ) );
+	_mm_store_ps( out, r0 );
+	_mm_store_ps( out + 4, r1 );
+	_mm_store_ps( out + 8, r2 );
+	_mm_store_ps( out + 12, _mm_sub_ps( _mm_setr_ps( 0, 0, 0, 1 ), c3 ) );
+}
+#endif
+
+Matrix4f Matrix4f::inverseAffine( bool* pbIsSingular, float epsilon ) const
+{
+#ifdef DEBUG
+	assert( isAffine( *this ) );
+#endif
+
+	// The rows of A^-1 are the cross products of the columns of A over
+	// the determinant, as in Matrix3f::inverse()
+	const float* m = m_elements;
+#ifdef VECMATH_USE_SSE
+	__m128 c0 = _mm_load_ps( m );
+	__m128 c1 = _mm_load_ps( m + 4 );
+	__m128 c2 = _mm_load_ps( m + 8 );
+	__m128 r0 = cross( c1, c2 );
+	__m128 r1 = cross( c2, c0 );
+	__m128 r2 = cross( c0, c1 );
+	float determinant = vecmath_hsum( _mm_mul_ps( c0, r0 ) );
+#else
+	float r0[ 3 ] = { m[ 5 ] * m[ 10 ] - m[ 6 ] * m[ 9 ], m[ 6 ] * m[ 8 ] - m[ 4 ] * m[ 10 ], m[ 4 ] * m[ 9 ] - m[ 5 ] * m[ 8 ] };
+	float r1[ 3 ] = { m[ 9 ] * m[ 2 ] - m[ 10 ] * m[ 1 ], m[ 10 ] * m[ 0 ] - m[ 8 ] * m[ 2 ], m[ 8 ] * m[ 1 ] - m[ 9 ] * m[ 0 ] };
+	float r2[ 3 ] = { m[ 1 ] * m[ 6 ] - m[ 2 ] * m[ 5 ], m[ 2 ] * m[ 4 ] - m[ 0 ] * m[ 6 ], m[ 0 ] * m[ 5 ] - m[ 1 ] * m[ 4 ] };
+	float determinant = m[ 0 ] * r0[ 0 ] + m[ 1 ] * r0[ 1 ] + m[ 2 ] * r0[ 2 ];
+#endif
+
+	bool isSingular = ( fabs( determinant ) < epsilon );
+	if( pbIsSingular != NULL )
+	{
+		*pbIsSingular = isSingular;
+	}
+	if( isSingular )
+	{
+		return Matrix4f();
+	}
+
+	float reciprocalDeterminant = 1.0f / determinant;
+	Matrix4f out;
+#ifdef VECMATH_USE_SSE
+	__m128 rd = _mm_set1_ps( reciprocalDeterminant );
+	storeAffine( out.m_elements, _mm_mul_ps( r0, rd ), _mm_mul_ps( r1, rd ), _mm_mul_ps( r2, rd ), m + 12 );
+#else
+	float* o = out.m_elements;
+	for( int j = 0; j < 3; ++j )
+	{
+		o[ 4 * j ] = r0[ j ] * reciprocalDeterminant;
+		o[ 4 * j + 1 ] = r1[ j ] * reciprocalDeterminant;
+		o[ 4 * j + 2 ] = r2[ j ] * reciprocalDeterminant;
+	}
+	for( int i = 0; i < 3; ++i )
+	{
+		o[ 12 + i ] = -( o[ i ] * m[ 12 ] + o[ 4 + i ] * m[ 13 ] + o[ 8 + i ] * m[ 14 ] );
+	}
+	o[ 15 ] = 1;
+#endif
+
+	return out;
+}
+
+Matrix4f Matrix4f::inverseRigid() const
+{
+#ifdef DEBUG
+	assert( isAffine( *this ) );
+	assert( getSubmatrix3x3( 0, 0 ).isOrthonormal() );
+#endif
+
+	// The rows of A^-1 = A^T are the columns of A
+	const float* m = m_elements;
+	Matrix4f out;
+#ifdef VECMATH_USE_SSE
+	storeAffine( out.m_elements, _mm_load_ps( m ), _mm_load_ps( m + 4 ), _mm_load_ps( m + 8 ), m + 12 );
+#else
+	float* o = out.m_elements;
+	for( int i = 0; i < 3; ++i )
+	{
+		for( int j = 0; j < 3; ++j )
+		{
+			o[ 4 * j + i ] = m[ 4 * i + j ];
+		}
+	}
+	for( int i = 0; i < 3; ++i )
+	{
+		o[ 12 + i ] = -( o[ i ] * m[ 12 ] + o[ 4 + i ] * m[ 13 ] + o[ 8 + i ] * m[ 14 ] );
+	}
+	o[ 15 ] = 1;
+#endif
+
+	return out;
+}
+
 void Matrix4f::transpose()
 {
 	float temp;
@@ -309,6 +366,17 @@ void Matrix4f::transpose()
 Matrix4f Matrix4f::transposed() const
 {
 	Matrix4f out;
+#ifdef VECMATH_USE_SSE
+	__m128 c0 = _mm_load_ps( m_elements );
+	__m128 c1 = _mm_load_ps( m_elements + 4 );
+	__m128 c2 = _mm_load_ps( m_elements + 8 );
+	__m128 c3 = _mm_load_ps( m_elements + 12 );
+	_MM_TRANSPOSE4_PS( c0, c1, c2, c3 );
+	_mm_store_ps( out.m_elements, c0 );
+	_mm_store_ps( out.m_elements + 4, c1 );
+	_mm_store_ps( out.m_elements + 8, c2 );
+	_mm_store_ps( out.m_elements + 12, c3 );
+#else
 	for( int i = 0; i < 4; ++i )
 	{
 		for( int j = 0; j < 4; ++j )
@@ -316,20 +384,77 @@ Matrix4f Matrix4f::transposed() const
 			out( j, i ) = ( *this )( i, j );
 		}
 	}
+#endif
 
 	return out;
 }
 
-Matrix4f::operator float* ()
+void Matrix4f::transformPoints( const float* in, float* out, int n, int inStride, int outStride ) const
 {
-	return m_elements;
+#ifdef VECMATH_HAVE_SSE
+	__m128 c0 = _mm_loadu_ps( m_elements );
+	__m128 c1 = _mm_loadu_ps( m_elements + 4 );
+	__m128 c2 = _mm_loadu_ps( m_elements + 8 );
+	__m128 c3 = _mm_loadu_ps( m_elements + 12 );
+	for( int k = 0; k < n; ++k )
+	{
+		const float* p = in + k * inStride;
+		__m128 r = _mm_mul_ps( c0, _mm_set1_ps( p[ 0 ] ) );
+		r = _mm_add_ps( r, _mm_mul_ps( c1, _mm_set1_ps( p[ 1 ] ) ) );
+		r = _mm_add_ps( r, _mm_mul_ps( c2, _mm_set1_ps( p[ 2 ] ) ) );
+		vecmath_storeXYZ( out + k * outStride, _mm_add_ps( r, c3 ) );
+	}
+#else
+	const float* m = m_elements;
+	for( int k = 0; k < n; ++k )
+	{
+		const float* p = in + k * inStride;
+		float* q = out + k * outStride;
+		float x = p[ 0 ];
+		float y = p[ 1 ];
+		float z = p[ 2 ];
+		q[ 0 ] = m[ 0 ] * x + m[ 4 ] * y + m[ 8 ] * z + m[ 12 ];
+		q[ 1 ] = m[ 1 ] * x + m[ 5 ] * y + m[ 9 ] * z + m[ 13 ];
+		q[ 2 ] = m[ 2 ] * x + m[ 6 ] * y + m[ 10 ] * z + m[ 14 ];
+	}
+#endif
 }
 
-Matrix4f::operator const float* ()const
+void Matrix4f::transformDirections( const float* in, float* out, int n, int inStride, int outStride ) const
 {
-	return m_elements;
+#ifdef VECMATH_HAVE_SSE
+	__m128 c0 = _mm_loadu_ps( m_elements );
+	__m128 c1 = _mm_loadu_ps( m_elements + 4 );
+	__m128 c2 = _mm_loadu_ps( m_elements + 8 );
+	for( int k = 0; k < n; ++k )
+	{
+		const float* p = in + k * inStride;
+		__m128 r = _mm_mul_ps( c0, _mm_set1_ps( p[ 0 ] ) );
+		r = _mm_add_ps( r, _mm_mul_ps( c1, _mm_set1_ps( p[ 1 ] ) ) );
+		r = _mm_add_ps( r, _mm_mul_ps( c2, _mm_set1_ps( p[ 2 ] ) ) );
+		vecmath_storeXYZ( out + k * outStride, r );
+	}
+#else
+	const float* m = m_elements;
+	for( int k = 0; k < n; ++k )
+	{
+		const float* p = in + k * inStride;
+		float* q = out + k * outStride;
+		float x = p[ 0 ];
+		float y = p[ 1 ];
+		float z = p[ 2 ];
+		q[ 0 ] = m[ 0 ] * x + m[ 4 ] * y + m[ 8 ] * z;
+		q[ 1 ] = m[ 1 ] * x + m[ 5 ] * y + m[ 9 ] * z;
+		q[ 2 ] = m[ 2 ] * x + m[ 6 ] * y + m[ 10 ] * z;
+	}
+#endif
 }
 
+void Matrix4f::transformNormals( const float* in, float* out, int n, int inStride, int outStride ) const
+{
+	Matrix3f normalMatrix = getSubmatrix3x3( 0, 0 ).inverse().transposed();
+	normalMatrix.transform( in, out, n, inStride, outStride );
+}
 
 void Matrix4f::print()
 {
@@ -666,40 +791,3 @@ Matrix4f Matrix4f::infinitePerspectiveProjection( float fLeft, float fRight,
 
 	return projection;
 }
-
-//////////////////////////////////////////////////////////////////////////
-// Operators
-//////////////////////////////////////////////////////////////////////////
-
-Vector4f operator * ( const Matrix4f& m, const Vector4f& v )
-{
-	Vector4f output( 0, 0, 0, 0 );
-
-	for( int i = 0; i < 4; ++i )
-	{
-		for( int j = 0; j < 4; ++j )
-		{
-			output[ i ] += m( i, j ) * v[ j ];
-		}
-	}
-
-	return output;
-}
-
-Matrix4f operator * ( const Matrix4f& x, const Matrix4f& y )
-{
-	Matrix4f product; // zeroes
-
-	for( int i = 0; i < 4; ++i )
-	{
-		for( int j = 0; j < 4; ++j )
-		{
-			for( int k = 0; k < 4; ++k )
-			{
-				product( i, k ) += x( i, j ) * y( j, k );
-			}
-		}
-	}
-
-	return product;
-}
@@ -394,7 +394,7 @@ Quat4f Quat4f::fromRotationMatrix( const Matrix3f& m )
 			x = 0.25f * s;
 			y = ( m( 0, 1 ) + m( 1, 0 ) ) / s;
 			z = ( m( 0, 2 ) + m( 2, 0 ) ) / s;
-			w = ( m( 1, 2 ) - m( 2, 1 ) ) / s;
+			w = ( m( 2, 1 ) - m( 1, 2 ) ) / s;
 		}
 		else if( m( 1, 1 ) > m( 2, 2 ) )
 		{
@@ -410,7 +410,7 @@ Quat4f Quat4f::fromRotationMatrix( const Matrix3f& m )
 			x = ( m( 0, 2 ) + m( 2, 0 ) ) / s;
 			y = ( m( 1, 2 ) + m( 2, 1 ) ) / s;
 			z = 0.25f * s;
-			w = ( m( 0, 1 ) - m( 1, 0 ) ) / s;
+			w = ( m( 1, 0 ) - m( 0, 1 ) ) / s;
 		}
 	}
 
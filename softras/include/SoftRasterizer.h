@@ -0,0 +1,100 @@
+#ifndef SOFT_RASTERIZER_H
+#define SOFT_RASTERIZER_H
+
+#include <cstddef>
+#include <vector>
+
+class ThreadPool;
+
+// Material of what is drawn next, like glMaterialfv( GL_FRONT_AND_BACK )
+struct RasterMaterial
+{
+	// GL_AMBIENT_AND_DIFFUSE
+	float diffuse[ 3 ];
+	float specular[ 3 ];
+	float shininess;
+};
+
+// Renders triangles and lines into memory without a GL context, for
+// batch machines that have no display.
+//
+// It follows the fixed function pipeline as the apps set it up: a
+// projection and a modelview matrix (column-major, as glLoadMatrixf()
+// takes them), a GL_LESS depth test for triangles and lines alike,
+// GL_LIGHT0 with a position given in eye space and a white specular
+// color, the default global ambient of 0.2, and no local viewer. Lighting is evaluated per pixel (Phong shading)
+// rather than per vertex. Lines are one pixel wide and unlit.
+//
+// The image is cut into tiles. Every draw call transforms its vertices
+// and sets up its triangles in chunks, sorts them into the tiles they
+// cover, and then rasterizes the tiles, each on one thread of a
+// ThreadPool (see threadpool/). Triangles are drawn in order within
+// every tile, so the image does not depend on the number of threads.
+//
+// Vertex arrays are read with a stride, so std::vector< Vector3f > can
+// be passed as it is, e.g.
+//
+//   raster.drawTriangles( &positions[ 0 ], &normals[ 0 ], sizeof( Vector3f ),
+//       positions.size(), indices, numTriangles );
+class SoftRasterizer
+{
+public:
+	// numThreads counts the calling thread, 0 uses one per hardware
+	// thread
+	SoftRasterizer( int width, int height, unsigned numThreads = 0 );
+	~SoftRasterizer();
+
+	int width() const { return m_width; }
+	int height() const { return m_height; }
+
+	// Fills the color buffer and resets the depth buffer
+	void clear( float r, float g, float b );
+
+	void setProjection( const float* matrix );
+	void setModelView( const float* matrix );
+	// position in eye space, a direction if position[ 3 ] is 0
+	void setLight( const float position[ 4 ], const float diffuse[ 3 ] );
+	void setMaterial( const RasterMaterial& material );
+	// Whether clockwise triangles are skipped, like GL_CULL_FACE
+	void setCulling( bool cullBackFaces );
+
+	// numTriangles triangles of 3 indices into numVertices vertices of
+	// 3 floats each, stride bytes apart. Without normals every triangle
+	// is lit with its face normal.
+	void drawTriangles( const void* positions, const void* normals, size_t stride,
+		size_t numVertices, const unsigned* indices, size_t numTriangles );
+
+	// numLines lines of 2 indices, in color
+	void drawLines( const void* positions, size_t stride, size_t numVertices,
+		const unsigned* indices, size_t numLines, const float color[ 3 ] );
+
+	// width() * height() (R,G,B) pixels, bottom row first, as
+	// glReadPixels() reads them and writeBMP() writes them
+	const unsigned char* pixels() const { return m_pixels.data(); }
+
+private:
+	SoftRasterizer( const SoftRasterizer& );
+	SoftRasterizer& operator=( const SoftRasterizer& );
+
+	// Transforms the vertices, sets up the primitives and draws them
+	void draw( const void* positions, const void* normals, size_t stride, size_t numVertices,
+		const unsigned* indices, size_t numPrimitives, int verticesPerPrimitive, const float* color );
+
+	int m_width;
+	int m_height;
+	int m_tilesX;
+	int m_tilesY;
+	std::vector< unsigned char > m_pixels;
+	std::vector< float > m_depth;
+
+	float m_projection[ 16 ];
+	float m_modelView[ 16 ];
+	float m_lightPosition[ 4 ];
+	float m_lightDiffuse[ 3 ];
+	RasterMaterial m_material;
+	bool m_cull;
+
+	ThreadPool* m_pool;
+};
+
+#endif // SOFT_RASTERIZER_H
@@ -0,0 +1,557 @@
+#include "SoftRasterizer.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+
+namespace
+{
+	// Tiles are this many pixels wide and high
+	const int TILE_SIZE = 64;
+	// Vertices and primitives are set up in chunks of these sizes, so
+	// how they are binned does not depend on the number of threads
+	const size_t CHUNK_VERTICES = 8192;
+	const size_t CHUNK_PRIMITIVES = 4096;
+	// GL_LIGHT_MODEL_AMBIENT
+	const float GLOBAL_AMBIENT = 0.2f;
+
+	// A vertex in clip space, with what is lit in eye space
+	struct Vertex
+	{
+		float clip[ 4 ];
+		float eye[ 3 ];
+		float normal[ 3 ];
+	};
+
+	// A vertex in window coordinates (depth in [ 0, 1 ]), with the eye
+	// space attributes divided by w for perspective-correct interpolation
+	struct ScreenVertex
+	{
+		float x;
+		float y;
+		float z;
+		float invW;
+		float eye[ 3 ];
+		float normal[ 3 ];
+	};
+
+	// A triangle or a line, ready to rasterize: vertices counterclockwise
+	// and the pixels it may cover
+	struct Primitive
+	{
+		ScreenVertex v[ 3 ];
+		float area;
+		int minX;
+		int minY;
+		int maxX;
+		int maxY;
+	};
+
+	// What one chunk of primitives sets up: the primitives, and for every
+	// tile the ones that touch it, in order
+	struct PrimitiveChunk
+	{
+		vector< Primitive > primitives;
+		vector< vector< unsigned > > bins;
+	};
+
+	inline void transformPoint( const float* m, const float* p, float w, float* out )
+	{
+		for( int i = 0; i != 4; ++i )
+		{
+			out[ i ] = m[ i ] * p[ 0 ] + m[ 4 + i ] * p[ 1 ] + m[ 8 + i ] * p[ 2 ] + m[ 12 + i ] * w;
+		}
+	}
+
+	inline float dot3( const float* a, const float* b )
+	{
+		return a[ 0 ] * b[ 0 ] + a[ 1 ] * b[ 1 ] + a[ 2 ] * b[ 2 ];
+	}
+
+	inline void normalize3( float* v )
+	{
+		const float length2 = dot3( v, v );
+		if( length2 > 0 )
+		{
+			const float s = 1.0f / sqrt( length2 );
+			v[ 0 ] *= s;
+			v[ 1 ] *= s;
+			v[ 2 ] *= s;
+		}
+	}
+
+	// Inverse transpose of the upper 3x3 of m, as a column-major 4x4, for
+	// normals
+	void normalMatrix( const float* m, float* out )
+	{
+		fill( out, out + 16, 0.0f );
+		const float a = m[ 0 ], b = m[ 4 ], c = m[ 8 ];
+		const float d = m[ 1 ], e = m[ 5 ], f = m[ 9 ];
+		const float g = m[ 2 ], h = m[ 6 ], k = m[ 10 ];
+		// cofactors; the inverse transpose is the cofactor matrix over
+		// the determinant, whose sign and size GL_NORMALIZE drops anyway
+		out[ 0 ] = e * k - f * h;
+		out[ 4 ] = -( d * k - f * g );
+		out[ 8 ] = d * h - e * g;
+		out[ 1 ] = -( b * k - c * h );
+		out[ 5 ] = a * k - c * g;
+		out[ 9 ] = -( a * h - b * g );
+		out[ 2 ] = b * f - c * e;
+		out[ 6 ] = -( a * f - c * d );
+		out[ 10 ] = a * e - b * d;
+		const float det = a * out[ 0 ] + b * out[ 4 ] + c * out[ 8 ];
+		if( det < 0 )
+		{
+			for( int i = 0; i != 16; ++i )
+			{
+				out[ i ] = -out[ i ];
+			}
+		}
+	}
+
+	Vertex lerp( const Vertex& a, const Vertex& b, float t )
+	{
+		Vertex v;
+		for( int i = 0; i != 4; ++i )
+		{
+			v.clip[ i ] = a.clip[ i ] + t * ( b.clip[ i ] - a.clip[ i ] );
+		}
+		for( int i = 0; i != 3; ++i )
+		{
+			v.eye[ i ] = a.eye[ i ] + t * ( b.eye[ i ] - a.eye[ i ] );
+			v.normal[ i ] = a.normal[ i ] + t * ( b.normal[ i ] - a.normal[ i ] );
+		}
+		return v;
+	}
+
+	// Distance to the near plane z = -w, >= 0 inside
+	inline float nearDistance( const Vertex& v )
+	{
+		return v.clip[ 2 ] + v.clip[ 3 ];
+	}
+
+	// Clips the polygon in[ 0, n ) to the near plane, the other planes are
+	// left to the pixel bounds. Returns the number of vertices in out.
+	int clipNear( const Vertex* in, int n, Vertex* out )
+	{
+		int count = 0;
+		for( int i = 0; i != n; ++i )
+		{
+			const Vertex& a = in[ i ];
+			const Vertex& b = in[ ( i + 1 ) % n ];
+			const float da = nearDistance( a ), db = nearDistance( b );
+			if( da >= 0 )
+			{
+				out[ count++ ] = a;
+			}
+			if( ( da >= 0 ) != ( db >= 0 ) )
+			{
+				out[ count++ ] = lerp( a, b, da / ( da - db ) );
+			}
+		}
+		return count;
+	}
+
+	ScreenVertex project( const Vertex& v, int width, int height )
+	{
+		ScreenVertex s;
+		const float invW = 1.0f / v.clip[ 3 ];
+		s.x = ( v.clip[ 0 ] * invW * 0.5f + 0.5f ) * width;
+		s.y = ( v.clip[ 1 ] * invW * 0.5f + 0.5f ) * height;
+		s.z = v.clip[ 2 ] * invW * 0.5f + 0.5f;
+		s.invW = invW;
+		for( int i = 0; i != 3; ++i )
+		{
+			s.eye[ i ] = v.eye[ i ] * invW;
+			s.normal[ i ] = v.normal[ i ] * invW;
+		}
+		return s;
+	}
+
+	inline float edge( const ScreenVertex& a, const ScreenVertex& b, float x, float y )
+	{
+		return ( b.x - a.x ) * ( y - a.y ) - ( b.y - a.y ) * ( x - a.x );
+	}
+
+	// Pixels exactly on an edge belong to the triangle on its top or
+	// left, so shared edges are drawn once. Counterclockwise with y up,
+	// left edges run down and top edges run left.
+	inline bool isTopLeft( const ScreenVertex& a, const ScreenVertex& b )
+	{
+		return b.y < a.y || ( b.y == a.y && b.x < a.x );
+	}
+}
+
+SoftRasterizer::SoftRasterizer( int width, int height, unsigned numThreads ) :
+	m_width( max( width, 1 ) ),
+	m_height( max( height, 1 ) ),
+	m_tilesX( ( m_width + TILE_SIZE - 1 ) / TILE_SIZE ),
+	m_tilesY( ( m_height + TILE_SIZE - 1 ) / TILE_SIZE ),
+	m_pixels( 3 * size_t( m_width ) * m_height, 0 ),
+	m_depth( size_t( m_width ) * m_height, 1.0f ),
+	m_cull( false ),
+	m_pool( new ThreadPool( numThreads ) )
+{
+	for( int i = 0; i != 16; ++i )
+	{
+		m_projection[ i ] = m_modelView[ i ] = i % 5 == 0 ? 1.0f : 0.0f;
+	}
+	// what the apps set up
+	const float position[ 4 ] = { 3, 3, 5, 1 };
+	const float diffuse[ 3 ] = { 1, 1, 1 };
+	const RasterMaterial material = { { 0.4f, 0.4f, 0.4f }, { 0.6f, 0.6f, 0.6f }, 50.0f };
+	setLight( position, diffuse );
+	setMaterial( material );
+}
+
+SoftRasterizer::~SoftRasterizer()
+{
+	delete m_pool;
+}
+
+void SoftRasterizer::clear( float r, float g, float b )
+{
+	const unsigned char color[ 3 ] =
+	{
+		(unsigned char)( min( max( r, 0.0f ), 1.0f ) * 255 + 0.5f ),
+		(unsigned char)( min( max( g, 0.0f ), 1.0f ) * 255 + 0.5f ),
+		(unsigned char)( min( max( b, 0.0f ), 1.0f ) * 255 + 0.5f )
+	};
+	for( size_t i = 0; i != m_depth.size(); ++i )
+	{
+		memcpy( &m_pixels[ 3 * i ], color, 3 );
+	}
+	fill( m_depth.begin(), m_depth.end(), 1.0f );
+}
+
+void SoftRasterizer::setProjection( const float* matrix )
+{
+	memcpy( m_projection, matrix, sizeof( m_projection ) );
+}
+
+void SoftRasterizer::setModelView( const float* matrix )
+{
+	memcpy( m_modelView, matrix, sizeof( m_modelView ) );
+}
+
+void SoftRasterizer::setLight( const float position[ 4 ], const float diffuse[ 3 ] )
+{
+	memcpy( m_lightPosition, position, sizeof( m_lightPosition ) );
+	memcpy( m_lightDiffuse, diffuse, sizeof( m_lightDiffuse ) );
+}
+
+void SoftRasterizer::setMaterial( const RasterMaterial& material )
+{
+	m_material = material;
+}
+
+void SoftRasterizer::setCulling( bool cullBackFaces )
+{
+	m_cull = cullBackFaces;
+}
+
+void SoftRasterizer::drawTriangles( const void* positions, const void* normals, size_t stride,
+	size_t numVertices, const unsigned* indices, size_t numTriangles )
+{
+	draw( positions, normals, stride, numVertices, indices, numTriangles, 3, NULL );
+}
+
+void SoftRasterizer::drawLines( const void* positions, size_t stride, size_t numVertices,
+	const unsigned* indices, size_t numLines, const float color[ 3 ] )
+{
+	draw( positions, NULL, stride, numVertices, indices, numLines, 2, color );
+}
+
+void SoftRasterizer::draw( const void* positions, const void* normals, size_t stride, size_t numVertices,
+	const unsigned* indices, size_t numPrimitives, int verticesPerPrimitive, const float* color )
+{
+	const char* const positionBytes = static_cast< const char* >( positions );
+	const char* const normalBytes = static_cast< const char* >( normals );
+	float normalTransform[ 16 ];
+	normalMatrix( m_modelView, normalTransform );
+
+	// vertices to clip and eye space
+	vector< Vertex > vertices( numVertices );
+	m_pool->run( ( numVertices + CHUNK_VERTICES - 1 ) / CHUNK_VERTICES, [ & ]( size_t c )
+	{
+		const size_t end = min( numVertices, ( c + 1 ) * CHUNK_VERTICES );
+		for( size_t i = c * CHUNK_VERTICES; i != end; ++i )
+		{
+			Vertex& v = vertices[ i ];
+			float eye[ 4 ];
+			transformPoint( m_modelView, reinterpret_cast< const float* >( positionBytes + i * stride ), 1, eye );
+			transformPoint( m_projection, eye, eye[ 3 ], v.clip );
+			for( int k = 0; k != 3; ++k )
+			{
+				v.eye[ k ] = eye[ k ] / eye[ 3 ];
+			}
+			if( normalBytes )
+			{
+				float n[ 4 ];
+				transformPoint( normalTransform, reinterpret_cast< const float* >( normalBytes + i * stride ), 0, n );
+				memcpy( v.normal, n, sizeof( v.normal ) );
+			}
+			else
+			{
+				fill( v.normal, v.normal + 3, 0.0f );
+			}
+		}
+	} );
+
+	// set up and bin the primitives chunk by chunk
+	const int numTiles = m_tilesX * m_tilesY;
+	vector< PrimitiveChunk > chunks( ( numPrimitives + CHUNK_PRIMITIVES - 1 ) / CHUNK_PRIMITIVES );
+	m_pool->run( chunks.size(), [ & ]( size_t c )
+	{
+		PrimitiveChunk& chunk = chunks[ c ];
+		chunk.bins.resize( numTiles );
+		const size_t end = min( numPrimitives, ( c + 1 ) * CHUNK_PRIMITIVES );
+		for( size_t p = c * CHUNK_PRIMITIVES; p != end; ++p )
+		{
+			const unsigned* index = indices + p * verticesPerPrimitive;
+			Vertex in[ 3 ];
+			bool valid = true;
+			for( int k = 0; k != verticesPerPrimitive; ++k )
+			{
+				valid = valid && index[ k ] < numVertices;
+				in[ k ] = vertices[ valid ? index[ k ] : 0 ];
+			}
+			if( !valid )
+			{
+				continue;
+			}
+			if( !normalBytes && verticesPerPrimitive == 3 )
+			{
+				// the face normal, in eye space
+				float e1[ 3 ], e2[ 3 ], n[ 3 ];
+				for( int k = 0; k != 3; ++k )
+				{
+					e1[ k ] = in[ 1 ].eye[ k ] - in[ 0 ].eye[ k ];
+					e2[ k ] = in[ 2 ].eye[ k ] - in[ 0 ].eye[ k ];
+				}
+				n[ 0 ] = e1[ 1 ] * e2[ 2 ] - e1[ 2 ] * e2[ 1 ];
+				n[ 1 ] = e1[ 2 ] * e2[ 0 ] - e1[ 0 ] * e2[ 2 ];
+				n[ 2 ] = e1[ 0 ] * e2[ 1 ] - e1[ 1 ] * e2[ 0 ];
+				for( int k = 0; k != 3; ++k )
+				{
+					memcpy( in[ k ].normal, n, sizeof( n ) );
+				}
+			}
+
+			// a triangle may become a quad; a line stays a line
+			Vertex clipped[ 4 ];
+			int numClipped;
+			if( verticesPerPrimitive == 3 )
+			{
+				numClipped = clipNear( in, 3, clipped );
+			}
+			else
+			{
+				const float d0 = nearDistance( in[ 0 ] ), d1 = nearDistance( in[ 1 ] );
+				if( d0 < 0 && d1 < 0 )
+				{
+					continue;
+				}
+				clipped[ 0 ] = d0 >= 0 ? in[ 0 ] : lerp( in[ 0 ], in[ 1 ], d0 / ( d0 - d1 ) );
+				clipped[ 1 ] = d1 >= 0 ? in[ 1 ] : lerp( in[ 0 ], in[ 1 ], d0 / ( d0 - d1 ) );
+				numClipped = 2;
+			}
+
+			// the clipped polygon as a fan of triangles
+			const int numParts = verticesPerPrimitive == 3 ? numClipped - 2 : 1;
+			for( int fan = 1; fan <= numParts; ++fan )
+			{
+				Primitive prim;
+				prim.v[ 0 ] = project( clipped[ 0 ], m_width, m_height );
+				prim.v[ 1 ] = project( clipped[ fan ], m_width, m_height );
+				int n = 2;
+				prim.area = 0;
+				if( verticesPerPrimitive == 3 )
+				{
+					prim.v[ 2 ] = project( clipped[ fan + 1 ], m_width, m_height );
+					n = 3;
+					prim.area = edge( prim.v[ 0 ], prim.v[ 1 ], prim.v[ 2 ].x, prim.v[ 2 ].y );
+					if( prim.area == 0 || !( prim.area == prim.area ) || ( m_cull && prim.area < 0 ) )
+					{
+						continue;
+					}
+					// back faces are lit like front faces, as without
+					// GL_LIGHT_MODEL_TWO_SIDE
+					if( prim.area < 0 )
+					{
+						swap( prim.v[ 1 ], prim.v[ 2 ] );
+						prim.area = -prim.area;
+					}
+				}
+				float minX = prim.v[ 0 ].x, maxX = minX, minY = prim.v[ 0 ].y, maxY = minY;
+				for( int k = 1; k != n; ++k )
+				{
+					minX = min( minX, prim.v[ k ].x );
+					maxX = max( maxX, prim.v[ k ].x );
+					minY = min( minY, prim.v[ k ].y );
+					maxY = max( maxY, prim.v[ k ].y );
+				}
+				// pixels whose centers may be covered
+				prim.minX = int( max( floor( minX - 0.5f ), 0.0f ) );
+				prim.minY = int( max( floor( minY - 0.5f ), 0.0f ) );
+				prim.maxX = int( min( ceil( maxX - 0.5f ), float( m_width - 1 ) ) );
+				prim.maxY = int( min( ceil( maxY - 0.5f ), float( m_height - 1 ) ) );
+				if( prim.minX > prim.maxX || prim.minY > prim.maxY )
+				{
+					continue;
+				}
+				const unsigned id = unsigned( chunk.primitives.size() );
+				chunk.primitives.push_back( prim );
+				for( int ty = prim.minY / TILE_SIZE; ty <= prim.maxY / TILE_SIZE; ++ty )
+				{
+					for( int tx = prim.minX / TILE_SIZE; tx <= prim.maxX / TILE_SIZE; ++tx )
+					{
+						chunk.bins[ ty * m_tilesX + tx ].push_back( id );
+					}
+				}
+			}
+		}
+	} );
+
+	// lighting constants
+	const RasterMaterial& mat = m_material;
+	float ambient[ 3 ], diffuse[ 3 ], lightDirection[ 3 ] = { 0, 0, 0 };
+	for( int k = 0; k != 3; ++k )
+	{
+		ambient[ k ] = GLOBAL_AMBIENT * mat.diffuse[ k ];
+		diffuse[ k ] = m_lightDiffuse[ k ] * mat.diffuse[ k ];
+	}
+	const bool directional = m_lightPosition[ 3 ] == 0;
+	if( directional )
+	{
+		memcpy( lightDirection, m_lightPosition, sizeof( lightDirection ) );
+		normalize3( lightDirection );
+	}
+
+	// every tile on its own thread, its primitives in order
+	m_pool->run( size_t( numTiles ), [ & ]( size_t tile )
+	{
+		const int tileX0 = int( tile % m_tilesX ) * TILE_SIZE, tileY0 = int( tile / m_tilesX ) * TILE_SIZE;
+		const int tileX1 = min( tileX0 + TILE_SIZE, m_width ) - 1, tileY1 = min( tileY0 + TILE_SIZE, m_height ) - 1;
+		for( size_t c = 0; c != chunks.size(); ++c )
+		{
+			const vector< unsigned >& bin = chunks[ c ].bins[ tile ];
+			for( size_t b = 0; b != bin.size(); ++b )
+			{
+				const Primitive& prim = chunks[ c ].primitives[ bin[ b ] ];
+				const int x0 = max( prim.minX, tileX0 ), x1 = min( prim.maxX, tileX1 );
+				const int y0 = max( prim.minY, tileY0 ), y1 = min( prim.maxY, tileY1 );
+				if( verticesPerPrimitive == 2 )
+				{
+					// one pixel per column or row along the longer axis
+					const ScreenVertex& a = prim.v[ 0 ];
+					const ScreenVertex& e = prim.v[ 1 ];
+					const float dx = e.x - a.x, dy = e.y - a.y;
+					const bool alongX = fabs( dx ) >= fabs( dy );
+					const float length = alongX ? dx : dy;
+					if( length == 0 )
+					{
+						continue;
+					}
+					const int from = alongX ? x0 : y0, to = alongX ? x1 : y1;
+					for( int i = from; i <= to; ++i )
+					{
+						const float t = ( i + 0.5f - ( alongX ? a.x : a.y ) ) / length;
+						if( t < 0 || t > 1 )
+						{
+							continue;
+						}
+						const int x = alongX ? i : int( floor( a.x + t * dx ) );
+						const int y = alongX ? int( floor( a.y + t * dy ) ) : i;
+						if( x < x0 || x > x1 || y < y0 || y > y1 )
+						{
+							continue;
+						}
+						const float z = a.z + t * ( e.z - a.z );
+						const size_t pixel = size_t( y ) * m_width + x;
+						if( z < 0 || z > 1 || z >= m_depth[ pixel ] )
+						{
+							continue;
+						}
+						m_depth[ pixel ] = z;
+						for( int k = 0; k != 3; ++k )
+						{
+							m_pixels[ 3 * pixel + k ] = (unsigned char)( min( max( color[ k ], 0.0f ), 1.0f ) * 255 + 0.5f );
+						}
+					}
+					continue;
+				}
+
+				const ScreenVertex& v0 = prim.v[ 0 ];
+				const ScreenVertex& v1 = prim.v[ 1 ];
+				const ScreenVertex& v2 = prim.v[ 2 ];
+				const bool topLeft0 = isTopLeft( v1, v2 ), topLeft1 = isTopLeft( v2, v0 ), topLeft2 = isTopLeft( v0, v1 );
+				const float invArea = 1.0f / prim.area;
+				for( int y = y0; y <= y1; ++y )
+				{
+					const float cy = y + 0.5f;
+					for( int x = x0; x <= x1; ++x )
+					{
+						const float cx = x + 0.5f;
+						const float w0 = edge( v1, v2, cx, cy ), w1 = edge( v2, v0, cx, cy ), w2 = edge( v0, v1, cx, cy );
+						if( w0 < 0 || w1 < 0 || w2 < 0 ||
+							( w0 == 0 && !topLeft0 ) || ( w1 == 0 && !topLeft1 ) || ( w2 == 0 && !topLeft2 ) )
+						{
+							continue;
+						}
+						const float b0 = w0 * invArea, b1 = w1 * invArea, b2 = w2 * invArea;
+						const float z = b0 * v0.z + b1 * v1.z + b2 * v2.z;
+						const size_t pixel = size_t( y ) * m_width + x;
+						if( z < 0 || z > 1 || z >= m_depth[ pixel ] )
+						{
+							continue;
+						}
+						m_depth[ pixel ] = z;
+
+						// eye space position and normal
+						const float w = 1.0f / ( b0 * v0.invW + b1 * v1.invW + b2 * v2.invW );
+						float eye[ 3 ], n[ 3 ];
+						for( int k = 0; k != 3; ++k )
+						{
+							eye[ k ] = ( b0 * v0.eye[ k ] + b1 * v1.eye[ k ] + b2 * v2.eye[ k ] ) * w;
+							n[ k ] = b0 * v0.normal[ k ] + b1 * v1.normal[ k ] + b2 * v2.normal[ k ];
+						}
+						normalize3( n );
+						float l[ 3 ];
+						if( directional )
+						{
+							memcpy( l, lightDirection, sizeof( l ) );
+						}
+						else
+						{
+							for( int k = 0; k != 3; ++k )
+							{
+								l[ k ] = m_lightPosition[ k ] - eye[ k ];
+							}
+							normalize3( l );
+						}
+						const float nDotL = dot3( n, l );
+						float specular = 0;
+						if( nDotL > 0 )
+						{
+							// the viewer is at infinity along +z
+							float h[ 3 ] = { l[ 0 ], l[ 1 ], l[ 2 ] + 1 };
+							normalize3( h );
+							const float nDotH = dot3( n, h );
+							specular = nDotH > 0 ? pow( nDotH, mat.shininess ) : 0.0f;
+						}
+						const float lit = max( nDotL, 0.0f );
+						for( int k = 0; k != 3; ++k )
+						{
+							const float c = ambient[ k ] + lit * diffuse[ k ] + specular * mat.specular[ k ];
+							m_pixels[ 3 * pixel + k ] = (unsigned char)( min( c, 1.0f ) * 255 + 0.5f );
+						}
+					}
+				}
+			}
+		}
+	} );
+}
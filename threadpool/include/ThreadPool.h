@@ -0,0 +1,57 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads that run indexed tasks, shared by a2, a3
+// and the softras library.
+//
+// run( n, fn ) calls fn( 0 ) ... fn( n - 1 ) and returns once all of them
+// have finished; the calling thread works on tasks too. Which thread
+// picks up a task is unspecified, so callers that need reproducible
+// results must make every task write to its own slots and combine
+// per-task results afterwards in task order.
+class ThreadPool
+{
+public:
+	// numThreads counts the calling thread, 0 uses one per hardware
+	// thread
+	explicit ThreadPool( unsigned numThreads = 0 );
+	~ThreadPool();
+
+	// Number of threads taking part in run(), including the caller
+	unsigned size() const { return unsigned( m_workers.size() ) + 1; }
+
+	void run( size_t numTasks, const std::function< void( size_t ) >& fn );
+
+private:
+	ThreadPool( const ThreadPool& );
+	ThreadPool& operator=( const ThreadPool& );
+
+	void workerLoop();
+	void drain( const std::function< void( size_t ) >& fn, size_t n );
+
+	std::vector< std::thread > m_workers;
+
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+
+	// Current job, guarded by m_mutex
+	const std::function< void( size_t ) >* m_job;
+	size_t m_numTasks;
+	unsigned long m_generation;
+	// workers still inside drain() for this job
+	unsigned m_active;
+	bool m_quit;
+
+	std::atomic< size_t > m_next;
+};
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,96 @@
+#include "ThreadPool.h"
+
+using namespace std;
+
+ThreadPool::ThreadPool( unsigned numThreads ) :
+	m_job( NULL ), m_numTasks( 0 ), m_generation( 0 ), m_active( 0 ), m_quit( false ), m_next( 0 )
+{
+	if( numThreads == 0 )
+	{
+		numThreads = thread::hardware_concurrency();
+	}
+	for( unsigned i = 1; i < numThreads; ++i )
+	{
+		m_workers.push_back( thread( &ThreadPool::workerLoop, this ) );
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		lock_guard< mutex > lock( m_mutex );
+		m_quit = true;
+	}
+	m_wake.notify_all();
+	for( size_t i = 0; i != m_workers.size(); ++i )
+	{
+		m_workers[ i ].join();
+	}
+}
+
+void ThreadPool::run( size_t n, const function< void( size_t ) >& fn )
+{
+	if( m_workers.empty() || n <= 1 )
+	{
+		for( size_t k = 0; k != n; ++k )
+		{
+			fn( k );
+		}
+		return;
+	}
+
+	{
+		lock_guard< mutex > lock( m_mutex );
+		m_job = &fn;
+		m_numTasks = n;
+		m_next = 0;
+		++m_generation;
+	}
+	m_wake.notify_all();
+
+	drain( fn, n );
+
+	// Wait for stragglers, so none of them can take an index from the
+	// next job while still holding a pointer to this one.
+	unique_lock< mutex > lock( m_mutex );
+	m_done.wait( lock, [ this ] { return m_active == 0; } );
+	m_job = NULL;
+}
+
+void ThreadPool::drain( const function< void( size_t ) >& fn, size_t n )
+{
+	for( size_t k = m_next++; k < n; k = m_next++ )
+	{
+		fn( k );
+	}
+}
+
+void ThreadPool::workerLoop()
+{
+	unsigned long seen = 0;
+	for( ;; )
+	{
+		const function< void( size_t ) >* fn;
+		size_t n;
+		{
+			unique_lock< mutex > lock( m_mutex );
+			m_wake.wait( lock, [ & ] { return m_quit || ( m_job && m_generation != seen ); } );
+			if( m_quit )
+			{
+				return;
+			}
+			seen = m_generation;
+			fn = m_job;
+			n = m_numTasks;
+			++m_active;
+		}
+
+		drain( *fn, n );
+
+		{
+			lock_guard< mutex > lock( m_mutex );
+			--m_active;
+		}
+		m_done.notify_one();
+	}
+}
@@ -1,15 +1,18 @@
+#include <algorithm>
 #include <cstdio>
 #include <vecmath.h>
 
 #include "ClothSystem.h"
 #include "config.h"
 #include "common.h"
+#include "Trace.h"
 
 
-ClothSystem::ClothSystem(float height, float width):
+ClothSystem::ClothSystem(float height, float width, ThreadPool *pool):
     num_rows(static_cast<size_t>(height/PARTICLE_INTERVAL + 1)),
     num_cols(static_cast<size_t>(width/PARTICLE_INTERVAL + 1)),
     render(true), swing(false), wind(false),
+    swing_vec(0, 0, SWING_SPEED), pool(pool), solver(pool),
     myball(Vector4f(BALL_X, BALL_Y, BALL_Z, BALL_SIZE))
 {
     m_numParticles = num_rows * num_cols;
@@ -55,33 +58,123 @@ ClothSystem::ClothSystem(float height, float width):
                         flex_len, CLO_STF_FLX);
         }
     }
+
+    setupImplicit();
+}
+
+void ClothSystem::setupImplicit()
+{
+    size_t n = m_numParticles;
+
+    fixedMask.assign(n, false);
+    for (size_t i = 0; i < num_rows; ++i)
+        for (size_t j = 0; j < num_cols; ++j)
+            fixedMask[indexOf(i,j)] = isFixed(i, j);
+
+    // One block per particle and per spring end
+    sysMatrix.n = n;
+    sysMatrix.rowStart.assign(1, 0);
+    sysMatrix.cols.clear();
+    for (size_t i = 0; i != n; ++i) {
+        vector<int> row(particles.connects(i));
+        row.push_back(i);
+        std::sort(row.begin(), row.end());
+        sysMatrix.cols.insert(sysMatrix.cols.end(), row.begin(), row.end());
+        sysMatrix.rowStart.push_back(sysMatrix.cols.size());
+    }
+    sysMatrix.blocks.assign(sysMatrix.cols.size(), Matrix3f());
+
+    vector<std::pair<int, int> > const &pairs = particles.allPairs();
+    springSlots.clear();
+    for (size_t s = 0; s != pairs.size(); ++s) {
+        int a = pairs[s].first, b = pairs[s].second;
+        springSlots.push_back(sysMatrix.find(a, a));
+        springSlots.push_back(sysMatrix.find(b, b));
+        springSlots.push_back(sysMatrix.find(a, b));
+        springSlots.push_back(sysMatrix.find(b, a));
+    }
+
+    dv.assign(n, Vector3f::ZERO);
+    solver.setup(num_rows, num_cols, fixedMask);
 }
 
 
 // for a given state, evaluate f(X,t)
 vector<Vector3f> ClothSystem::evalF(vector<Vector3f> state)
 {
-	vector<Vector3f> f;
+    TRACE_SCOPE("ClothSystem::evalF");
+	vector<Vector3f> f(2 * m_numParticles);
+
+    // Resolve all collisions before any spring force reads a neighbour,
+    // otherwise the forces depend on the order particles are visited.
+    forEachRowChunk([this](size_t row_begin, size_t row_end) {
+        collideRows(row_begin, row_end);
+    });
+    updateSwing();
+    forEachRowChunk([this, &f](size_t row_begin, size_t row_end) {
+        evalRows(row_begin, row_end, f);
+    });
+    return f;
+}
+
+void ClothSystem::forEachRowChunk(
+        std::function<void(size_t, size_t)> const &fn)
+{
+    size_t num_chunks = (num_rows + CLO_CHUNK_ROWS - 1) / CLO_CHUNK_ROWS;
+    std::function<void(size_t)> task = [&](size_t k) {
+        size_t row_begin = k * CLO_CHUNK_ROWS,
+               row_end = std::min(row_begin + CLO_CHUNK_ROWS, num_rows);
+        fn(row_begin, row_end);
+    };
+    if (pool)
+        pool->run(num_chunks, task);
+    else
+        for (size_t k = 0; k != num_chunks; ++k)
+            task(k);
+}
 
-    for (size_t i = 0; i < num_rows; ++i) {
+// Check for collision,
+// if so, reproject back to surface
+void ClothSystem::collideRows(size_t row_begin, size_t row_end)
+{
+    TRACE_SCOPE("ClothSystem::collideRows");
+    for (size_t i = row_begin; i < row_end; ++i) {
+        for (size_t j = 0; j < num_cols; ++j) {
+            if (i == 0 && (j == 0 || j == num_cols-1))
+                continue;
+            Vector3f &pos = getPosition(indexOf(i,j));
+            if (checkCollision(pos))
+                pos = reProject(pos);
+        }
+    }
+}
+
+// Both fixed corners move together, so the top-left one decides
+// when the swing turns around.
+void ClothSystem::updateSwing()
+{
+    if (!swing)
+        return;
+    Vector3f pos = getPosition(indexOf(0, 0));
+    if (pos.z() > SWING_Z_LIM)
+        swing_vec = Vector3f(0, 0, - SWING_SPEED);
+    else if (pos.z() < - SWING_Z_LIM)
+        swing_vec = Vector3f(0, 0, SWING_SPEED);
+}
+
+void ClothSystem::evalRows(size_t row_begin, size_t row_end,
+                           vector<Vector3f> &f)
+{
+    TRACE_SCOPE("ClothSystem::evalRows");
+    for (size_t i = row_begin; i < row_end; ++i) {
         for (size_t j = 0; j < num_cols; ++j) {
+            int ind1 = indexOf(i,j);
             if (i == 0 && (j == 0 || j == num_cols-1)) {
-                if (swing) {
-                    Vector3f pos = getPosition(indexOf(i, j));
-                    static Vector3f swing_vec = Vector3f(0, 0, SWING_SPEED);
-                    if (pos.z() > SWING_Z_LIM)
-                        swing_vec = Vector3f(0, 0, - SWING_SPEED);
-                    else if (pos.z() < - SWING_Z_LIM)
-                        swing_vec = Vector3f(0, 0, SWING_SPEED);
-                    f.push_back(swing_vec);
-                }
-                else
-                    f.push_back(Vector3f::ZERO);
-                f.push_back(Vector3f::ZERO);
+                f[2*ind1] = swing ? swing_vec : Vector3f::ZERO;
+                f[2*ind1+1] = Vector3f::ZERO;
                 continue;
             }
 
-            int ind1 = indexOf(i,j);
             Vector3f fx = getVelocity(ind1);
             Vector3f fv = Vector3f::ZERO;
 
@@ -106,20 +199,101 @@ vector<Vector3f> ClothSystem::evalF(vector<Vector3f> state)
             fv += sprForce;
             fv = fv / particles.massGet(ind1);
 
-            // Check for collision, 
-            // if so, reproject back to surface, and set dv, dx to zero
-            Vector3f pos = getPosition(indexOf(i,j));
-            if (checkCollision(pos)) {
-                getPosition(indexOf(i,j)) = reProject(pos);
-                /* fx = Vector3f::ZERO; */
-                /* fv = Vector3f::ZERO; */
+            f[2*ind1] = fx;
+            f[2*ind1+1] = fv;
+        }
+    }
+}
+
+bool ClothSystem::stepImplicit(float h)
+{
+    TRACE_SCOPE("ClothSystem::stepImplicit");
+    size_t n = m_numParticles;
+    vector<Vector3f> rhs(n, Vector3f::ZERO);
+
+    // Diagonal (M - h D), the damping is D = - CLO_VISCOUS * I
+    std::fill(sysMatrix.blocks.begin(), sysMatrix.blocks.end(), Matrix3f());
+    for (size_t i = 0; i != n; ++i) {
+        float d = particles.massGet(i) + h * CLO_VISCOUS;
+        Matrix3f &blk = sysMatrix.blocks[sysMatrix.find(i, i)];
+        blk(0,0) = blk(1,1) = blk(2,2) = d;
+
+        // External forces, as in evalF
+        Vector3f f = - CLO_VISCOUS * getVelocity(i);
+        f.y() += - particles.massGet(i) * CLO_G;
+        if (wind)
+            f.z() += - WIND_FORCE;
+        rhs[i] = h * f;
+    }
+
+    // Springs. J = -dF_a/dx_a, with the transverse term clamped at zero
+    // so that compressed springs keep the matrix positive definite.
+    vector<std::pair<int, int> > const &pairs = particles.allPairs();
+    for (size_t s = 0; s != pairs.size(); ++s) {
+        int a = pairs[s].first, b = pairs[s].second;
+        Vector3f d = getPosition(a) - getPosition(b);
+        float len = d.abs();
+        if (len == 0.0f)
+            continue;
+        Vector3f u = d / len;
+        float k = particles.stiffnessGet(s),
+              r = particles.restGet(s),
+              t = std::max(0.0f, 1.0f - r / len);
+
+        Vector3f fa = - k * (len - r) * u;
+        Matrix3f J;
+        for (int p = 0; p != 3; ++p)
+            for (int q = 0; q != 3; ++q)
+                J(p,q) = k * ((1.0f - t) * u[p] * u[q] + (p == q ? t : 0.0f));
+
+        // rhs += h (f + h K v), with K v = -J (v_a - v_b) on a
+        Vector3f Kv = - (J * (getVelocity(a) - getVelocity(b)));
+        rhs[a] += h * (fa + h * Kv);
+        rhs[b] -= h * (fa + h * Kv);
+
+        float h2 = h * h;
+        Matrix3f *blk[4];
+        for (int m = 0; m != 4; ++m)
+            blk[m] = &sysMatrix.blocks[springSlots[4*s + m]];
+        for (int p = 0; p != 3; ++p) {
+            for (int q = 0; q != 3; ++q) {
+                (*blk[0])(p,q) += h2 * J(p,q);
+                (*blk[1])(p,q) += h2 * J(p,q);
+                (*blk[2])(p,q) -= h2 * J(p,q);
+                (*blk[3])(p,q) -= h2 * J(p,q);
             }
+        }
+    }
 
-            f.push_back(fx);
-            f.push_back(fv);
+    // Fixed corners: identity rows and columns, no velocity change
+    for (size_t i = 0; i != n; ++i) {
+        for (size_t k = sysMatrix.rowStart[i]; k != sysMatrix.rowStart[i+1]; ++k) {
+            int j = sysMatrix.cols[k];
+            if (fixedMask[i] || fixedMask[j])
+                sysMatrix.blocks[k] = (int(i) == j) ?
+                    Matrix3f::identity() : Matrix3f();
+        }
+        if (fixedMask[i]) {
+            rhs[i] = Vector3f::ZERO;
+            dv[i] = Vector3f::ZERO;
         }
     }
-    return f;
+
+    solver.solve(sysMatrix, rhs, dv, CLO_CG_TOL, CLO_CG_MAX_ITER);
+
+    updateSwing();
+    for (size_t i = 0; i != n; ++i) {
+        if (fixedMask[i]) {
+            if (swing)
+                getPosition(i) += h * swing_vec;
+            continue;
+        }
+        getVelocity(i) += dv[i];
+        getPosition(i) += h * getVelocity(i);
+        if (checkCollision(getPosition(i)))
+            getPosition(i) = reProject(getPosition(i));
+    }
+    return true;
 }
 
 bool ClothSystem::checkCollision(Vector3f pos) {
@@ -138,6 +312,7 @@ Vector3f ClothSystem::reProject(Vector3f pos) {
 #define THR     0.36f
 // render the system
 void ClothSystem::draw() {
+    TRACE_SCOPE("ClothSystem::draw");
     // First, draw a ball for collision
     glPushMatrix();
     // Coloring
@@ -154,6 +329,10 @@ void ClothSystem::draw() {
         this->drawFrame();
 }
 
+Vector4f ClothSystem::ball() const {
+    return Vector4f(myball.xyz(), myball.w() - THR);
+}
+
 void ClothSystem::drawFrame() {
     // Coloring
     glColorMaterial( GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE );
@@ -188,8 +367,13 @@ void ClothSystem::drawFrame() {
     glEnd();
 }
 
-void ClothSystem::drawCloth() {
-    vector<Vector3f> vns;
+void ClothSystem::clothBuffers(vector<Vector3f> &positions,
+                               vector<Vector3f> &normals,
+                               vector<unsigned> &indices) {
+    positions.assign(m_numParticles, Vector3f::ZERO);
+    normals.assign(positions.size(), Vector3f::ZERO);
+    for (size_t i = 0; i < positions.size(); ++i)
+        positions[i] = getPosition(i);
 
     //     a  
     //     |
@@ -236,59 +420,45 @@ void ClothSystem::drawCloth() {
 
             vn = vn / cnt;
 
-            vns.push_back(vn);
+            normals[indexOf(i,j)] = vn;
         }
     }
 
-    // Coloring
-    glColorMaterial( GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE );
-    GLfloat diff[] = {0.5, 0.5 , 0.9, 1.0};
-    glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE, diff);
-
     // a--b
     // | /|    face 1 (a-c-b) on the left; face 2 (b-c-d) on the right
     // |/ |
     // c--d     We also need to draw the back.
-    glBegin(GL_TRIANGLES);
+    indices.clear();
     for (size_t i = 0; i < num_rows-1; ++i) {
         for (size_t j = 0; j < num_cols-1; ++j) {
-            Vector3f a = getPosition(indexOf(i,j)),
-                     b = getPosition(indexOf(i,j+1)),
-                     c = getPosition(indexOf(i+1,j)),
-                     d = getPosition(indexOf(i+1,j+1)),
-                     vna = vns[indexOf(i,j)],
-                     vnb = vns[indexOf(i,j+1)],
-                     vnc = vns[indexOf(i+1,j)],
-                     vnd = vns[indexOf(i+1,j+1)];
-            glNormal(vna);
-            glVertex(a);
-            glNormal(vnc);
-            glVertex(c);
-            glNormal(vnb);
-            glVertex(b);
-
-            glNormal(vnb);
-            glVertex(b);
-            glNormal(vnc);
-            glVertex(c);
-            glNormal(vnd);
-            glVertex(d);
-
-            // Draw the back
-            glNormal(vna);
-            glVertex(a);
-            glNormal(vnb);
-            glVertex(b);
-            glNormal(vnc);
-            glVertex(c);
-
-            glNormal(vnb);
-            glVertex(b);
-            glNormal(vnd);
-            glVertex(d);
-            glNormal(vnc);
-            glVertex(c);
+            unsigned a = indexOf(i,j),
+                     b = indexOf(i,j+1),
+                     c = indexOf(i+1,j),
+                     d = indexOf(i+1,j+1);
+            const unsigned faces[] = {
+                a, c, b,  b, c, d,
+                // the back
+                a, b, c,  b, d, c
+            };
+            indices.insert(indices.end(), faces, faces + 12);
         }
     }
+}
+
+void ClothSystem::drawCloth() {
+    vector<Vector3f> positions, normals;
+    vector<unsigned> indices;
+    clothBuffers(positions, normals, indices);
+
+    // Coloring
+    glColorMaterial( GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE );
+    GLfloat diff[] = {0.5, 0.5 , 0.9, 1.0};
+    glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE, diff);
+
+    glBegin(GL_TRIANGLES);
+    for (size_t k = 0; k < indices.size(); ++k) {
+        glNormal(normals[indices[k]]);
+        glVertex(positions[indices[k]]);
+    }
     glEnd();
 }
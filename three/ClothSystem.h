@@ -7,20 +7,32 @@
 
 #include "particleSystem.h"
 #include "common.h"
+#include "ThreadPool.h"
+#include "MultigridSolver.h"
 
 
 class ClothSystem: public ParticleSystem
 {
 ///ADD MORE FUNCTION AND FIELDS HERE
 public:
-	ClothSystem(float height, float width);
+	// pool may be NULL, evalF then runs on the calling thread
+	ClothSystem(float height, float width, ThreadPool *pool = NULL);
 	vector<Vector3f> evalF(vector<Vector3f> state);
+	bool stepImplicit(float stepSize);
 	
 	void draw();
     void set_render(bool r) { render = r; }
     void set_swing(bool sw) { swing = sw; }
     void set_wind(bool w) { wind = w; }
 
+    // The cloth as drawCloth() draws it: a position and a smooth normal
+    // per particle, and the triangles with both windings, so the back
+    // shows with back faces culled
+    void clothBuffers(vector<Vector3f> &positions, vector<Vector3f> &normals,
+                      vector<unsigned> &indices);
+    // The ball as draw() draws it: center and radius
+    Vector4f ball() const;
+
 private:
     size_t num_rows;
     size_t num_cols;
@@ -44,6 +56,34 @@ private:
     bool render;
     bool swing;
     bool wind;
+    Vector3f swing_vec;
+
+    // Parallel evaluation.
+    //
+    // Rows are split into chunks of CLO_CHUNK_ROWS, so the partition
+    // does not depend on the number of threads. Each particle gathers
+    // its own spring forces in `connects` order and writes only its own
+    // slots of f, hence the result is bit-identical for any pool size.
+    ThreadPool *pool;
+    void forEachRowChunk(std::function<void(size_t, size_t)> const &fn);
+    void collideRows(size_t row_begin, size_t row_end);
+    void evalRows(size_t row_begin, size_t row_end, vector<Vector3f> &f);
+    void updateSwing();
+
+    // Implicit integration.
+    //
+    // (M - h D - h^2 K) dv = h (f + h K v), with K the spring stiffness
+    // matrix, whose sparsity follows the springs and is set up once.
+    // The fixed corners are removed from the system.
+    void setupImplicit();
+    MultigridSolver solver;
+    BlockMatrix sysMatrix;
+    vector<int> springSlots;    // (aa, bb, ab, ba) block of every spring
+    vector<bool> fixedMask;
+    vector<Vector3f> dv;        // last solution, warm-starts the next one
+    bool isFixed(size_t i, size_t j) const {
+        return i == 0 && (j == 0 || j == num_cols-1);
+    }
 	void drawFrame();
 	void drawCloth();
 
@@ -0,0 +1,442 @@
+#include <algorithm>
+#include <cmath>
+
+#include "MultigridSolver.h"
+#include "config.h"
+
+namespace
+{
+    // Rows per task. Fixed, so that partial sums are always formed the
+    // same way no matter how many threads there are.
+    const size_t CHUNK_SIZE = 2048;
+
+    // Damping of the Jacobi smoother
+    const float JACOBI_OMEGA = 2.0f / 3.0f;
+
+    // Symmetric Gauss-Seidel sweeps on the coarsest grid
+    const int COARSE_SWEEPS = 10;
+
+    // Width of the neighbourhood tracked directly when forming a coarse
+    // row, the stencils stay within a few nodes on every level
+    const int GALERKIN_WINDOW = 13;
+
+    // dst += s * src
+    inline void addScaled(Matrix3f &dst, Matrix3f const &src, float s)
+    {
+        for (int i = 0; i != 3; ++i)
+            for (int j = 0; j != 3; ++j)
+                dst(i, j) += s * src(i, j);
+    }
+
+    // Fine index -> (coarse index, weight) pairs along one axis, where the
+    // coarse grid keeps the fine indices listed in `nodes`.
+    void interp1D(size_t fine, vector<size_t> const &nodes,
+                  vector<vector<pair<int, float> > > &out)
+    {
+        out.assign(fine, vector<pair<int, float> >());
+        for (size_t k = 0; k + 1 < nodes.size(); ++k) {
+            size_t lo = nodes[k], hi = nodes[k+1];
+            for (size_t i = lo; i < hi; ++i) {
+                float t = float(i - lo) / float(hi - lo);
+                out[i].push_back(make_pair(int(k), 1.0f - t));
+                if (t > 0.0f)
+                    out[i].push_back(make_pair(int(k+1), t));
+            }
+        }
+        out[nodes.back()].push_back(make_pair(int(nodes.size() - 1), 1.0f));
+    }
+
+    // Every other index, plus the last one
+    vector<size_t> coarseNodes(size_t fine)
+    {
+        vector<size_t> nodes;
+        for (size_t i = 0; i < fine; i += 2)
+            nodes.push_back(i);
+        if (nodes.back() != fine - 1)
+            nodes.push_back(fine - 1);
+        return nodes;
+    }
+}
+
+int BlockMatrix::find(int i, int j) const
+{
+    vector<int>::const_iterator begin = cols.begin() + rowStart[i],
+                                end = cols.begin() + rowStart[i+1],
+                                it = std::lower_bound(begin, end, j);
+    if (it == end || *it != j)
+        return -1;
+    return it - cols.begin();
+}
+
+MultigridSolver::MultigridSolver(ThreadPool *pool): pool(pool)
+{
+}
+
+void MultigridSolver::setup(size_t rows, size_t cols,
+                            vector<bool> const &fixed)
+{
+    levels.clear();
+    levels.push_back(Level());
+    levels.back().rows = rows;
+    levels.back().cols = cols;
+
+    while (rows * cols > CLO_MG_COARSEST && rows >= 3 && cols >= 3) {
+        vector<size_t> rowNodes = coarseNodes(rows),
+                       colNodes = coarseNodes(cols);
+        Level &fine = levels.back();
+        buildInterp(rows, cols, rowNodes, colNodes,
+                    levels.size() == 1 ? fixed : vector<bool>(), fine.P);
+        transpose(fine.P, rowNodes.size() * colNodes.size(), fine.R);
+
+        rows = rowNodes.size();
+        cols = colNodes.size();
+        levels.push_back(Level());
+        levels.back().rows = rows;
+        levels.back().cols = cols;
+    }
+
+    for (size_t l = 0; l != levels.size(); ++l) {
+        size_t n = levels[l].rows * levels[l].cols;
+        levels[l].x.assign(n, Vector3f::ZERO);
+        levels[l].b.assign(n, Vector3f::ZERO);
+        levels[l].r.assign(n, Vector3f::ZERO);
+        levels[l].op = &levels[l].A;
+    }
+}
+
+void MultigridSolver::buildInterp(size_t rows, size_t cols,
+                                  vector<size_t> const &rowNodes,
+                                  vector<size_t> const &colNodes,
+                                  vector<bool> const &fixed, Interp &P)
+{
+    vector<vector<pair<int, float> > > wr, wc;
+    interp1D(rows, rowNodes, wr);
+    interp1D(cols, colNodes, wc);
+    size_t coarseCols = colNodes.size();
+
+    P.rowStart.assign(1, 0);
+    P.cols.clear();
+    P.w.clear();
+    for (size_t i = 0; i != rows; ++i) {
+        for (size_t j = 0; j != cols; ++j) {
+            // Fixed particles take no correction from coarse grids
+            if (fixed.empty() || !fixed[i * cols + j]) {
+                for (size_t a = 0; a != wr[i].size(); ++a) {
+                    for (size_t b = 0; b != wc[j].size(); ++b) {
+                        P.cols.push_back(
+                            wr[i][a].first * coarseCols + wc[j][b].first);
+                        P.w.push_back(wr[i][a].second * wc[j][b].second);
+                    }
+                }
+            }
+            P.rowStart.push_back(P.cols.size());
+        }
+    }
+}
+
+void MultigridSolver::transpose(Interp const &P, size_t numCoarse, Interp &R)
+{
+    size_t numFine = P.rowStart.size() - 1;
+    R.rowStart.assign(numCoarse + 1, 0);
+    for (size_t k = 0; k != P.cols.size(); ++k)
+        ++R.rowStart[P.cols[k] + 1];
+    for (size_t I = 0; I != numCoarse; ++I)
+        R.rowStart[I+1] += R.rowStart[I];
+
+    vector<size_t> fill(R.rowStart.begin(), R.rowStart.end() - 1);
+    R.cols.resize(P.cols.size());
+    R.w.resize(P.w.size());
+    for (size_t i = 0; i != numFine; ++i) {
+        for (size_t k = P.rowStart[i]; k != P.rowStart[i+1]; ++k) {
+            size_t slot = fill[P.cols[k]]++;
+            R.cols[slot] = i;
+            R.w[slot] = P.w[k];
+        }
+    }
+}
+
+void MultigridSolver::forEachChunk(size_t n,
+        std::function<void(size_t, size_t)> const &fn)
+{
+    size_t numChunks = (n + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    std::function<void(size_t)> task = [&](size_t k) {
+        fn(k * CHUNK_SIZE, std::min(n, (k + 1) * CHUNK_SIZE));
+    };
+    if (pool)
+        pool->run(numChunks, task);
+    else
+        for (size_t k = 0; k != numChunks; ++k)
+            task(k);
+}
+
+void MultigridSolver::multiply(BlockMatrix const &A,
+                               vector<Vector3f> const &x,
+                               vector<Vector3f> &y)
+{
+    forEachChunk(A.n, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i != end; ++i) {
+            Vector3f sum = Vector3f::ZERO;
+            for (size_t k = A.rowStart[i]; k != A.rowStart[i+1]; ++k)
+                sum += A.blocks[k] * x[A.cols[k]];
+            y[i] = sum;
+        }
+    });
+}
+
+float MultigridSolver::dot(vector<Vector3f> const &a,
+                           vector<Vector3f> const &b)
+{
+    vector<double> partial((a.size() + CHUNK_SIZE - 1) / CHUNK_SIZE, 0.0);
+    forEachChunk(a.size(), [&](size_t begin, size_t end) {
+        double sum = 0.0;
+        for (size_t i = begin; i != end; ++i)
+            sum += Vector3f::dot(a[i], b[i]);
+        partial[begin / CHUNK_SIZE] = sum;
+    });
+    double sum = 0.0;
+    for (size_t k = 0; k != partial.size(); ++k)
+        sum += partial[k];
+    return float(sum);
+}
+
+void MultigridSolver::invertDiagonal(Level &lv)
+{
+    BlockMatrix const &A = *lv.op;
+    lv.invDiag.resize(A.n);
+    forEachChunk(A.n, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i != end; ++i) {
+            int k = A.find(i, i);
+            bool singular = true;
+            if (k >= 0)
+                lv.invDiag[i] = A.blocks[k].inverse(&singular, 1e-12f);
+            if (singular)
+                lv.invDiag[i] = Matrix3f();
+        }
+    });
+}
+
+// A_c = R A P, one coarse row per loop iteration
+void MultigridSolver::galerkin(size_t l)
+{
+    Level &fine = levels[l], &coarse = levels[l+1];
+    BlockMatrix const &A = *fine.op;
+    Interp const &P = fine.P, &R = fine.R;
+    size_t n = coarse.rows * coarse.cols;
+
+    size_t numChunks = (n + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    vector<vector<size_t> > rowLen(numChunks);
+    vector<vector<int> > colsOut(numChunks);
+    vector<vector<Matrix3f> > blocksOut(numChunks);
+
+    int cc = coarse.cols;
+    forEachChunk(n, [&](size_t begin, size_t end) {
+        size_t c = begin / CHUNK_SIZE;
+        // Slot of each column near row I, columns are found by their
+        // grid offset from I. Anything further out is searched for.
+        int window[GALERKIN_WINDOW * GALERKIN_WINDOW];
+        vector<int> rowCols;
+        vector<Matrix3f> rowBlocks;
+        for (size_t I = begin; I != end; ++I) {
+            rowCols.clear();
+            rowBlocks.clear();
+            std::fill(window, window + GALERKIN_WINDOW * GALERKIN_WINDOW, -1);
+            int rI = I / cc, cI = I % cc;
+            for (size_t a = R.rowStart[I]; a != R.rowStart[I+1]; ++a) {
+                int i = R.cols[a];
+                for (size_t k = A.rowStart[i]; k != A.rowStart[i+1]; ++k) {
+                    int j = A.cols[k];
+                    for (size_t b = P.rowStart[j]; b != P.rowStart[j+1]; ++b) {
+                        int J = P.cols[b];
+                        int dr = J / cc - rI + GALERKIN_WINDOW / 2,
+                            dc = J % cc - cI + GALERKIN_WINDOW / 2;
+                        int *slot = NULL, found = -1;
+                        if (dr >= 0 && dr < GALERKIN_WINDOW &&
+                            dc >= 0 && dc < GALERKIN_WINDOW) {
+                            slot = &window[dr * GALERKIN_WINDOW + dc];
+                            found = *slot;
+                        } else {
+                            vector<int>::iterator it = std::find(
+                                rowCols.begin(), rowCols.end(), J);
+                            if (it != rowCols.end())
+                                found = it - rowCols.begin();
+                        }
+                        if (found < 0) {
+                            found = rowCols.size();
+                            rowCols.push_back(J);
+                            rowBlocks.push_back(Matrix3f());
+                            if (slot)
+                                *slot = found;
+                        }
+                        addScaled(rowBlocks[found], A.blocks[k],
+                                  R.w[a] * P.w[b]);
+                    }
+                }
+            }
+
+            // Store sorted by column
+            vector<int> order(rowCols.size());
+            for (size_t k = 0; k != order.size(); ++k)
+                order[k] = k;
+            std::sort(order.begin(), order.end(),
+                      [&](int u, int v) { return rowCols[u] < rowCols[v]; });
+            for (size_t k = 0; k != order.size(); ++k) {
+                colsOut[c].push_back(rowCols[order[k]]);
+                blocksOut[c].push_back(rowBlocks[order[k]]);
+            }
+            rowLen[c].push_back(rowCols.size());
+        }
+    });
+
+    BlockMatrix &Ac = coarse.A;
+    Ac.n = n;
+    Ac.rowStart.assign(1, 0);
+    Ac.cols.clear();
+    Ac.blocks.clear();
+    for (size_t c = 0; c != numChunks; ++c) {
+        for (size_t k = 0; k != rowLen[c].size(); ++k)
+            Ac.rowStart.push_back(Ac.rowStart.back() + rowLen[c][k]);
+        Ac.cols.insert(Ac.cols.end(), colsOut[c].begin(), colsOut[c].end());
+        Ac.blocks.insert(Ac.blocks.end(),
+                         blocksOut[c].begin(), blocksOut[c].end());
+    }
+}
+
+// r = b - A x
+void MultigridSolver::residual(Level &lv)
+{
+    BlockMatrix const &A = *lv.op;
+    forEachChunk(A.n, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i != end; ++i) {
+            Vector3f sum = lv.b[i];
+            for (size_t k = A.rowStart[i]; k != A.rowStart[i+1]; ++k)
+                sum -= A.blocks[k] * lv.x[A.cols[k]];
+            lv.r[i] = sum;
+        }
+    });
+}
+
+void MultigridSolver::smooth(Level &lv, int sweeps)
+{
+    for (int s = 0; s != sweeps; ++s) {
+        residual(lv);
+        forEachChunk(lv.x.size(), [&](size_t begin, size_t end) {
+            for (size_t i = begin; i != end; ++i)
+                lv.x[i] += JACOBI_OMEGA * (lv.invDiag[i] * lv.r[i]);
+        });
+    }
+}
+
+// Symmetric block Gauss-Seidel, serial but the grid is tiny here
+void MultigridSolver::coarseSolve(Level &lv)
+{
+    BlockMatrix const &A = *lv.op;
+    int n = A.n;
+    for (int s = 0; s != COARSE_SWEEPS; ++s) {
+        for (int pass = 0; pass != 2; ++pass) {
+            for (int t = 0; t != n; ++t) {
+                int i = pass == 0 ? t : n - 1 - t;
+                Vector3f sum = lv.b[i];
+                for (size_t k = A.rowStart[i]; k != A.rowStart[i+1]; ++k)
+                    if (A.cols[k] != i)
+                        sum -= A.blocks[k] * lv.x[A.cols[k]];
+                lv.x[i] = lv.invDiag[i] * sum;
+            }
+        }
+    }
+}
+
+// Approximately solves levels[l].op * x = b, starting from x = 0
+void MultigridSolver::vcycle(size_t l)
+{
+    Level &lv = levels[l];
+    std::fill(lv.x.begin(), lv.x.end(), Vector3f::ZERO);
+    if (l + 1 == levels.size()) {
+        coarseSolve(lv);
+        return;
+    }
+
+    Level &coarse = levels[l+1];
+    smooth(lv, CLO_MG_SMOOTH);
+    residual(lv);
+
+    // Restrict the residual, b_c = R r
+    forEachChunk(coarse.b.size(), [&](size_t begin, size_t end) {
+        for (size_t I = begin; I != end; ++I) {
+            Vector3f sum = Vector3f::ZERO;
+            for (size_t k = lv.R.rowStart[I]; k != lv.R.rowStart[I+1]; ++k)
+                sum += lv.R.w[k] * lv.r[lv.R.cols[k]];
+            coarse.b[I] = sum;
+        }
+    });
+
+    vcycle(l + 1);
+
+    // Prolongate the correction, x += P x_c
+    forEachChunk(lv.x.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i != end; ++i)
+            for (size_t k = lv.P.rowStart[i]; k != lv.P.rowStart[i+1]; ++k)
+                lv.x[i] += lv.P.w[k] * coarse.x[lv.P.cols[k]];
+    });
+
+    smooth(lv, CLO_MG_SMOOTH);
+}
+
+int MultigridSolver::solve(BlockMatrix const &A, vector<Vector3f> const &b,
+                           vector<Vector3f> &x, float tol, int maxIter)
+{
+    size_t n = A.n;
+    levels[0].op = &A;
+    for (size_t l = 0; l != levels.size(); ++l) {
+        if (l > 0)
+            galerkin(l - 1);
+        invertDiagonal(levels[l]);
+    }
+
+    r.resize(n);
+    z.resize(n);
+    p.resize(n);
+    q.resize(n);
+
+    multiply(A, x, q);
+    forEachChunk(n, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i != end; ++i)
+            r[i] = b[i] - q[i];
+    });
+
+    float bnorm = std::sqrt(dot(b, b));
+    if (bnorm == 0.0f) {
+        std::fill(x.begin(), x.end(), Vector3f::ZERO);
+        return 0;
+    }
+
+    // z = M^-1 r, one V-cycle
+    levels[0].b = r;
+    vcycle(0);
+    p = z = levels[0].x;
+    float rz = dot(r, z);
+
+    int it = 0;
+    while (it < maxIter && std::sqrt(dot(r, r)) > tol * bnorm) {
+        multiply(A, p, q);
+        float alpha = rz / dot(p, q);
+        forEachChunk(n, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i != end; ++i) {
+                x[i] += alpha * p[i];
+                r[i] -= alpha * q[i];
+            }
+        });
+        ++it;
+
+        levels[0].b = r;
+        vcycle(0);
+        z = levels[0].x;
+        float rzNew = dot(r, z);
+        float beta = rzNew / rz;
+        rz = rzNew;
+        forEachChunk(n, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i != end; ++i)
+                p[i] = z[i] + beta * p[i];
+        });
+    }
+    return it;
+}
@@ -0,0 +1,104 @@
+#ifndef MULTIGRIDSOLVER_H
+#define MULTIGRIDSOLVER_H
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+#include <vecmath.h>
+
+#include "ThreadPool.h"
+
+using namespace std;
+
+// Symmetric sparse matrix of 3x3 blocks in compressed row form.
+// Row i owns blocks [rowStart[i], rowStart[i+1]), sorted by column.
+struct BlockMatrix
+{
+    size_t n;
+    vector<size_t> rowStart;
+    vector<int> cols;
+    vector<Matrix3f> blocks;
+
+    BlockMatrix() : n(0) {}
+
+    // Index of block (i, j) in `blocks`, -1 if it is not stored
+    int find(int i, int j) const;
+};
+
+// Solves A x = b for a block matrix defined on a rows x cols lattice
+// (particle index = i * cols + j), with conjugate gradients
+// preconditioned by one geometric multigrid V-cycle.
+//
+// Each coarser grid keeps every other row and column of the finer one
+// (plus the last, so odd sizes work), values are moved between grids by
+// bilinear prolongation P and restriction R = P^T, and the coarse
+// operators are the Galerkin products R A P. Smoothing is damped block
+// Jacobi, so every level stays parallel; the coarsest grid is solved
+// with symmetric Gauss-Seidel sweeps.
+//
+// Stiffness information crosses the whole sheet within one V-cycle,
+// so the iteration count stays roughly flat as the grid grows.
+//
+// All loops run over fixed chunks of rows and reductions add the
+// per-chunk partial sums in chunk order, so results do not depend on
+// the number of threads.
+class MultigridSolver
+{
+public:
+    explicit MultigridSolver(ThreadPool *pool = NULL);
+
+    // Build the grid hierarchy. Fixed particles are left out of all
+    // coarse grids, their rows in A must be identity.
+    void setup(size_t rows, size_t cols, vector<bool> const &fixed);
+
+    // x holds the initial guess on entry.
+    // Returns the number of CG iterations taken.
+    int solve(BlockMatrix const &A, vector<Vector3f> const &b,
+              vector<Vector3f> &x, float tol, int maxIter);
+
+private:
+    // Bilinear interpolation from a coarse grid to the next finer one:
+    // fine row i takes weight w[k] of coarse node cols[k].
+    struct Interp
+    {
+        vector<size_t> rowStart;
+        vector<int> cols;
+        vector<float> w;
+    };
+
+    struct Level
+    {
+        size_t rows;
+        size_t cols;
+        BlockMatrix A;          // owned on coarse levels only
+        BlockMatrix const *op;  // operator used on this level
+        vector<Matrix3f> invDiag;
+        Interp P;               // from level l+1 to this level
+        Interp R;               // P transposed
+        vector<Vector3f> x, b, r;
+    };
+
+    void vcycle(size_t l);
+    void smooth(Level &lv, int sweeps);
+    void coarseSolve(Level &lv);
+    void residual(Level &lv);
+    void galerkin(size_t l);
+    void invertDiagonal(Level &lv);
+
+    void multiply(BlockMatrix const &A, vector<Vector3f> const &x,
+                  vector<Vector3f> &y);
+    float dot(vector<Vector3f> const &a, vector<Vector3f> const &b);
+    void forEachChunk(size_t n, std::function<void(size_t, size_t)> const &fn);
+
+    static void buildInterp(size_t rows, size_t cols,
+                            vector<size_t> const &rowNodes,
+                            vector<size_t> const &colNodes,
+                            vector<bool> const &fixed, Interp &P);
+    static void transpose(Interp const &P, size_t numCoarse, Interp &R);
+
+    ThreadPool *pool;
+    vector<Level> levels;
+    vector<Vector3f> r, z, p, q;
+};
+
+#endif
@@ -1,5 +1,6 @@
 #include "TimeStepper.hpp"
 #include "common.h"
+#include "Trace.h"
 
 // Note the systems are time-invariant, hence we can ignore Time argument
 
@@ -13,6 +14,7 @@ void stateAdd(stateType &state, stateType &delta, float mul) {
 ///DONE: implement Explicit Euler time integrator here
 void ForwardEuler::takeStep(ParticleSystem* particleSystem, float stepSize)
 {
+    TRACE_SCOPE("ForwardEuler::takeStep");
     stateType state = particleSystem->getState(),
         f = particleSystem->evalF(state);
     stateAdd(state, f, stepSize);
@@ -22,6 +24,7 @@ void ForwardEuler::takeStep(ParticleSystem* particleSystem, float stepSize)
 ///DONE: implement Trapzoidal rule here
 void Trapzoidal::takeStep(ParticleSystem* particleSystem, float stepSize)
 {
+    TRACE_SCOPE("Trapzoidal::takeStep");
     stateType state = particleSystem->getState(), next = state;
     stateType f0 = particleSystem->evalF(state);
     stateAdd(next, f0, stepSize);
@@ -32,8 +35,18 @@ void Trapzoidal::takeStep(ParticleSystem* particleSystem, float stepSize)
     particleSystem->setState(state);
 }
 
+void ImplicitEuler::takeStep(ParticleSystem* particleSystem, float stepSize)
+{
+    TRACE_SCOPE("ImplicitEuler::takeStep");
+    if (!particleSystem->stepImplicit(stepSize)) {
+        TimeStepper &explicitStepper = fallback;
+        explicitStepper.takeStep(particleSystem, stepSize);
+    }
+}
+
 void MyRK4::takeStep(ParticleSystem* particleSystem, float stepSize)
 {
+    TRACE_SCOPE("MyRK4::takeStep");
     stateType state, x1=state, x2=state, x3=state,
               k1, k2, k3, k4;
     state = particleSystem->getState();
@@ -28,6 +28,14 @@ class MyRK4:public TimeStepper
   void takeStep(ParticleSystem* particleSystem, float stepSize);
 };
 
+// Linearised backward Euler through ParticleSystem::stepImplicit,
+// systems without it fall back to the trapezoidal rule.
+class ImplicitEuler:public TimeStepper
+{
+  void takeStep(ParticleSystem* particleSystem, float stepSize);
+  Trapzoidal fallback;
+};
+
 /////////////////////////
 
 //Provided
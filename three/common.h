@@ -4,6 +4,7 @@
 #include <vecmath.h>
 #include <GL/glut.h>
 
+#include <cstring>
 #include <map>
 #include <utility>  // std::pair
 
@@ -13,6 +14,27 @@
 
 typedef std::vector<Vector3f> stateType;
 
+// FNV-1a hash over the bit patterns of a state, chained through `seed`.
+// Two runs agree on every step iff they produce the same hashes, which
+// makes diffing a long simulation cheap.
+inline unsigned long long
+stateHash(const stateType &state,
+          unsigned long long seed = 14695981039346656037ULL) {
+    unsigned long long h = seed;
+    LOOP_STATE(i, state) {
+        for (int k = 0; k != 3; ++k) {
+            unsigned int bits;
+            float v = state[i][k];
+            std::memcpy(&bits, &v, sizeof(bits));
+            for (int b = 0; b != 4; ++b) {
+                h ^= (bits >> (8 * b)) & 0xffu;
+                h *= 1099511628211ULL;
+            }
+        }
+    }
+    return h;
+}
+
 // Inline functions to help with drawing
 inline void glVertex( const Vector3f& a )
 { glVertex3fv(a); }
@@ -133,6 +155,13 @@ public:
     float 
     massGet(int i) { return particles[i].mass; }
 
+    // Get rest length and stiffness of spring spr, where spr indexes
+    // allPairs()
+    float
+    restGet(int spr) const { return springs[spr].r; }
+    float
+    stiffnessGet(int spr) const { return springs[spr].k; }
+
     //  Get a list of 'j' that connect to 'i'
     vector<int> const &
     connects(int i) const { return particles[i].connects(); }
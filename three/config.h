@@ -35,6 +35,22 @@
 
 #define WIND_FORCE          0.25f
 
+// Parallel evaluation.
+// Rows per task, fixed so that the partition is the same for any
+// number of threads.
+#define CLO_CHUNK_ROWS      4
+// Threads used by default, 0 means one per hardware thread
+#define NUM_THREADS         0
+
+// Implicit integrator ("i"), see MultigridSolver.h.
+// The linear solve stops at relative residual CLO_CG_TOL.
+#define CLO_CG_TOL          1e-4f
+#define CLO_CG_MAX_ITER     100
+// Jacobi sweeps before and after each coarse grid correction
+#define CLO_MG_SMOOTH       2
+// Stop coarsening at this many particles
+#define CLO_MG_COARSEST     32
+
 // Ball for collision
 #define BALL_SIZE           1.0f
 #define BALL_X              0.5f
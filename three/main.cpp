@@ -1,6 +1,7 @@
 #include <cmath>
 #include <cstdlib>
 #include <ctime>
+#include <fstream>
 #include <iostream>
 #include <vector>
 
@@ -15,6 +16,10 @@
 #include "simpleSystem.h"
 #include "pendulumSystem.h"
 #include "ClothSystem.h"
+#include "ThreadPool.h"
+#include "SoftRasterizer.h"
+#include "Trace.h"
+#include "bitmap.h"
 
 using namespace std;
 
@@ -24,10 +29,10 @@ namespace
     class SystemCollections {
     public:
         SystemCollections(): cloth_ind(-1) {};
-        void setup(int vis_index) {
+        void setup(int vis_index, ThreadPool *pool) {
             addSys(new SimpleSystem());
             addSys(new PendulumSystem(PENDSYS_NUM_PARTICLES, vis_index));
-            addSys(new ClothSystem(HEIGHT, WIDTH), true);
+            addSys(new ClothSystem(HEIGHT, WIDTH, pool), true);
         }
         void addSys(ParticleSystem *sys, bool is_cloth=false) { 
             if (is_cloth)
@@ -47,9 +52,17 @@ namespace
             else return true;
         }
         void sysStep(TimeStepper *stepper, float stepSize) {
+            TRACE_SCOPE("SystemCollections::sysStep");
             for (size_t i = 0; i != sys_list.size(); ++i)
                 stepper->takeStep(sys_list[i], stepSize);
         }
+        // Hash of all states, in system order
+        unsigned long long stateHash() const {
+            unsigned long long h = ::stateHash(stateType());
+            for (size_t i = 0; i != sys_list.size(); ++i)
+                h = ::stateHash(sys_list[i]->getState(), h);
+            return h;
+        }
         void clear() {
             for (size_t i = 0; i != sys_list.size(); ++i)
                 delete sys_list[i];
@@ -62,13 +75,27 @@ namespace
 
     SystemCollections sys_collections;
     TimeStepper * timeStepper;
+    ThreadPool * pool;
     int vis_index = -1;
     float stepSize = 0.04f;
+    int numThreads = NUM_THREADS;
+    unsigned long stepCount = 0;
     // Cloth System
     bool render = true;
     bool wind = false;
     bool swing = false;
 
+  TimeStepper *newRK4()
+  {
+#ifdef VECMATH_USE_SSE
+    // libRK4.a was compiled against the unpadded Vector3f
+    cout << "RK4 needs the scalar vecmath, using TRAPEZOIDAL" << endl;
+    return new Trapzoidal();
+#else
+    return new RK4();
+#endif
+  }
+
   // initialize your particle systems
   ///DONE: read argv here. set timestepper , step size etc
   void initSystem(int argc, char * argv[])
@@ -91,15 +118,19 @@ namespace
     }
     else if (method == "r") {
         cout << "Integrator: RK4" << endl;
-        timeStepper = new RK4();
+        timeStepper = newRK4();
+    }
+    else if (method == "i") {
+        cout << "Integrator: IMPLICIT EULER" << endl;
+        timeStepper = new ImplicitEuler();
     }
     else if (method == "mr") {
         cout << "Integrator: MyRK4" << endl;
-        timeStepper = new RK4();
+        timeStepper = newRK4();
     }
     else {
         cout << "Use RK4 by default" << endl;
-        timeStepper = new RK4();
+        timeStepper = newRK4();
     }
     if (argc > 2) {
         stepSize = std::atof(argv[2]);
@@ -111,8 +142,16 @@ namespace
         if (vis_index != -1)
             cout << "Visualize particle index: " << vis_index << endl;
     }
+    if (argc > 4) {
+        numThreads = std::atoi(argv[4]);
+    }
 
-    sys_collections.setup(vis_index);
+    pool = new ThreadPool(numThreads);
+    cout << "Threads: " << pool->size() << endl;
+#ifdef DETERMINISTIC
+    cout << "Deterministic mode: printing state hash per step" << endl;
+#endif
+    sys_collections.setup(vis_index, pool);
   }
 
   // Take a step forward for the particle shower
@@ -123,6 +162,11 @@ namespace
       ///DONE The stepsize should change according to commandline arguments
     if(timeStepper!=0){
         sys_collections.sysStep(timeStepper, stepSize);
+        ++stepCount;
+#ifdef DETERMINISTIC
+        cout << "step " << stepCount << " hash " << hex
+             << sys_collections.stateHash() << dec << endl;
+#endif
     }
   }
 
@@ -190,7 +234,8 @@ namespace
         case 'r':
         {
             sys_collections.clear();
-            sys_collections.setup(vis_index);
+            sys_collections.setup(vis_index, pool);
+            stepCount = 0;
             break;
         }
 
@@ -214,6 +259,12 @@ namespace
             break;
         }
 
+#ifdef TRACE
+        case 't':
+            Trace::write("a3_trace.json");
+            break;
+#endif
+
         case 's':
         {
             swing = !swing;
@@ -318,6 +369,7 @@ namespace
     // This function is responsible for displaying the object.
     void drawScene(void)
     {
+        TRACE_SCOPE("drawScene");
         // Clear the rendering window
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -382,6 +434,90 @@ namespace
         glutTimerFunc(t, &timerFunc, t);
     }
 
+    // A unit sphere like glutSolidSphere(1, slices, stacks) draws,
+    // counterclockwise from outside
+    void makeSphere(int slices, int stacks, vector<Vector3f> &positions,
+                    vector<unsigned> &indices)
+    {
+        positions.clear();
+        indices.clear();
+        for (int i = 0; i <= stacks; ++i) {
+            float theta = float(M_PI) * i / stacks;
+            for (int j = 0; j <= slices; ++j) {
+                float phi = 2 * float(M_PI) * j / slices;
+                positions.push_back(Vector3f(sin(theta) * sin(phi), cos(theta),
+                                             sin(theta) * cos(phi)));
+            }
+        }
+        for (int i = 0; i < stacks; ++i) {
+            for (int j = 0; j < slices; ++j) {
+                unsigned a = i * (slices + 1) + j, b = a + 1,
+                         c = a + slices + 1, d = c + 1;
+                const unsigned faces[] = { a, c, d,  a, d, b };
+                indices.insert(indices.end(), faces, faces + 6);
+            }
+        }
+    }
+
+    // Steps the systems numFrames times without a window and writes the
+    // cloth and its ball before every step to OUTPREFIX_0000.bmp, ...,
+    // as drawScene() shows them with the initial camera, drawn by
+    // SoftRasterizer
+    int renderFrames(int numFrames, const string &outPrefix)
+    {
+        ClothSystem *cloth = sys_collections.getClothSys();
+        if (!cloth) {
+            cerr << "-render needs an integrator" << endl;
+            return -1;
+        }
+        const int width = 600, height = 600;
+        camera.SetDimensions(width, height);
+        camera.SetViewport(0, 0, width, height);
+        camera.SetPerspective(50);
+
+        SoftRasterizer raster(width, height, numThreads);
+        raster.setProjection(camera.projectionMatrix());
+        // initRendering() culls back faces, and no specular color is set
+        raster.setCulling(true);
+        RasterMaterial clothMaterial = { { 0.5f, 0.5f, 0.9f }, { 0, 0, 0 }, 0 };
+        RasterMaterial ballMaterial = { { 0.5f, 0.9f, 0.3f }, { 0, 0, 0 }, 0 };
+
+        vector<Vector3f> sphere, positions, normals;
+        vector<unsigned> sphereIndices, indices;
+        makeSphere(30, 30, sphere, sphereIndices);
+        vector<unsigned char> file;
+        for (int f = 0; f < numFrames; ++f) {
+            raster.clear(0, 0, 0);
+
+            Vector4f ball = cloth->ball();
+            raster.setModelView(camera.viewMatrix() * Matrix4f::translation(ball.xyz())
+                                * Matrix4f::uniformScaling(ball.w()));
+            raster.setMaterial(ballMaterial);
+            raster.drawTriangles(&sphere[0], &sphere[0], sizeof(Vector3f), sphere.size(),
+                                 &sphereIndices[0], sphereIndices.size() / 3);
+
+            cloth->clothBuffers(positions, normals, indices);
+            raster.setModelView(camera.viewMatrix());
+            raster.setMaterial(clothMaterial);
+            raster.drawTriangles(&positions[0], &normals[0], sizeof(Vector3f), positions.size(),
+                                 &indices[0], indices.size() / 3);
+
+            char filename[1024];
+            snprintf(filename, sizeof(filename), "%s_%04d.bmp", outPrefix.c_str(), f);
+            encodeBMP(width, height, raster.pixels(), file);
+            ofstream out(filename, ios::binary);
+            out.write(reinterpret_cast<const char *>(&file[0]), file.size());
+            if (!out) {
+                cerr << "could not write " << filename << endl;
+                return -1;
+            }
+
+            stepSystem();
+        }
+        cout << "wrote " << numFrames << " frames" << endl;
+        return 0;
+    }
+
     
 
     
@@ -392,6 +528,24 @@ namespace
 // Set up OpenGL, define the callbacks and start the main loop
 int main( int argc, char* argv[] )
 {
+#ifdef TRACE
+    Trace::writeAtExit("a3_trace.json");
+#endif
+
+    // -render N OUTPREFIX, followed by the usual arguments, writes N
+    // frames without opening a window, see renderFrames()
+    if (argc > 3 && string(argv[1]) == "-render") {
+        int numFrames = atoi(argv[2]);
+        string outPrefix = argv[3];
+        argv[3] = argv[0];
+        argc -= 3;
+        argv += 3;
+        camera.SetDistance( 10 );
+        camera.SetCenter( Vector3f::ZERO );
+        initSystem(argc, argv);
+        return renderFrames(numFrames, outPrefix);
+    }
+
     glutInit( &argc, argv );
 
     // We're going to animate it, so double buffer 
@@ -11,11 +11,16 @@ class ParticleSystem
 public:
 
 	ParticleSystem(int numParticles=0);
+	virtual ~ParticleSystem() {}
 
 	int m_numParticles;
 	
 	// for a given state, evaluate derivative f(X,t)
 	virtual vector<Vector3f> evalF(vector<Vector3f> state) = 0;
+
+	// Advance the state by one linearised backward Euler step.
+	// Returns false if the system only supports explicit integration.
+	virtual bool stepImplicit(float stepSize) { return false; }
 	
 	// getter method for the system's state
 	vector<Vector3f> getState(){ return m_vVecState; };
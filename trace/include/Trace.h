@@ -0,0 +1,72 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Scoped timers that write a trace for Chrome's trace viewer
+// (chrome://tracing or ui.perfetto.dev):
+//
+//   void SkeletalModel::updateMeshes( ... )
+//   {
+//       TRACE_SCOPE( "SkeletalModel::updateMeshes" );
+//       ...
+//   }
+//
+// records the time the function took, on the thread it ran on. Scopes
+// nest. Every thread keeps the last BUFFER_EVENTS scopes it closed in a
+// ring buffer of its own, so recording takes no lock; write() collects
+// the buffers of all threads into one JSON file.
+//
+// TRACE_SCOPE() compiles to nothing unless TRACE is defined (make
+// TRACE=1), so the hooks may stay in hot paths. Code that calls Trace
+// itself should be inside #ifdef TRACE as well.
+class Trace
+{
+public:
+	// Scopes kept per thread, older ones are overwritten
+	static const size_t BUFFER_EVENTS = size_t( 1 ) << 16;
+
+	// Nanoseconds on the clock of the trace
+	static uint64_t now();
+
+	// Records a scope of the calling thread from start to end (see
+	// now()). name must stay valid until the trace is written, a string
+	// literal in practice.
+	static void record( const char* name, uint64_t start, uint64_t end );
+
+	// Writes every recorded scope as Chrome trace JSON. Scopes that
+	// close on other threads meanwhile may be left out, so call it
+	// while they are idle, e.g. between frames. Returns false, with a
+	// message on stderr, if the file cannot be written.
+	static bool write( const char* filename );
+
+	// write( filename ) when the program exits
+	static void writeAtExit( const char* filename );
+};
+
+// Records its lifetime, see TRACE_SCOPE()
+class TraceScope
+{
+public:
+	explicit TraceScope( const char* name ) : m_name( name ), m_start( Trace::now() ) { }
+	~TraceScope() { Trace::record( m_name, m_start, Trace::now() ); }
+
+private:
+	TraceScope( const TraceScope& );
+	TraceScope& operator=( const TraceScope& );
+
+	const char* m_name;
+	uint64_t m_start;
+};
+
+#define TRACE_CONCAT_( a, b ) a##b
+#define TRACE_CONCAT( a, b ) TRACE_CONCAT_( a, b )
+
+#ifdef TRACE
+#define TRACE_SCOPE( name ) TraceScope TRACE_CONCAT( traceScope, __LINE__ )( name )
+#else
+#define TRACE_SCOPE( name ) do { } while( 0 )
+#endif
+
+#endif // TRACE_H
@@ -0,0 +1,163 @@
+#include "Trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+	struct Event
+	{
+		const char* name;
+		uint64_t start;
+		uint64_t end;
+	};
+
+	// The events of one thread. Only that thread writes them; count is
+	// published after every event so that write() sees complete ones.
+	struct Buffer
+	{
+		explicit Buffer( unsigned tid ) : tid( tid ), events( Trace::BUFFER_EVENTS ), count( 0 ) { }
+
+		unsigned tid;
+		vector< Event > events;
+		atomic< uint64_t > count;
+	};
+
+	// Buffers of every thread that recorded something. They stay until
+	// the program ends, so the scopes of threads that have exited are
+	// written too.
+	struct Registry
+	{
+		Registry() : epoch( chrono::steady_clock::now() ) { }
+
+		chrono::steady_clock::time_point epoch;
+		mutex lock;
+		vector< unique_ptr< Buffer > > buffers;
+		string exitFilename;
+	};
+
+	// Never destroyed: threads may still record while statics go away
+	Registry& registry()
+	{
+		static Registry* r = new Registry;
+		return *r;
+	}
+
+	Buffer& threadBuffer()
+	{
+		static thread_local Buffer* buffer = NULL;
+		if( !buffer )
+		{
+			Registry& r = registry();
+			lock_guard< mutex > guard( r.lock );
+			r.buffers.push_back( unique_ptr< Buffer >( new Buffer( unsigned( r.buffers.size() ) ) ) );
+			buffer = r.buffers.back().get();
+		}
+		return *buffer;
+	}
+
+	void writeString( FILE* fp, const char* s )
+	{
+		fputc( '"', fp );
+		for( ; *s; ++s )
+		{
+			if( *s == '"' || *s == '\\' )
+			{
+				fputc( '\\', fp );
+			}
+			if( (unsigned char)*s >= 0x20 )
+			{
+				fputc( *s, fp );
+			}
+		}
+		fputc( '"', fp );
+	}
+
+	void writeAtExitHandler()
+	{
+		Trace::write( registry().exitFilename.c_str() );
+	}
+}
+
+uint64_t Trace::now()
+{
+	return uint64_t( chrono::duration_cast< chrono::nanoseconds >(
+		chrono::steady_clock::now() - registry().epoch ).count() );
+}
+
+void Trace::record( const char* name, uint64_t start, uint64_t end )
+{
+	Buffer& b = threadBuffer();
+	const uint64_t n = b.count.load( memory_order_relaxed );
+	Event& e = b.events[ n % BUFFER_EVENTS ];
+	e.name = name;
+	e.start = start;
+	e.end = end;
+	b.count.store( n + 1, memory_order_release );
+}
+
+bool Trace::write( const char* filename )
+{
+	FILE* fp = fopen( filename, "w" );
+	if( !fp )
+	{
+		fprintf( stderr, "Cannot write trace %s\n", filename );
+		return false;
+	}
+	Registry& r = registry();
+	lock_guard< mutex > guard( r.lock );
+	size_t numEvents = 0;
+	fprintf( fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" );
+	for( size_t i = 0; i != r.buffers.size(); ++i )
+	{
+		const Buffer& b = *r.buffers[ i ];
+		const uint64_t end = b.count.load( memory_order_acquire );
+		const uint64_t begin = end > BUFFER_EVENTS ? end - BUFFER_EVENTS : 0;
+		vector< Event > events;
+		events.reserve( size_t( end - begin ) );
+		for( uint64_t k = begin; k != end; ++k )
+		{
+			events.push_back( b.events[ k % BUFFER_EVENTS ] );
+		}
+		// the thread may have lapped the oldest ones while they were copied
+		const uint64_t now = b.count.load( memory_order_acquire );
+		const uint64_t valid = now > BUFFER_EVENTS ? now - BUFFER_EVENTS : 0;
+		for( uint64_t k = max( begin, valid ); k < end; ++k )
+		{
+			const Event& e = events[ size_t( k - begin ) ];
+			fprintf( fp, "%s\n{\"name\":", numEvents++ ? "," : "" );
+			writeString( fp, e.name );
+			// microseconds
+			fprintf( fp, ",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+				b.tid, e.start * 1e-3, ( e.end - e.start ) * 1e-3 );
+		}
+	}
+	fprintf( fp, "\n]}\n" );
+	if( fclose( fp ) != 0 )
+	{
+		fprintf( stderr, "Cannot write trace %s\n", filename );
+		return false;
+	}
+	fprintf( stderr, "Wrote %zu trace events to %s\n", numEvents, filename );
+	return true;
+}
+
+void Trace::writeAtExit( const char* filename )
+{
+	Registry& r = registry();
+	const bool first = r.exitFilename.empty();
+	r.exitFilename = filename;
+	if( first )
+	{
+		atexit( writeAtExitHandler );
+	}
+}
@@ -0,0 +1,212 @@
+#include "AnimationClip.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "Trace.h"
+
+using namespace std;
+
+namespace
+{
+	// Samples per pool task
+	const size_t CHUNK_SAMPLES = 16;
+
+	// Rotations with a smaller squared norm cannot be normalized
+	const float MIN_ROTATION_NORM2 = 1e-8f;
+
+	// The end keys of a looping clip agree up to this much in |dot|
+	const float LOOP_EPSILON = 1e-5f;
+}
+
+AnimationClip::AnimationClip() :
+	m_numJoints( 0 )
+{
+}
+
+shared_ptr< const AnimationClip > AnimationClip::load( const char* filename )
+{
+	ifstream istrm( filename );
+	if( !istrm.is_open() )
+	{
+		return shared_ptr< const AnimationClip >();
+	}
+
+	shared_ptr< AnimationClip > clip( new AnimationClip() );
+	size_t numKeys = 0;
+	size_t joint = 0;
+	string buf;
+	while( getline( istrm, buf ) )
+	{
+		stringstream ss( buf );
+		string s;
+		if( !( ss >> s ) || s[ 0 ] == '#' )
+		{
+			continue;
+		}
+		if( s == "clip" )
+		{
+			if( !( ss >> clip->m_numJoints >> numKeys ) )
+			{
+				cerr << filename << ": bad clip line" << endl;
+				return shared_ptr< const AnimationClip >();
+			}
+		}
+		else if( s == "key" )
+		{
+			float t;
+			Vector3f translation;
+			if( !( ss >> t >> translation[ 0 ] >> translation[ 1 ] >> translation[ 2 ] ) )
+			{
+				cerr << filename << ": bad key line" << endl;
+				return shared_ptr< const AnimationClip >();
+			}
+			if( !clip->m_times.empty() &&
+				( joint != clip->m_numJoints || t <= clip->m_times.back() ) )
+			{
+				cerr << filename << ": bad key at time " << t << endl;
+				return shared_ptr< const AnimationClip >();
+			}
+			clip->m_times.push_back( t );
+			clip->m_rootTranslations.push_back( translation );
+			joint = 0;
+		}
+		else
+		{
+			Quat4f q;
+			stringstream qs( buf );
+			if( !( qs >> q[ 0 ] >> q[ 1 ] >> q[ 2 ] >> q[ 3 ] ) ||
+				q.absSquared() < MIN_ROTATION_NORM2 )
+			{
+				cerr << filename << ": bad rotation \"" << buf << "\"" << endl;
+				return shared_ptr< const AnimationClip >();
+			}
+			if( clip->m_times.empty() || joint == clip->m_numJoints )
+			{
+				cerr << filename << ": rotation outside a key" << endl;
+				return shared_ptr< const AnimationClip >();
+			}
+			q.normalize();
+			const size_t k = clip->m_times.size() - 1;
+			if( k > 0 && Quat4f::dot( q, clip->rotation( k - 1, joint ) ) < 0 )
+			{
+				q = -1.0f * q;
+			}
+			clip->m_rotations.push_back( q );
+			++joint;
+		}
+	}
+	if( clip->m_times.empty() || clip->m_times.size() != numKeys ||
+		joint != clip->m_numJoints )
+	{
+		cerr << filename << ": expected " << numKeys << " keys of "
+			<< clip->m_numJoints << " joints" << endl;
+		return shared_ptr< const AnimationClip >();
+	}
+
+	// When the last key repeats the first, the end keys take their missing
+	// neighbour from across the loop seam (keys n - 2 and 1), so playback
+	// keeps its velocity there. Otherwise they use themselves.
+	const size_t n = clip->m_numJoints;
+	bool loops = numKeys > 2;
+	for( size_t j = 0; loops && j < n; ++j )
+	{
+		loops = fabs( Quat4f::dot( clip->rotation( 0, j ), clip->rotation( numKeys - 1, j ) ) ) >
+			1.0f - LOOP_EPSILON;
+	}
+	clip->m_tangents.resize( clip->m_rotations.size() );
+	for( size_t k = 0; k < numKeys; ++k )
+	{
+		const size_t before = k > 0 ? k - 1 : ( loops ? numKeys - 2 : k );
+		const size_t after = k + 1 < numKeys ? k + 1 : ( loops ? 1 : k );
+		for( size_t j = 0; j < n; ++j )
+		{
+			const Quat4f& center = clip->rotation( k, j );
+			Quat4f a = clip->rotation( before, j );
+			Quat4f b = clip->rotation( after, j );
+			// Neighbours across the seam may lie in the other hemisphere
+			if( Quat4f::dot( center, a ) < 0 )
+			{
+				a = -1.0f * a;
+			}
+			if( Quat4f::dot( center, b ) < 0 )
+			{
+				b = -1.0f * b;
+			}
+			clip->m_tangents[ k * n + j ] = Quat4f::squadTangent( a, center, b );
+		}
+	}
+	return clip;
+}
+
+void AnimationClip::sample( float time, ClipInterpolation interpolation, Pose& pose ) const
+{
+	pose.rotations.resize( m_numJoints );
+	if( m_times.size() == 1 )
+	{
+		copy( m_rotations.begin(), m_rotations.end(), pose.rotations.begin() );
+		pose.rootTranslation = m_rootTranslations[ 0 ];
+		return;
+	}
+
+	// wrap into [ start, end ), then find the keys around time
+	const float start = startTime(), length = endTime() - start;
+	time = start + fmod( time - start, length );
+	if( time < start )
+	{
+		time += length;
+	}
+	size_t k = upper_bound( m_times.begin(), m_times.end(), time ) - m_times.begin();
+	k = min( max( k, size_t( 1 ) ), m_times.size() - 1 ) - 1;
+	const float u = ( time - m_times[ k ] ) / ( m_times[ k + 1 ] - m_times[ k ] );
+
+	pose.rootTranslation = ( 1.0f - u ) * m_rootTranslations[ k ] + u * m_rootTranslations[ k + 1 ];
+	const Quat4f* a = &m_rotations[ k * m_numJoints ];
+	const Quat4f* b = a + m_numJoints;
+	if( interpolation == CLIP_SQUAD )
+	{
+		const Quat4f* tanA = &m_tangents[ k * m_numJoints ];
+		const Quat4f* tanB = tanA + m_numJoints;
+		for( size_t j = 0; j < m_numJoints; ++j )
+		{
+			pose.rotations[ j ] = Quat4f::squad( a[ j ], tanA[ j ], tanB[ j ], b[ j ], u );
+		}
+	}
+	else
+	{
+		for( size_t j = 0; j < m_numJoints; ++j )
+		{
+			pose.rotations[ j ] = Quat4f::slerp( a[ j ], b[ j ], u );
+		}
+	}
+}
+
+void AnimationClip::sampleBatch( const ClipSample* samples, size_t numSamples,
+	ClipInterpolation interpolation, ThreadPool* pool )
+{
+	TRACE_SCOPE( "AnimationClip::sampleBatch" );
+	const size_t numChunks = ( numSamples + CHUNK_SAMPLES - 1 ) / CHUNK_SAMPLES;
+	auto task = [&]( size_t c )
+	{
+		const size_t end = min( numSamples, ( c + 1 ) * CHUNK_SAMPLES );
+		for( size_t i = c * CHUNK_SAMPLES; i < end; ++i )
+		{
+			samples[ i ].clip->sample( samples[ i ].time, interpolation, *samples[ i ].pose );
+		}
+	};
+	if( pool )
+	{
+		pool->run( numChunks, task );
+	}
+	else
+	{
+		for( size_t c = 0; c < numChunks; ++c )
+		{
+			task( c );
+		}
+	}
+}
@@ -0,0 +1,87 @@
+#ifndef ANIMATIONCLIP_H
+#define ANIMATIONCLIP_H
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include <vecmath.h>
+
+#include "ThreadPool.h"
+
+// A pose of a skeleton: one rotation per joint, applied after the bind
+// transform of the joint, and the translation of the root
+struct Pose
+{
+	std::vector< Quat4f > rotations;
+	Vector3f rootTranslation;
+};
+
+enum ClipInterpolation
+{
+	CLIP_SLERP,
+	CLIP_SQUAD
+};
+
+class AnimationClip;
+
+// One pose to evaluate in AnimationClip::sampleBatch()
+struct ClipSample
+{
+	const AnimationClip* clip;
+	float time;
+	Pose* pose;
+};
+
+// Keyframed joint rotations, read from a text file:
+//
+//   clip NUM_JOINTS NUM_KEYS
+//   key TIME TX TY TZ
+//   W X Y Z
+//   ...
+//
+// Every key line gives the time in seconds and the root translation,
+// and is followed by one unit quaternion per joint. Times must increase.
+// Lines starting with # are comments.
+//
+// The clip loops: a time outside [ startTime(), endTime() ] is wrapped
+// into it, so the last key should repeat the first. Squad tangents then
+// wrap around the seam, so playback stays smooth there.
+class AnimationClip
+{
+public:
+	// NULL if the file cannot be read or has a malformed line
+	static std::shared_ptr< const AnimationClip > load( const char* filename );
+
+	size_t numJoints() const { return m_numJoints; }
+	size_t numKeys() const { return m_times.size(); }
+	float startTime() const { return m_times.empty() ? 0.0f : m_times.front(); }
+	float endTime() const { return m_times.empty() ? 0.0f : m_times.back(); }
+
+	// The pose at time
+	void sample( float time, ClipInterpolation interpolation, Pose& pose ) const;
+
+	// sample() for numSamples ( clip, time ) pairs, chunked over pool
+	// (which may be NULL). Every sample writes only its own pose.
+	static void sampleBatch( const ClipSample* samples, size_t numSamples,
+		ClipInterpolation interpolation, ThreadPool* pool );
+
+private:
+	AnimationClip();
+
+	// Key k and joint j
+	const Quat4f& rotation( size_t k, size_t j ) const
+	{
+		return m_rotations[ k * m_numJoints + j ];
+	}
+
+	size_t m_numJoints;
+	std::vector< float > m_times;
+	std::vector< Vector3f > m_rootTranslations;
+	// m_numJoints per key, each key flipped into the hemisphere of the
+	// one before it so neighbours interpolate along the short arc
+	std::vector< Quat4f > m_rotations;
+	// squad tangents, laid out like m_rotations
+	std::vector< Quat4f > m_tangents;
+};
+
+#endif
@@ -0,0 +1,154 @@
+#include "FrameCapture.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include "bitmap.h"
+
+using namespace std;
+
+namespace
+{
+	double seconds()
+	{
+		return chrono::duration< double >( chrono::steady_clock::now().time_since_epoch() ).count();
+	}
+}
+
+FrameCapture::FrameCapture( const string& prefix, CaptureFormat format, size_t numBuffers ) :
+	m_prefix( prefix ),
+	m_format( format ),
+	m_width( 0 ),
+	m_height( 0 ),
+	m_buffers( numBuffers > 0 ? numBuffers : 1 ),
+	m_current( 0 ),
+	m_quit( false )
+{
+	memset( &m_stats, 0, sizeof( m_stats ) );
+}
+
+FrameCapture::~FrameCapture()
+{
+	stop();
+}
+
+void FrameCapture::start( int width, int height )
+{
+	stop();
+	m_width = width;
+	m_height = height;
+	m_free.clear();
+	for( size_t b = 0; b != m_buffers.size(); ++b )
+	{
+		m_buffers[ b ].assign( 3 * size_t( width ) * height, 0 );
+		m_free.push_back( b );
+	}
+	m_queue.clear();
+	m_quit = false;
+	memset( &m_stats, 0, sizeof( m_stats ) );
+	m_writer = thread( &FrameCapture::writerLoop, this );
+}
+
+void FrameCapture::stop()
+{
+	if( !m_writer.joinable() )
+	{
+		return;
+	}
+	{
+		lock_guard< mutex > lock( m_mutex );
+		m_quit = true;
+	}
+	m_frameQueued.notify_one();
+	m_writer.join();
+}
+
+unsigned char* FrameCapture::beginFrame()
+{
+	unique_lock< mutex > lock( m_mutex );
+	if( m_free.empty() )
+	{
+		const double t0 = seconds();
+		m_bufferFree.wait( lock, [ this ] { return !m_free.empty(); } );
+		++m_stats.stalls;
+		m_stats.stallSeconds += seconds() - t0;
+	}
+	m_current = m_free.back();
+	m_free.pop_back();
+	return m_buffers[ m_current ].data();
+}
+
+void FrameCapture::endFrame()
+{
+	{
+		lock_guard< mutex > lock( m_mutex );
+		m_queue.push_back( make_pair( m_current, m_stats.framesCaptured++ ) );
+		m_stats.maxQueued = max( m_stats.maxQueued, m_queue.size() );
+	}
+	m_frameQueued.notify_one();
+}
+
+CaptureStats FrameCapture::stats() const
+{
+	lock_guard< mutex > lock( m_mutex );
+	return m_stats;
+}
+
+void FrameCapture::writerLoop()
+{
+	// one file's worth of bytes, reused for every frame
+	vector< unsigned char > file;
+	const char* extension = m_format == CAPTURE_BMP ? "bmp" : "tga";
+	for( ;; )
+	{
+		pair< size_t, size_t > frame;
+		{
+			unique_lock< mutex > lock( m_mutex );
+			m_frameQueued.wait( lock, [ this ] { return m_quit || !m_queue.empty(); } );
+			// the queue is written out before quitting
+			if( m_queue.empty() )
+			{
+				return;
+			}
+			frame = m_queue.front();
+			m_queue.pop_front();
+		}
+
+		const double t0 = seconds();
+		const unsigned char* pixels = m_buffers[ frame.first ].data();
+		if( m_format == CAPTURE_BMP )
+		{
+			encodeBMP( m_width, m_height, pixels, file );
+		}
+		else
+		{
+			encodeTGA( m_width, m_height, pixels, file );
+		}
+		// the pixels are no longer needed once encoded
+		{
+			lock_guard< mutex > lock( m_mutex );
+			m_free.push_back( frame.first );
+		}
+		m_bufferFree.notify_one();
+
+		char filename[ 1024 ];
+		snprintf( filename, sizeof( filename ), "%s_%05zu.%s", m_prefix.c_str(), frame.second, extension );
+		FILE* fp = fopen( filename, "wb" );
+		bool ok = fp && fwrite( file.data(), file.size(), 1, fp ) == 1;
+		ok = fp && fclose( fp ) == 0 && ok;
+
+		lock_guard< mutex > lock( m_mutex );
+		m_stats.writeSeconds += seconds() - t0;
+		if( ok )
+		{
+			++m_stats.framesWritten;
+			m_stats.bytesWritten += file.size();
+		}
+		else
+		{
+			++m_stats.writeErrors;
+		}
+	}
+}
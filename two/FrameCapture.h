@@ -0,0 +1,103 @@
+#ifndef FRAMECAPTURE_H
+#define FRAMECAPTURE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum CaptureFormat
+{
+	CAPTURE_BMP,
+	// run-length encoded TGA, see encodeTGA()
+	CAPTURE_TGA_RLE
+};
+
+// What a recording cost, see FrameCapture::stats()
+struct CaptureStats
+{
+	size_t framesCaptured;
+	size_t framesWritten;
+	size_t writeErrors;
+	// times the render thread found every buffer queued and waited for
+	// the writer, and how long in total
+	size_t stalls;
+	double stallSeconds;
+	// most frames queued at once
+	size_t maxQueued;
+	// time the writer spent encoding and writing, and what it wrote
+	double writeSeconds;
+	size_t bytesWritten;
+};
+
+// Records frames without writing them on the render thread:
+//
+//   FrameCapture capture( "capture", CAPTURE_BMP );
+//   capture.start( width, height );
+//   every frame: glReadPixels( ..., capture.beginFrame() );
+//                capture.endFrame();
+//   capture.stop();
+//
+// writes capture_00000.bmp, capture_00001.bmp, ... The pixels go into one
+// of a fixed pool of buffers allocated by start(), and a writer thread
+// encodes and writes the queued buffers in order. When the writer falls
+// behind, beginFrame() waits for a buffer to come back, so no frame is
+// ever dropped; stats() tells how often that happened.
+class FrameCapture
+{
+public:
+	FrameCapture( const std::string& prefix, CaptureFormat format, size_t numBuffers = 16 );
+	// stop()s
+	~FrameCapture();
+
+	// Allocates the buffers for frames of width x height and starts the
+	// writer
+	void start( int width, int height );
+	// Waits until every frame is written and ends the writer
+	void stop();
+	bool recording() const { return m_writer.joinable(); }
+
+	// 3 * width * height bytes to fill with the (R,G,B) pixels of the
+	// next frame, bottom row first, as glReadPixels() reads them with
+	// GL_PACK_ALIGNMENT 1
+	unsigned char* beginFrame();
+	// Queues the frame of the last beginFrame()
+	void endFrame();
+
+	CaptureStats stats() const;
+	const std::string& prefix() const { return m_prefix; }
+	int width() const { return m_width; }
+	int height() const { return m_height; }
+
+private:
+	FrameCapture( const FrameCapture& );
+	FrameCapture& operator=( const FrameCapture& );
+
+	void writerLoop();
+
+	std::string m_prefix;
+	CaptureFormat m_format;
+	int m_width;
+	int m_height;
+
+	std::vector< std::vector< unsigned char > > m_buffers;
+	// the buffer between beginFrame() and endFrame()
+	size_t m_current;
+
+	mutable std::mutex m_mutex;
+	std::condition_variable m_bufferFree;
+	std::condition_variable m_frameQueued;
+	// guarded by m_mutex: buffers ready for beginFrame(), and buffers
+	// waiting for the writer with their frame numbers
+	std::vector< size_t > m_free;
+	std::deque< std::pair< size_t, size_t > > m_queue;
+	bool m_quit;
+	CaptureStats m_stats;
+
+	std::thread m_writer;
+};
+
+#endif
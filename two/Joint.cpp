@@ -1 +0,0 @@
-#include "Joint.h"
@@ -1,89 +1,252 @@
 #include "Mesh.h"
+#include <algorithm>
+#include <cstring>
+#include <AttachLoader.h>
+#include <MeshCache.h>
+#include <ObjLoader.h>
 
 using namespace std;
 
-namespace {
-    // These are convenience functions which allow us to call OpenGL 
-    // methods on Vec3d objects
-    inline void glVertex(const Vector3f &a) 
-    { glVertex3fv(a); }
-    inline void glNormal(const Vector3f &a) 
-    { glNormal3fv(a); }
+namespace
+{
+	// FILE.a2cache, next to the .obj and the .attach file, holds what
+	// Mesh derives from them (see MeshCache)
+	const char CACHE_TAG[] = "a2cache";
+
+	// Sections of the caches
+	enum
+	{
+		CACHE_POSITIONS,
+		CACHE_NORMALS,
+		CACHE_FACES,
+		CACHE_INFLUENCE_COUNT,
+		CACHE_INFLUENCE_JOINTS,
+		CACHE_INFLUENCE_WEIGHTS
+	};
+
+	// Vector3f may be padded, the caches hold 3 floats per vector
+	MeshCache::Section vectorSection( unsigned id, const vector< Vector3f >& in, vector< float >& flat )
+	{
+		flat.resize( 3 * in.size() );
+		for( size_t i = 0; i != in.size(); ++i )
+		{
+			flat[ 3 * i ] = in[ i ][ 0 ];
+			flat[ 3 * i + 1 ] = in[ i ][ 1 ];
+			flat[ 3 * i + 2 ] = in[ i ][ 2 ];
+		}
+		MeshCache::Section s = { id, sizeof( float ), flat.size(), flat.data() };
+		return s;
+	}
+
+	bool readVectors( const MeshCache& cache, unsigned id, vector< Vector3f >& out )
+	{
+		size_t count;
+		const float* p = cache.array< float >( id, count );
+		if( !p || count % 3 != 0 )
+		{
+			return false;
+		}
+		out.resize( count / 3 );
+		for( size_t i = 0; i != out.size(); ++i )
+		{
+			out[ i ] = Vector3f( p[ 3 * i ], p[ 3 * i + 1 ], p[ 3 * i + 2 ] );
+		}
+		return true;
+	}
+
+	bool loadMeshCache( const char* filename, Mesh& mesh )
+	{
+		MeshCache cache;
+		size_t numFaceIndices;
+		const unsigned* faces;
+		if( !cache.open( filename, CACHE_TAG, 0 ) ||
+			!readVectors( cache, CACHE_POSITIONS, mesh.bindVertices ) ||
+			!readVectors( cache, CACHE_NORMALS, mesh.bindNormals ) ||
+			!( faces = cache.array< unsigned >( CACHE_FACES, numFaceIndices ) ) ||
+			mesh.bindNormals.size() != mesh.bindVertices.size() || numFaceIndices % 3 != 0 )
+		{
+			return false;
+		}
+		// the faces are 1-based, as in the file, and are drawn without
+		// bounds checks
+		for( size_t i = 0; i != numFaceIndices; ++i )
+		{
+			if( faces[ i ] == 0 || faces[ i ] > mesh.bindVertices.size() )
+			{
+				return false;
+			}
+		}
+		mesh.faces.resize( numFaceIndices / 3 );
+		for( size_t ind = 0; ind != mesh.faces.size(); ++ind )
+		{
+			for( int k = 0; k != 3; ++k )
+			{
+				mesh.faces[ ind ][ k ] = faces[ 3 * ind + k ];
+			}
+		}
+		return true;
+	}
+
+	void writeMeshCache( const char* filename, const Mesh& mesh )
+	{
+		vector< float > positions, normals;
+		vector< unsigned > faces( 3 * mesh.faces.size() );
+		for( size_t ind = 0; ind != mesh.faces.size(); ++ind )
+		{
+			for( int k = 0; k != 3; ++k )
+			{
+				faces[ 3 * ind + k ] = mesh.faces[ ind ][ k ];
+			}
+		}
+		vector< MeshCache::Section > sections;
+		sections.push_back( vectorSection( CACHE_POSITIONS, mesh.bindVertices, positions ) );
+		sections.push_back( vectorSection( CACHE_NORMALS, mesh.bindNormals, normals ) );
+		MeshCache::Section faceSection = { CACHE_FACES, sizeof( unsigned ), faces.size(), faces.data() };
+		sections.push_back( faceSection );
+		MeshCache::write( filename, CACHE_TAG, 0, sections );
+	}
+
+	// The influences depend on the number of joints, which keys the cache,
+	// and must give influenceCount slots to every vertex of the mesh
+	bool loadAttachmentCache( const char* filename, int numJoints, Mesh& mesh )
+	{
+		MeshCache cache;
+		size_t numCounts, numInfluences, numWeights;
+		const int* count;
+		const int* joints;
+		const float* weights;
+		if( !cache.open( filename, CACHE_TAG, (unsigned long long)numJoints ) ||
+			!( count = cache.array< int >( CACHE_INFLUENCE_COUNT, numCounts ) ) ||
+			!( joints = cache.array< int >( CACHE_INFLUENCE_JOINTS, numInfluences ) ) ||
+			!( weights = cache.array< float >( CACHE_INFLUENCE_WEIGHTS, numWeights ) ) ||
+			numCounts != 1 || numInfluences != numWeights || count[ 0 ] <= 0 ||
+			numInfluences % count[ 0 ] != 0 ||
+			numInfluences / count[ 0 ] != mesh.bindVertices.size() )
+		{
+			return false;
+		}
+		// the palette is indexed by joint without bounds checks
+		for( size_t i = 0; i != numInfluences; ++i )
+		{
+			if( joints[ i ] < 0 || joints[ i ] >= numJoints )
+			{
+				return false;
+			}
+		}
+		mesh.influenceCount = count[ 0 ];
+		mesh.influenceJoints.assign( joints, joints + numInfluences );
+		mesh.influenceWeights.assign( weights, weights + numWeights );
+		return true;
+	}
+
+	void writeAttachmentCache( const char* filename, int numJoints, const Mesh& mesh )
+	{
+		MeshCache::Section count = { CACHE_INFLUENCE_COUNT, sizeof( int ), 1, &mesh.influenceCount },
+			joints = { CACHE_INFLUENCE_JOINTS, sizeof( int ), mesh.influenceJoints.size(), mesh.influenceJoints.data() },
+			weights = { CACHE_INFLUENCE_WEIGHTS, sizeof( float ), mesh.influenceWeights.size(), mesh.influenceWeights.data() };
+		vector< MeshCache::Section > sections;
+		sections.push_back( count );
+		sections.push_back( joints );
+		sections.push_back( weights );
+		MeshCache::write( filename, CACHE_TAG, (unsigned long long)numJoints, sections );
+	}
 }
 
 void Mesh::load( const char* filename )
 {
-	// 2.1.1. load() should populate bindVertices, currentVertices, and faces
+	// 2.1.1. load() should populate bindVertices and faces
 
 	// Add your code here.
-    std::ifstream istrm(filename, std::ios::in);
-    if (!istrm.is_open()) {
-        std::cerr << "Failed to open " << filename << std::endl;
+    // A current FILE.a2cache has everything up to the index buffer.
+    if (loadMeshCache(filename, *this)) {
+        setIndices();
         return;
     }
-    string buf;
-    while(getline(istrm, buf)) {
-        stringstream ss(buf);
-        string s;
-        ss >> s;
-        if (s == "v") {
-            Vector3f v;
-            ss >> v[0] >> v[1] >> v[2];
-            bindVertices.push_back(v);
-        } else if (s == "f") {
-            Tuple3u t;
-            ss >> t[0] >> t[1] >> t[2];
-            faces.push_back(t);
-        }
+
+    // ObjLoader maps the file and parses it in place, much faster than
+    // a stringstream per line.
+    ObjLoader obj;
+    if (!obj.load(filename))
+        return;
+    bindVertices.resize(obj.numPositions());
+    for (size_t i = 0; i < bindVertices.size(); ++i) {
+        const float *p = &obj.positions[3 * i];
+        bindVertices[i] = Vector3f(p[0], p[1], p[2]);
     }
+    // faces keep the 1-based indices of the file
+    faces.resize(obj.numTriangles());
+    for (size_t ind = 0; ind < faces.size(); ++ind)
+        for (int k = 0; k < 3; ++k)
+            faces[ind][k] = obj.corners[3 * ind + k].position + 1;
 
+    // The cross product of two edges is twice the face area long, so
+    // summing it unnormalized weights each face by its area. Vertices
+    // that are in no face keep a zero normal.
+    bindNormals.assign(bindVertices.size(), Vector3f(0, 0, 0));
+    for (size_t ind = 0; ind < faces.size(); ++ind) {
+        unsigned i1 = faces[ind][0]-1, i2 = faces[ind][1]-1, i3 = faces[ind][2]-1;
+        Vector3f n = Vector3f::cross(bindVertices[i2] - bindVertices[i1],
+                                     bindVertices[i3] - bindVertices[i1]);
+        bindNormals[i1] += n;
+        bindNormals[i2] += n;
+        bindNormals[i3] += n;
+    }
+    for (size_t i = 0; i < bindNormals.size(); ++i)
+        if (bindNormals[i].absSquared() > 0)
+            bindNormals[i].normalize();
+
+    writeMeshCache(filename, *this);
+    setIndices();
+}
+
+void Mesh::setIndices()
+{
+    vector<GLuint> faceIndices;
+    faceIndices.reserve(3 * faces.size());
+    for (size_t ind = 0; ind < faces.size(); ++ind)
+        for (int k = 0; k < 3; ++k)
+            faceIndices.push_back(faces[ind][k]-1);
+    indices.set(faceIndices);
+}
+
+void SkinnedMesh::reset( const Mesh& mesh )
+{
 	// make a copy of the bind vertices as the current vertices
-	currentVertices = bindVertices;
+	currentVertices = mesh.bindVertices;
+	currentNormals = mesh.bindNormals;
+	buffer.invalidate();
 }
 
-void Mesh::draw()
+void SkinnedMesh::draw( const Mesh& mesh )
 {
-	// Since these meshes don't have normals
-	// be sure to generate a normal per triangle.
-	// Notice that since we have per-triangle normals
-	// rather than the analytical normals from
-	// assignment 1, the appearance is "faceted".
-    glBegin(GL_TRIANGLES);
-    for (size_t ind = 0; ind < faces.size(); ++ind) {
-        Vector3f v1 = currentVertices[faces[ind][0]-1],
-                 v2 = currentVertices[faces[ind][1]-1],
-                 v3 = currentVertices[faces[ind][2]-1];
-        Vector3f v12 = v2 - v1, v13 = v3 - v1, 
-                 v21 = -v12, v23 = v3 - v2,
-                 v31 = -v13, v32 = -v23,
-                 vn1 = Vector3f::cross(v12, v13).normalized(),
-                 vn2 = Vector3f::cross(v23, v21).normalized(),
-                 vn3 = Vector3f::cross(v31, v32).normalized();
-        ::glNormal(vn1);
-        ::glVertex(v1);
-        ::glNormal(vn2);
-        ::glVertex(v2);
-        ::glNormal(vn3);
-        ::glVertex(v3);
-    }
-    glEnd();
+	// The normals are skinned along with the positions, so drawing
+	// only looks them up. They are smooth, so the mesh is no longer
+	// "faceted".
+    // The whole mesh is one glDrawElements call, see TriangleBuffer.
+    buffer.draw(mesh.indices, currentVertices, currentNormals);
 }
 
 void Mesh::loadAttachments( const char* filename, int numJoints )
 {
 	// 2.2. Implement this method to load the per-vertex attachment weights
-	// this method should update m_mesh.attachments
-    std::ifstream istrm(filename, std::ios::in);
-    if (!istrm.is_open()) {
-        std::cerr << "Failed to open " << filename << std::endl;
-        return;
-    }
-    string buf;
-    while(getline(istrm, buf)) {
-        stringstream ss(buf);
-        vector<float> at(numJoints, 0);
-        for (int i = 0; i != numJoints-1; ++i)
-            ss >> at[i+1];
-        attachments.push_back(at);
+	// this method should update the influence arrays
+    // AttachLoader parses the text in place, in parallel chunks, and
+    // reads the quantized .attachb files as well. Those need no cache.
+    AttachLoader attach;
+    const size_t length = strlen(filename);
+    const bool binary = length >= 8 && strcmp(filename + length - 8, ".attachb") == 0;
+    if (binary) {
+        if (!attach.loadBinary(filename, numJoints))
+            return;
+    } else {
+        if (loadAttachmentCache(filename, numJoints, *this))
+            return;
+        if (!attach.load(filename, numJoints, MAX_INFLUENCES))
+            return;
     }
+    influenceCount = attach.influenceCount;
+    influenceJoints.swap(attach.joints);
+    influenceWeights.swap(attach.weights);
+    if (!binary)
+        writeAttachmentCache(filename, numJoints, *this);
 }
@@ -13,9 +13,17 @@
 #include <GL/glut.h>
 #endif
 #include "tuple.h"
+#include "TriangleBuffer.h"
 
 typedef tuple< unsigned, 3 > Tuple3u;
 
+// At most this many joints influence one vertex. Rows of an .attach file
+// with more non-zero weights keep the largest ones, rescaled to the same
+// total.
+const int MAX_INFLUENCES = 16;
+
+// A mesh as loaded, with its skin weights. A Rig shares one Mesh among
+// all of its instances, each of which skins it into a SkinnedMesh.
 struct Mesh
 {
 	// list of vertices from the OBJ file
@@ -26,23 +34,55 @@ struct Mesh
 	// referencing 3 vertices
 	std::vector< Tuple3u > faces;
 
-	// current vertex positions after animation
-	std::vector< Vector3f > currentVertices;
+	// smooth per-vertex normals: area-weighted averages of the adjacent
+	// face normals in the bind pose, computed once by load()
+	std::vector< Vector3f > bindNormals;
+
+	// faces as 0-based indices for drawing
+	IndexBuffer indices;
 
-	// list of vertex to joint attachments
-	// each element of attachments is a vector< float > containing
-	// one attachment weight per joint
-	std::vector< std::vector< float > > attachments;
+	// list of vertex to joint attachments, packed with influenceCount
+	// slots per vertex: vertex i is attached to joint influenceJoints[ s ]
+	// with weight influenceWeights[ s ] for s in
+	// [ i * influenceCount, ( i + 1 ) * influenceCount ). Slots are
+	// sorted by decreasing weight, unused ones have weight 0.
+	int influenceCount = 0;
+	std::vector< int > influenceJoints;
+	std::vector< float > influenceWeights;
 
-	// 2.1.1. load() should populate bindVertices, currentVertices, and faces
+	// 2.1.1. load() should populate bindVertices, faces (and the normals)
+	// load() and loadAttachments() keep what they read in a binary
+	// FILE.a2cache next to the file and read that instead while it is
+	// current.
 	void load(const char *filename);
 
-	// 2.1.2. draw the current mesh.
-	void draw();
+	// indices from faces
+	void setIndices();
 
 	// 2.2. Implement this method to load the per-vertex attachment weights
-	// this method should update m_mesh.attachments
+	// this method should update the influence arrays
+	// filename is an .attach text file, or an .attachb file with the
+	// weights quantized (see AttachLoader.h and a2attachb).
 	void loadAttachments( const char* filename, int numJoints );
 };
 
+// The posed copy of a Mesh that one SkeletalModel skins and draws
+struct SkinnedMesh
+{
+	// current vertex positions after animation
+	std::vector< Vector3f > currentVertices;
+	// the bind normals carried along by skinning
+	std::vector< Vector3f > currentNormals;
+
+	// currentVertices / currentNormals once uploaded. Call
+	// buffer.invalidate() after changing them.
+	TriangleBuffer buffer;
+
+	// Starts out in the bind pose of mesh
+	void reset( const Mesh& mesh );
+
+	// 2.1.2. draw the current mesh.
+	void draw( const Mesh& mesh );
+};
+
 #endif
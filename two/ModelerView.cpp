@@ -1,17 +1,23 @@
 #include "ModelerView.h"
 #include "camera.h"
 #include "modelerapp.h"
+#include "Trace.h"
 
 #include <FL/Fl.H>
 #include <FL/Fl_Gl_Window.H>
 #include <FL/gl.h>
 #include <GL/glu.h>
 #include <cstdio>
+#include <map>
 
 // Accessing the values of sliders is a very lengthy function call.
 // We use a macro VAL() to shorten it.
 #define VAL(x) ( static_cast< float >( ModelerApplication::Instance()->GetControlValue( x ) ) )
 
+// Clips advance by exactly this many seconds per tick, so playback
+// does not depend on how often the sliders or the window redraw
+static const double PLAYBACK_STEP = 1.0 / 60.0;
+
 ModelerView::ModelerView(int x, int y, int w, int h,
 			 const char *label):Fl_Gl_Window(x, y, w, h, label)
 {
@@ -21,8 +27,14 @@ ModelerView::ModelerView(int x, int y, int w, int h,
     m_camera->SetDistance( 2 );
     m_camera->SetCenter( Vector3f( 0.5, 0.5, 0.5 ) );
 
+    m_pool = new ThreadPool();
+
 	m_drawAxes = true;
 	m_drawSkeleton = true;
+	m_playing = false;
+	m_playbackTime = 0.0f;
+	m_capture = NULL;
+	m_numRecordings = 0;
 }
 
 // If you want to load files, etc, do that here.
@@ -30,23 +42,37 @@ void ModelerView::loadModel(int argc, char* argv[])
 {
 	glutInit( &argc, argv );
 
-	// Load the model based on the command-line arguments
+	// Load the model based on the command-line arguments.
+    // A prefix given more than once loads once, its models share the rig.
+    // PREFIX.anim, if there is one, is the clip played by the 'p' key.
+    map< string, shared_ptr< const Rig > > rigs;
+    map< string, shared_ptr< const AnimationClip > > clips;
     for (int i = 1; i != argc; ++i) {
         string prefix = argv[ i ];
         string skeletonFile = prefix + ".skel";
         string meshFile = prefix + ".obj";
-        string attachmentsFile = prefix + ".attach";
+        string attachmentsFile = Rig::attachmentsFile(prefix);
 
-        SkeletalModel *mod = new SkeletalModel();
-        mod->load(skeletonFile.c_str(), meshFile.c_str(), attachmentsFile.c_str());
-        models.push_back(mod);
+        shared_ptr< const Rig > &rig = rigs[ prefix ];
+        if (!rig)
+            rig = Rig::load(skeletonFile.c_str(), meshFile.c_str(), attachmentsFile.c_str());
+        models.push_back(new SkeletalModel(rig, m_pool));
+
+        if (!clips.count(prefix))
+            clips[ prefix ] = AnimationClip::load((prefix + ".anim").c_str());
+        m_clips.push_back(clips[ prefix ]);
     }
+    m_poses.resize(models.size());
 }
 
 ModelerView::~ModelerView()
 {
+    if (m_playing)
+        Fl::remove_timeout(playbackTick, this);
+    delete m_capture;
     for (size_t i = 0; i != models.size(); ++i)
         delete models[i];
+    delete m_pool;
     delete m_camera;
 }
 
@@ -104,6 +130,34 @@ int ModelerView::handle( int event )
 				m_drawSkeleton = !m_drawSkeleton;
 				cout << "drawSkeleton is now: " << m_drawSkeleton << endl;
 			}
+			else if( key == 'd' )
+			{
+				for( size_t i = 0; i != models.size(); ++i )
+				{
+					SkeletalModel *mod = models[ i ];
+					mod->setSkinningMode( mod->skinningMode() == LINEAR_BLEND_SKINNING ?
+						DUAL_QUATERNION_SKINNING : LINEAR_BLEND_SKINNING );
+					mod->updateMesh();
+				}
+				cout << "dualQuaternionSkinning is now: " << ( !models.empty() &&
+					models[ 0 ]->skinningMode() == DUAL_QUATERNION_SKINNING ) << endl;
+			}
+			else if( key == 'p' )
+			{
+				togglePlayback();
+				cout << "playing is now: " << m_playing << endl;
+			}
+			else if( key == 'r' )
+			{
+				// shift+r records run-length encoded TGA files
+				toggleRecording( ( eventState & FL_SHIFT ) ? CAPTURE_TGA_RLE : CAPTURE_BMP );
+			}
+#ifdef TRACE
+			else if( key == 't' )
+			{
+				Trace::write( "a2_trace.json" );
+			}
+#endif
     	}
 		break;
 
@@ -118,15 +172,115 @@ int ModelerView::handle( int event )
 
 void ModelerView::update()
 {
-	// update the skeleton from sliders
-	updateJoints();
+	TRACE_SCOPE( "ModelerView::update" );
+	// update the skeleton from sliders, unless the clips drive it
+	if( !m_playing )
+	{
+		updateJoints();
+	}
+
+    // Update the bone to world transforms for SSD.
+    for (auto it = models.begin(); it != models.end(); ++it)
+        (*it)->updateCurrentJointToWorldTransforms();
+    // update the meshes given the new skeletons, all in one batch
+    SkeletalModel::updateMeshes(models.data(), models.size(), m_pool);
+}
+
+void ModelerView::togglePlayback()
+{
+    m_playing = !m_playing;
+    if (m_playing) {
+        Fl::add_timeout(PLAYBACK_STEP, playbackTick, this);
+        stepPlayback();
+    } else {
+        Fl::remove_timeout(playbackTick, this);
+        // back to the slider pose
+        update();
+    }
+}
+
+void ModelerView::toggleRecording(CaptureFormat format)
+{
+    if (m_capture) {
+        m_capture->stop();
+        CaptureStats s = m_capture->stats();
+        printf("recorded %zu frames to %s_*, %zu written, %zu failed\n"
+               "  render thread waited for the writer %zu times, %.1f ms in all;"
+               " at most %zu frames queued\n"
+               "  writer: %.2f ms per frame, %.1f MB\n",
+               s.framesCaptured, m_capture->prefix().c_str(), s.framesWritten,
+               s.writeErrors, s.stalls, s.stallSeconds * 1000, s.maxQueued,
+               s.framesWritten ? s.writeSeconds * 1000 / s.framesWritten : 0.0,
+               s.bytesWritten / 1e6);
+        delete m_capture;
+        m_capture = NULL;
+        return;
+    }
+    char prefix[ 32 ];
+    snprintf(prefix, sizeof(prefix), "capture%02u", m_numRecordings++);
+    m_capture = new FrameCapture(prefix, format);
+    m_capture->start(w(), h());
+    cout << "recording to " << prefix << "_*" << endl;
+    if (!m_playing)
+        togglePlayback();
+}
+
+void ModelerView::playbackTick(void *view)
+{
+    ModelerView *self = static_cast< ModelerView* >(view);
+    Fl::repeat_timeout(PLAYBACK_STEP, playbackTick, view);
+    self->m_playbackTime += float(PLAYBACK_STEP);
+    self->stepPlayback();
+}
+
+void ModelerView::stepPlayback()
+{
+    TRACE_SCOPE( "ModelerView::stepPlayback" );
+    // sample the poses of all models in one batch, then pose and skin
+    // them all like update() does
+    vector< ClipSample > samples;
+    vector< size_t > posed;
+    for (size_t i = 0; i != models.size(); ++i) {
+        if (!m_clips[ i ])
+            continue;
+        ClipSample sample = { m_clips[ i ].get(), m_playbackTime, &m_poses[ i ] };
+        samples.push_back(sample);
+        posed.push_back(i);
+    }
+    AnimationClip::sampleBatch(samples.data(), samples.size(), CLIP_SQUAD, m_pool);
+    for (size_t k = 0; k != posed.size(); ++k)
+        models[ posed[ k ] ]->setPose(m_poses[ posed[ k ] ]);
 
-    for (auto it = models.begin(); it != models.end(); ++it) {
-        // Update the bone to world transforms for SSD.
+    for (auto it = models.begin(); it != models.end(); ++it)
         (*it)->updateCurrentJointToWorldTransforms();
-        // update the mesh given the new skeleton
-        (*it)->updateMesh();
+    SkeletalModel::updateMeshes(models.data(), models.size(), m_pool);
+
+    // A recording needs every step drawn, which redraw() alone does not
+    // promise: FLTK draws once for any number of ticks that came before.
+    if (m_capture)
+        captureFrame();
+    else
+        redraw();
+}
+
+void ModelerView::captureFrame()
+{
+    // the buffers are as large as the window was when recording started
+    if (w() != m_capture->width() || h() != m_capture->height()) {
+        cout << "the window was resized, recording stops" << endl;
+        toggleRecording(CAPTURE_BMP);
+        redraw();
+        return;
     }
+    make_current();
+    draw();
+
+    glReadBuffer(GL_BACK);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+    glReadPixels(0, 0, w(), h(), GL_RGB, GL_UNSIGNED_BYTE, m_capture->beginFrame());
+    m_capture->endFrame();
+    swap_buffers();
 }
 
 void ModelerView::updateJoints()
@@ -160,6 +314,7 @@ void ModelerView::updateJoints()
 // default lighting parameters.
 void ModelerView::draw()
 {
+    TRACE_SCOPE( "ModelerView::draw" );
     // Window is !valid() upon resize
     // FLTK convention has you initializing rendering here.
     if( !valid() )
@@ -17,6 +17,7 @@
 class Camera;
 class ModelerView;
 
+#include "FrameCapture.h"
 #include "SkeletalModel.h"
 
 using namespace std;
@@ -38,12 +39,39 @@ public:
 	void updateJoints();
 	void drawAxes();
 
+	// Starts or stops playing the clips of the models
+	void togglePlayback();
+	// Starts recording every playback step to captureNN_00000.bmp, ...
+	// (or .tga), playing the clips if they are not, or stops it
+	void toggleRecording(CaptureFormat format);
+
     Camera *m_camera;
+    // shared by the models for skinning
+    ThreadPool *m_pool;
     vector<SkeletalModel*> models;
+    // clip of every model (NULL if its prefix has no .anim file), and
+    // the poses sampled from them
+    vector< shared_ptr< const AnimationClip > > m_clips;
+    vector< Pose > m_poses;
 	/* SkeletalModel model; */
 
 	bool m_drawAxes;
 	bool m_drawSkeleton;		// if false, the mesh is drawn instead.
+
+	// While playing, the clips drive the models instead of the sliders
+	bool m_playing;
+	float m_playbackTime;
+
+	// NULL unless recording
+	FrameCapture *m_capture;
+	unsigned m_numRecordings;
+
+private:
+	// Advances the clips by one PLAYBACK_STEP, rearmed every step
+	static void playbackTick(void *view);
+	void stepPlayback();
+	// Draws the current frame and hands its pixels to m_capture
+	void captureFrame();
 };
 
 
@@ -0,0 +1,89 @@
+#include "Rig.h"
+
+using namespace std;
+
+Rig::Rig():
+    jointShape(TriangleList::sphere(0.025f, 12, 12)),
+    boneShape(TriangleList::cube(1.0f))
+{
+}
+
+shared_ptr< const Rig > Rig::load(const char *skeletonFile, const char *meshFile,
+                                  const char *attachmentsFile)
+{
+    shared_ptr< Rig > rig = make_shared< Rig >();
+    rig->loadSkeleton(skeletonFile);
+    rig->computeBindWorldToJointTransforms();
+
+    rig->mesh.load(meshFile);
+    rig->mesh.loadAttachments(attachmentsFile, rig->numJoints());
+    rig->skinner.setup(rig->mesh);
+
+    // one sphere per joint and one box per joint but the root
+    const size_t numJoints = rig->numJoints();
+    std::vector< GLuint > indices;
+    rig->jointShape.instanceIndices(numJoints, indices);
+    rig->jointIndices.set(indices);
+    rig->boneShape.instanceIndices(numJoints > 0 ? numJoints - 1 : 0, indices);
+    rig->boneIndices.set(indices);
+    return rig;
+}
+
+string Rig::attachmentsFile(const string &prefix)
+{
+    string binary = prefix + ".attachb";
+    std::ifstream istrm(binary.c_str(), std::ios::in | std::ios::binary);
+    return istrm.is_open() ? binary : prefix + ".attach";
+}
+
+void Rig::loadSkeleton( const char* filename )
+{
+	// Load the skeleton from file here.
+    std::ifstream istrm(filename, std::ios::in);
+    if (!istrm.is_open()) {
+        std::cerr << "Failed to open " << filename << std::endl;
+        return;
+    }
+    string buf;
+    while(getline(istrm, buf)) {
+        stringstream ss(buf);
+        float f1, f2, f3;
+        int index;
+        if (!(ss >> f1 >> f2 >> f3 >> index))
+            continue;
+        Matrix4f transform = Matrix4f::translation(f1, f2, f3);
+        // The joint arrays rely on parents coming first
+        if (index < -1 || index >= int(parents.size()) ||
+                (index == -1) != parents.empty()) {
+            std::cerr << filename << ": joint " << parents.size()
+                << " has bad parent " << index << std::endl;
+            return;
+        }
+        parents.push_back(index);
+        bindTransforms.push_back(transform);
+    }
+}
+
+void Rig::computeBindWorldToJointTransforms()
+{
+	// 2.3.1. Implement this method to compute a per-joint transform from
+	// world-space to joint space in the BIND POSE.
+	//
+	// Note that this needs to be computed only once since there is only
+	// a single bind pose.
+	//
+	// This method should update bindWorldToJointTransforms.
+	//
+	// Parents come first, so B_parent is ready when joint j needs it.
+    const size_t numJoints = this->numJoints();
+    std::vector< Matrix4f > bindJointToWorld(numJoints);
+    bindWorldToJointTransforms.resize(numJoints);
+    for (size_t j = 0; j != numJoints; ++j) {
+        const int parent = parents[j];
+        bindJointToWorld[j] = parent < 0 ? bindTransforms[j] :
+            bindJointToWorld[parent] * bindTransforms[j];
+        // bindWorldToJointTransform = B^-1; the joint transforms are
+        // translations, so B is rigid
+        bindWorldToJointTransforms[j] = bindJointToWorld[j].inverseRigid();
+    }
+}
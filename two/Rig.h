@@ -0,0 +1,60 @@
+#ifndef RIG_H
+#define RIG_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <vecmath.h>
+
+#include "Mesh.h"
+#include "Skinning.h"
+#include "TriangleBuffer.h"
+
+// Everything about a character that does not depend on its pose: the
+// skeleton, the bind mesh with its skin weights, and what is derived
+// from them once. A loaded Rig is never changed again and is shared by
+// every SkeletalModel that animates it, so a crowd of N characters
+// parses the files once and holds one copy of the mesh.
+struct Rig
+{
+	// The skeleton as flat arrays with one entry per joint, in the order
+	// of the .skel file, which puts every parent before its children.
+	// index of the parent of every joint, -1 for the root
+	std::vector< int > parents;
+	// transform relative to the parent in the bind pose
+	std::vector< Matrix4f > bindTransforms;
+	// world space --> joint space in the bind pose
+	std::vector< Matrix4f > bindWorldToJointTransforms;
+
+	Mesh mesh;
+	// bind pose and influences of mesh in SIMD blocks
+	Skinner skinner;
+
+	// Joint and bone geometry, and the indices of one copy of it per
+	// joint and per bone (see SkeletalModel::drawJoints())
+	TriangleList jointShape;
+	TriangleList boneShape;
+	IndexBuffer jointIndices;
+	IndexBuffer boneIndices;
+
+	Rig();
+
+	// Reads the three files into a new Rig
+	static std::shared_ptr< const Rig > load( const char* skeletonFile,
+		const char* meshFile, const char* attachmentsFile );
+
+	// PREFIX.attachb if there is one, else PREFIX.attach
+	static std::string attachmentsFile( const std::string& prefix );
+
+	size_t numJoints() const { return parents.size(); }
+
+	// 1.1. Implement method to load a skeleton.
+	// This method should populate the joint arrays (parents etc.).
+	void loadSkeleton( const char* filename );
+
+	// 2.3.1. Implement this method to compute a per-joint transform from
+	// world-space to joint space in the BIND POSE.
+	void computeBindWorldToJointTransforms();
+};
+
+#endif
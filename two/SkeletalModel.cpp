@@ -1,27 +1,56 @@
 #include "SkeletalModel.h"
-#include <functional>
+#include <algorithm>
 #ifdef DEBUG
 #include <cassert>
 #endif
 #include <vecmath.h>
 
-#include <FL/Fl.H>
+#include "Trace.h"
 
 using namespace std;
 
+SkeletalModel::SkeletalModel(ThreadPool *pool):
+    m_rig(std::make_shared< Rig >()), m_skinAll(true),
+    m_skinningMode(LINEAR_BLEND_SKINNING), m_pool(pool),
+    m_jointsStale(true), m_bonesStale(true)
+{
+}
+
+SkeletalModel::SkeletalModel(std::shared_ptr< const Rig > rig, ThreadPool *pool):
+    m_skinAll(true),
+    m_skinningMode(LINEAR_BLEND_SKINNING), m_pool(pool),
+    m_jointsStale(true), m_bonesStale(true)
+{
+    setRig(rig);
+}
+
 void SkeletalModel::load(const char *skeletonFile, const char *meshFile, const char *attachmentsFile)
 {
-	loadSkeleton(skeletonFile);
+	setRig(Rig::load(skeletonFile, meshFile, attachmentsFile));
+}
 
-	m_mesh.load(meshFile);
-	m_mesh.loadAttachments(attachmentsFile, m_joints.size());
+void SkeletalModel::setRig(std::shared_ptr< const Rig > rig)
+{
+    m_rig = rig;
+    const size_t numJoints = rig->numJoints();
+    m_jointTransforms = rig->bindTransforms;
+    m_currentJointToWorldTransforms = rig->bindTransforms;
+    m_jointDirty.assign(numJoints, 1);
+    m_jointAngles.assign(numJoints, Vector3f());
+    m_jointRotations.assign(numJoints, Quat4f::IDENTITY);
+    m_jointUsesRotation.assign(numJoints, 0);
+    m_rootTranslation = Vector3f();
+    m_jointMoved.assign(numJoints, 0);
+    m_skinned.reset(rig->mesh);
+    m_jointsStale = m_bonesStale = true;
 
-	computeBindWorldToJointTransforms();
+	m_skinAll = true;
 	updateCurrentJointToWorldTransforms();
 }
 
 void SkeletalModel::draw(Matrix4f cameraMatrix, bool skeletonVisible)
 {
+    TRACE_SCOPE( "SkeletalModel::draw" );
 	// draw() gets called whenever a redraw is required
 	// (after an update() occurs, when the camera moves, the window is resized, etc)
 
@@ -31,6 +60,8 @@ void SkeletalModel::draw(Matrix4f cameraMatrix, bool skeletonVisible)
 	if( skeletonVisible )
 	{
         m_matrixStack.push(cameraMatrix);
+        // joints and bones are placed in world space
+        glLoadMatrixf(m_matrixStack.top());
 		drawJoints();
 		drawSkeleton();
         m_matrixStack.pop();
@@ -44,189 +75,200 @@ void SkeletalModel::draw(Matrix4f cameraMatrix, bool skeletonVisible)
 		glLoadMatrixf(m_matrixStack.top());
 
 		// Tell the mesh to draw itself.
-		m_mesh.draw();
+		m_skinned.draw(m_rig->mesh);
 	}
 }
 
-void SkeletalModel::loadSkeleton( const char* filename )
-{
-	// Load the skeleton from file here.
-    std::ifstream istrm(filename, std::ios::in);
-    if (!istrm.is_open()) {
-        std::cerr << "Failed to open " << filename << std::endl;
-        return;
-    }
-    string buf;
-    while(getline(istrm, buf)) {
-        stringstream ss(buf);
-        float f1, f2, f3;
-        int index;
-        ss >> f1 >> f2 >> f3 >> index;
-        Joint *joint = new Joint;
-        joint->transform = Matrix4f::translation(f1, f2, f3);
-        // Assuming joints occurs in accending order!
-        if (index == -1) {
-            m_rootJoint = joint;
-            ini_root_trans = joint->transform;
-        } else {
-#ifdef DEBUG
-            Joint *parent = m_joints.at(index);
-#else
-            Joint *parent = m_joints[index];
-#endif
-            parent->children.push_back(joint);
-        }
-        m_joints.push_back(joint);
-        ini_trans.push_back(joint->transform);
-    }
-}
-
 void SkeletalModel::drawJoints( )
 {
-	// Draw a sphere at each joint. You will need to add a recursive helper function 
-    // to traverse the joint hierarchy.
-	//
-	// We recommend using glutSolidSphere( 0.025f, 12, 12 )
-	// to draw a sphere of reasonable size.
+	// Draw a sphere at each joint.
 	//
-	// You are *not* permitted to use the OpenGL matrix stack commands
-	// (glPushMatrix, glPopMatrix, glMultMatrix).
-	// You should use your MatrixStack class
-	// and use glLoadMatrix() before your drawing call.
-    std::function<void(Joint*)> bfs = [&, this](Joint *jt) -> void {
-        m_matrixStack.push(jt->transform);
-        glLoadMatrixf(m_matrixStack.top());
-        glutSolidSphere(0.025f, 12, 12);
-        for (auto it = jt->children.begin(); it != jt->children.end(); ++it) 
-            bfs(*it);
-        m_matrixStack.pop();
-    };
-    // We have cameraMatrix here, hence we must not clear()
-    bfs(m_rootJoint);
+	// Every joint gets a copy of Rig::jointShape, the vertices of
+	// glutSolidSphere( 0.025f, 12, 12 ), moved to world space on the CPU.
+	// They are rebuilt only after the pose changed, and all of them go
+	// out in one draw call with the camera matrix that draw() loaded.
+    if (m_jointsStale) {
+        for (size_t j = 0; j != numJoints(); ++j)
+            m_rig->jointShape.placeInstance(m_currentJointToWorldTransforms[j], j,
+                                       m_jointPositions, m_jointNormals);
+        m_jointBuffer.invalidate();
+        m_jointsStale = false;
+    }
+    m_jointBuffer.draw(m_rig->jointIndices, m_jointPositions, m_jointNormals);
 }
 
 void SkeletalModel::drawSkeleton( )
 {
 	// Draw boxes between the joints. 
-    // You will need to add a recursive helper function to traverse the joint hierarchy.
-    std::function<void(Joint*)> bfs = [&, this](Joint *jt) -> void {
-        Vector3f offset = jt->transform.getCol(3).xyz(); // from parent to jt
-        float dis = offset.abs();
-        // There're two ways, one is by rotation, another one is by Matrix of Basis,
-        // we use the Change of Basis.
-        // 
-        // We're still at parent's transform frame,
-        // new Z-axis points from parent to children
-        auto new_frame = Matrix4f::identity();
-        Vector3f rnd(0, 0, 1.0f),
-                 z = offset.normalized(),
-                 y = Vector3f::cross(z, rnd).normalized(),
-                 x = Vector3f::cross(y, z).normalized();
-        new_frame.setSubmatrix3x3(0, 0, Matrix3f(x, y, z, true));
-        auto scale = Matrix4f::scaling(0.05f, 0.05f, dis),
-             trans = Matrix4f::translation(0, 0, 0.5f);
-        m_matrixStack.push(new_frame);
-        m_matrixStack.push(scale);
-        m_matrixStack.push(trans);
-        glLoadMatrixf(m_matrixStack.top());
-        glutSolidCube(1.0f);
-        m_matrixStack.pop();
-        m_matrixStack.pop();
-        m_matrixStack.pop();
-        //
-        // The `rotation` way, somewhat different result
-        //
-        // Vector3f origin(0, 0, 1.0f);
-        // auto dir = Vector3f::cross(origin, offset);
-        // float radians = acos(Vector3f::dot(origin.normalized(), offset.normalized()));
-        // m_matrixStack.push(Matrix4f::rotation(dir, radians));
-        // m_matrixStack.push(Matrix4f::scaling(0.05f, 0.05f, dis));
-        // m_matrixStack.push(Matrix4f::translation(0, 0, 0.5f));
-        // glLoadMatrixf(m_matrixStack.top());
-        // glutSolidCube(1.0f);
-        // m_matrixStack.pop();
-        // m_matrixStack.pop();
-        // m_matrixStack.pop();
-
-        m_matrixStack.push(jt->transform);
-        for (auto it = jt->children.begin(); it != jt->children.end(); ++it)
-            bfs(*it);
-        m_matrixStack.pop();
-    };
-    // We have cameraMatrix here, hence we must not clear()
-    m_matrixStack.push(m_rootJoint->transform);
-    for (auto it = m_rootJoint->children.begin();
-            it != m_rootJoint->children.end();
-            ++it) bfs(*it);
-    m_matrixStack.pop();
+    //
+    // Like drawJoints(), with one copy of the unit cube per bone.
+    if (m_bonesStale) {
+        size_t bone = 0;
+        for (size_t j = 0; j != numJoints(); ++j) {
+            const int parent = m_rig->parents[j];
+            if (parent < 0)
+                continue;
+            Vector3f offset = m_jointTransforms[j].getCol(3).xyz(); // from parent to j
+            float dis = offset.abs();
+            // There're two ways, one is by rotation, another one is by Matrix of Basis,
+            // we use the Change of Basis.
+            // 
+            // In parent's transform frame,
+            // new Z-axis points from parent to children
+            auto new_frame = Matrix4f::identity();
+            Vector3f rnd(0, 0, 1.0f),
+                     z = offset.normalized(),
+                     y = Vector3f::cross(z, rnd).normalized(),
+                     x = Vector3f::cross(y, z).normalized();
+            new_frame.setSubmatrix3x3(0, 0, Matrix3f(x, y, z, true));
+            auto scale = Matrix4f::scaling(0.05f, 0.05f, dis),
+                 trans = Matrix4f::translation(0, 0, 0.5f);
+            m_rig->boneShape.placeInstance(
+                m_currentJointToWorldTransforms[parent] * new_frame * scale * trans,
+                bone++, m_bonePositions, m_boneNormals);
+        }
+        m_boneBuffer.invalidate();
+        m_bonesStale = false;
+    }
+    m_boneBuffer.draw(m_rig->boneIndices, m_bonePositions, m_boneNormals);
 }
 
 void SkeletalModel::setJointTransform(int jointIndex, float rX, float rY, float rZ)
 {
 	// Set the rotation part of the joint's transformation matrix 
     // based on the passed in Euler angles.
-    auto Rx = Matrix4f::rotateX(rX),
-         Ry = Matrix4f::rotateY(rY),
-         Rz = Matrix4f::rotateZ(rZ);
-    m_joints[jointIndex]->transform = 
-        ini_trans[jointIndex] * Rx * Ry * Rz;
+    // ModelerView sets every joint on every update, only the ones that
+    // actually changed are marked dirty.
+    Vector3f angles(rX, rY, rZ);
+    if (!m_jointUsesRotation[jointIndex] && angles == m_jointAngles[jointIndex])
+        return;
+    m_jointAngles[jointIndex] = angles;
+    m_jointUsesRotation[jointIndex] = 0;
+    updateLocalTransform(jointIndex);
 }
 
-void SkeletalModel::setRootTranslation(float tX, float tY, float tZ)
+void SkeletalModel::setJointRotation(int jointIndex, const Quat4f &rotation)
 {
-	// Set the rotation part of the joint's transformation matrix 
-    // based on the passed in Euler angles.
-    auto T = Matrix4f::translation(tX, tY, tZ);
-    ini_trans[0] = ini_root_trans * T;
+    Quat4f &current = m_jointRotations[jointIndex];
+    if (m_jointUsesRotation[jointIndex] && rotation[0] == current[0] &&
+            rotation[1] == current[1] && rotation[2] == current[2] &&
+            rotation[3] == current[3])
+        return;
+    current = rotation;
+    m_jointUsesRotation[jointIndex] = 1;
+    updateLocalTransform(jointIndex);
 }
 
+void SkeletalModel::setPose(const Pose &pose)
+{
+    const size_t n = min(pose.rotations.size(), numJoints());
+    for (size_t j = 0; j != n; ++j)
+        setJointRotation(int(j), pose.rotations[j]);
+    const Vector3f &t = pose.rootTranslation;
+    setRootTranslation(t.x(), t.y(), t.z());
+}
 
-void SkeletalModel::computeBindWorldToJointTransforms()
+void SkeletalModel::updateLocalTransform(size_t j)
 {
-	// 2.3.1. Implement this method to compute a per-joint transform from
-	// world-space to joint space in the BIND POSE.
-	//
-	// Note that this needs to be computed only once since there is only
-	// a single bind pose.
-	//
-	// This method should update each joint's bindWorldToJointTransform.
-	// You will need to add a recursive helper function to traverse the joint hierarchy.
-    std::function<void(Joint*)> bfs = [&, this](Joint *jt) -> void {
-        m_matrixStack.push(jt->transform);
-        // bindWorldToJointTransform = B^-1
-        jt->bindWorldToJointTransform = m_matrixStack.top().inverse();
-        for (auto it = jt->children.begin(); it != jt->children.end(); ++it) 
-            bfs(*it);
-        m_matrixStack.pop();
-    };
-    m_matrixStack.clear();
-    bfs(m_rootJoint);
+    Matrix4f rest = m_rig->bindTransforms[j];
+    if (m_rig->parents[j] < 0)
+        rest = rest * Matrix4f::translation(m_rootTranslation);
+    if (m_jointUsesRotation[j]) {
+        m_jointTransforms[j] = rest * Matrix4f::rotation(m_jointRotations[j]);
+    } else {
+        const Vector3f &angles = m_jointAngles[j];
+        auto Rx = Matrix4f::rotateX(angles.x()),
+             Ry = Matrix4f::rotateY(angles.y()),
+             Rz = Matrix4f::rotateZ(angles.z());
+        m_jointTransforms[j] = rest * Rx * Ry * Rz;
+    }
+    m_jointDirty[j] = 1;
 }
 
+void SkeletalModel::setRootTranslation(float tX, float tY, float tZ)
+{
+	// Set the rotation part of the joint's transformation matrix 
+    // based on the passed in Euler angles.
+    Vector3f translation(tX, tY, tZ);
+    if (translation == m_rootTranslation)
+        return;
+    m_rootTranslation = translation;
+    updateLocalTransform(0);
+}
+
+
 void SkeletalModel::updateCurrentJointToWorldTransforms()
 {
+    TRACE_SCOPE( "SkeletalModel::updateCurrentJointToWorldTransforms" );
 	// 2.3.2. Implement this method to compute a per-joint transform from
 	// joint space to world space in the CURRENT POSE.
 	//
 	// The current pose is defined by the rotations you've applied to the
 	// joints and hence needs to be *updated* every time the joint angles change.
 	//
-	// This method should update each joint's bindWorldToJointTransform
-    // (*fix*: currentJointToWorldTransform).
-	// You will need to add a recursive helper function to traverse the joint hierarchy.
-    std::function<void(Joint*)> bfs = [&, this](Joint *jt) -> void {
-        m_matrixStack.push(jt->transform);
-        jt->currentJointToWorldTransform = m_matrixStack.top();
-        for (auto it = jt->children.begin(); it != jt->children.end(); ++it) 
-            bfs(*it);
-        m_matrixStack.pop();
-    };
-    m_matrixStack.clear();
-    bfs(m_rootJoint);
+	// This method should update m_currentJointToWorldTransforms.
+    updateWorldTransforms();
+    updateSkinningPalette();
+}
+
+void SkeletalModel::updateWorldTransforms()
+{
+	// Joints are stored parents first (see loadSkeleton()), so one pass in
+	// order sees every parent before its children. Only dirty joints and
+	// the subtrees below them get new world transforms.
+    const size_t numJoints = this->numJoints();
+    std::vector< unsigned char > moved(numJoints, 0);
+    for (size_t j = 0; j != numJoints; ++j) {
+        const int parent = m_rig->parents[j];
+        if (!m_jointDirty[j] && (parent < 0 || !moved[parent]))
+            continue;
+        m_currentJointToWorldTransforms[j] = parent < 0 ? m_jointTransforms[j] :
+            m_currentJointToWorldTransforms[parent] * m_jointTransforms[j];
+        m_jointDirty[j] = 0;
+        moved[j] = 1;
+        m_jointMoved[j] = 1;
+        m_jointsStale = m_bonesStale = true;
+    }
+}
+
+void SkeletalModel::updateSkinningPalette()
+{
+    rebuildSkinningPalette(m_skinAll);
+}
+
+void SkeletalModel::rebuildSkinningPalette(bool all)
+{
+    const size_t numJoints = this->numJoints();
+    m_palette.resize(numJoints);
+    for (size_t j = 0; j != numJoints; ++j) {
+        if (!all && !m_jointMoved[j])
+            continue;
+        const Matrix4f &bind2Joint = m_rig->bindWorldToJointTransforms[j],
+                       &joint2World = m_currentJointToWorldTransforms[j];
+        m_palette[j].set(joint2World * bind2Joint);
+    }
+    if (m_skinningMode == DUAL_QUATERNION_SKINNING) {
+        m_dualPalette.resize(numJoints);
+        for (size_t j = 0; j != numJoints; ++j) {
+            if (!all && !m_jointMoved[j])
+                continue;
+            const Matrix4f &bind2Joint = m_rig->bindWorldToJointTransforms[j],
+                           &joint2World = m_currentJointToWorldTransforms[j];
+            m_dualPalette[j].set(joint2World * bind2Joint);
+        }
+    }
+}
+
+void SkeletalModel::setSkinningMode(SkinningMode mode)
+{
+    m_skinningMode = mode;
+    m_skinAll = true;
+    rebuildSkinningPalette(true);
 }
 
 void SkeletalModel::updateMesh()
 {
+    TRACE_SCOPE( "SkeletalModel::updateMesh" );
 	// 2.3.2. This is the core of SSD.
 	// Implement this method to update the vertices of the mesh
 	// given the current state of the skeleton.
@@ -236,24 +278,63 @@ void SkeletalModel::updateMesh()
     // Some notes:
     //  1. Matrix4f does not support `+`, also no scalar multiplication.
     //  2. Distinguish between point( [x,y,z,1] ) and vector ( [x,y,z,0] )
-    const size_t numVertices = m_mesh.bindVertices.size();
-    const size_t numJoints = m_joints.size();
-    for (size_t i = 0; i != numVertices; ++i) {
-        Vector4f p_bind(m_mesh.bindVertices[i], 1.0f); // 1.0f indicats a POINT
-        // p_i = \sum_j w_ij T_j * B^-1_j * p_i
-        Vector4f b1, b2, b3, b4; 
-        for (size_t j = 0; j != numJoints; ++j) {
-            float wij = m_mesh.attachments[i][j];
-            Matrix4f bind2Joint = m_joints[j]->bindWorldToJointTransform,
-                     joint2World = m_joints[j]->currentJointToWorldTransform;
-            Matrix4f M = joint2World * bind2Joint;
-            b1 = b1 + wij * M.getCol(0);
-            b2 = b2 + wij * M.getCol(1);
-            b3 = b3 + wij * M.getCol(2);
-            b4 = b4 + wij * M.getCol(3);
-        }
-        Vector4f deform = Matrix4f(b1, b2, b3, b4) * p_bind; 
-        m_mesh.currentVertices[i] = deform.xyz();
-    }
+    //  3. p_i = \sum_j w_ij T_j * B^-1_j * p_i, over the joints that
+    //     actually influence vertex i (see Mesh::influenceJoints).
+    //     T_j * B^-1_j comes from the palette of the current pose.
+    //     Rig::skinner runs this over blocks of vertices on m_pool.
+    //  4. DUAL_QUATERNION_SKINNING blends the same transforms as dual
+    //     quaternions instead (see Skinner::skinDualQuaternion).
+    //  5. Vertices whose joints all kept their world transforms since
+    //     the last call are left alone.
+    //  6. Normals go through the rotation part of the same blend, so
+    //     SkinnedMesh::draw() needs no per-face math.
+    SkeletalModel *self = this;
+    updateMeshes(&self, 1, m_pool);
+}
+
+void SkeletalModel::updateMeshes(SkeletalModel *const *models, size_t numModels,
+                                 ThreadPool *pool)
+{
+    TRACE_SCOPE( "SkeletalModel::updateMeshes" );
+    std::vector< SkinJob > jobs(numModels);
+    for (size_t i = 0; i != numModels; ++i)
+        jobs[i] = models[i]->skinJob();
+    Skinner::skinBatch(jobs.data(), numModels, pool);
+    for (size_t i = 0; i != numModels; ++i)
+        models[i]->finishSkinning();
+}
+
+SkinJob SkeletalModel::skinJob()
+{
+    const bool dual = m_skinningMode == DUAL_QUATERNION_SKINNING;
+    SkinJob job;
+    job.skinner = &m_rig->skinner;
+    job.palette = dual ? NULL : m_palette.data();
+    job.dualPalette = m_dualPalette.data();
+    job.positions = &m_skinned.currentVertices;
+    job.normals = &m_skinned.currentNormals;
+    job.moved = m_skinAll ? NULL : m_jointMoved.data();
+    m_skinned.buffer.invalidate();
+    return job;
 }
 
+void SkeletalModel::finishSkinning()
+{
+    m_skinAll = false;
+    std::fill(m_jointMoved.begin(), m_jointMoved.end(), 0);
+#ifdef DEBUG
+    const Skinner &skinner = m_rig->skinner;
+    const std::vector< Vector3f > &out = m_skinned.currentVertices,
+                                  &normals = m_skinned.currentNormals;
+    std::vector< Vector3f > reference, referenceNormals;
+    if (m_skinningMode == DUAL_QUATERNION_SKINNING)
+        skinner.skinDualQuaternionReference(m_dualPalette.data(), reference, referenceNormals);
+    else
+        skinner.skinLinearReference(m_palette.data(), reference, referenceNormals);
+    for (size_t i = 0; i != skinner.numVertices(); ++i) {
+        assert((reference[i] - out[i]).abs()
+                <= 1e-4f * (1.0f + reference[i].abs()));
+        assert((referenceNormals[i] - normals[i]).abs() <= 1e-4f);
+    }
+#endif
+}
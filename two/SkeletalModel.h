@@ -15,7 +15,7 @@
 #include "FL/gl.h"
 #else
 #include <GL/glut.h>
-#include <FL/gl.h>
+#include <GL/gl.h>
 #endif
 #include <iostream>
 #include <fstream>
@@ -25,27 +25,42 @@
 #include <vecmath.h>
 
 #include "tuple.h"
-#include "Joint.h"
+#include "AnimationClip.h"
 #include "Mesh.h"
 #include "MatrixStack.h"
+#include "Rig.h"
+#include "Skinning.h"
+#include "TriangleBuffer.h"
 
+enum SkinningMode
+{
+	LINEAR_BLEND_SKINNING,
+	DUAL_QUATERNION_SKINNING
+};
+
+// One posed character: its joint angles, world transforms, palette and
+// skinned mesh. Everything else lives in a Rig, which any number of
+// SkeletalModels can share.
 class SkeletalModel
 {
 public:
+	// pool may be NULL, updateMesh() then runs on the calling thread
+	explicit SkeletalModel(ThreadPool *pool = NULL);
+
+	// An instance of a rig that is already loaded, in its bind pose
+	explicit SkeletalModel(std::shared_ptr< const Rig > rig, ThreadPool *pool = NULL);
+
 	// Already-implemented utility functions that call the code you will write.
+	// load() gives this model a rig of its own, see Rig::load().
 	void load(const char *skeletonFile, const char *meshFile, const char *attachmentsFile);
 	void draw(Matrix4f cameraMatrix, bool drawSkeleton);
 
 	// Part 1: Understanding Hierarchical Modeling
 
-	// 1.1. Implement method to load a skeleton.
-	// This method should compute m_rootJoint and populate m_joints.
-	void loadSkeleton( const char* filename );
-
-	// 1.1. Implement this method with a recursive helper to draw a sphere at each joint.
+	// 1.1. Implement this method to draw a sphere at each joint.
 	void drawJoints( );
 
-	// 1.2. Implement this method a recursive helper to draw a box between each pair of joints
+	// 1.2. Implement this method to draw a box between each pair of joints
 	void drawSkeleton( );
 
 	// 1.3. Implement this method to handle changes to your skeleton given
@@ -55,18 +70,28 @@ public:
     // Extra credit. 
 	void setRootTranslation( float tX, float tY, float tZ );
 
-	// Part 2: Skeletal Subspace Deformation
+	// Rotation of joint j as a unit quaternion, in place of the Euler
+	// angles of setJointTransform()
+	void setJointRotation( int jointIndex, const Quat4f& rotation );
 
-	// 2.3. Implement SSD
+	// The rotations of the first numJoints() joints of pose and its
+	// root translation, e.g. a sample of an AnimationClip
+	void setPose( const Pose& pose );
 
-	// 2.3.1. Implement this method to compute a per-joint transform from
-	// world-space to joint space in the BIND POSE.
-	void computeBindWorldToJointTransforms();
+	// Part 2: Skeletal Subspace Deformation
+
+	// 2.3. Implement SSD (see Rig for the bind pose)
 
 	// 2.3.2. Implement this method to compute a per-joint transform from
 	// joint space to world space in the CURRENT POSE.
 	void updateCurrentJointToWorldTransforms();
 
+	// The two halves of updateCurrentJointToWorldTransforms(), for callers
+	// that time them separately: forward kinematics of the joints whose
+	// transforms changed, then the palette entries of the joints that moved
+	void updateWorldTransforms();
+	void updateSkinningPalette();
+
 	// 2.3.2. This is the core of SSD.
 	// Implement this method to update the vertices of the mesh
 	// given the current state of the skeleton.
@@ -74,22 +99,90 @@ public:
 	// and the current joint --> world transforms.
 	void updateMesh();
 
+	// updateMesh() of numModels models at once, with the blocks of all
+	// of them spread over one set of pool tasks
+	static void updateMeshes(SkeletalModel *const *models, size_t numModels,
+		ThreadPool *pool);
+
+	// Skinning palette of the current pose: entry j is T_j * B_j^-1 of
+	// joint j. Rebuilt by updateCurrentJointToWorldTransforms(), so a
+	// renderer or exporter can read the whole pose as one block.
+	const SkinMatrix* skinningPalette() const { return m_palette.data(); }
+	size_t skinningPaletteSize() const { return m_palette.size(); }
+
+	// The same pose as unit dual quaternions, only kept up to date in
+	// DUAL_QUATERNION_SKINNING mode
+	const DualQuat* dualQuaternionPalette() const { return m_dualPalette.data(); }
+
+	// Linear blend skinning by default
+	void setSkinningMode(SkinningMode mode);
+	SkinningMode skinningMode() const { return m_skinningMode; }
+
+	size_t numJoints() const { return m_jointTransforms.size(); }
+	const Rig &rig() const { return *m_rig; }
+	const Mesh &mesh() const { return m_rig->mesh; }
+	const SkinnedMesh &skinnedMesh() const { return m_skinned; }
+
 private:
+	// Starts over in the bind pose of rig
+	void setRig(std::shared_ptr< const Rig > rig);
+
+	// The skin call for the next updateMeshes(), and the bookkeeping
+	// once it ran
+	SkinJob skinJob();
+	void finishSkinning();
+
+	// Rebuild the m_palette (and m_dualPalette) entries of the joints in
+	// m_jointMoved, or of all joints, from the current and bind transforms
+	void rebuildSkinningPalette(bool all);
+
+	// transform of joint j from its angles (or rotation) and its bind
+	// transform
+	void updateLocalTransform(size_t j);
 
     // Cache cameraMatrix for redrawing joints and bones
     Matrix4f cameraMatrix;
 
-	// pointer to the root joint
-	Joint* m_rootJoint;
-	// the list of joints.
-	std::vector< Joint* > m_joints;
-    // Initial Joint transform
-    Matrix4f ini_root_trans;
-    std::vector< Matrix4f > ini_trans;
-
-	Mesh m_mesh;
+	std::shared_ptr< const Rig > m_rig;
+
+	// The pose as flat arrays with one entry per joint, indexed like
+	// the joints of m_rig.
+	// transform relative to the parent
+	std::vector< Matrix4f > m_jointTransforms;
+	// joint space --> world space in the current pose
+	std::vector< Matrix4f > m_currentJointToWorldTransforms;
+	// m_jointTransforms[ j ] changed since the world transforms were
+	// last updated, so joint j and its subtree need new ones
+	std::vector< unsigned char > m_jointDirty;
+    // last values passed to setJointTransform(), setJointRotation() and
+    // setRootTranslation(); m_jointUsesRotation[ j ] says which of the
+    // first two joint j got last
+    std::vector< Vector3f > m_jointAngles;
+    std::vector< Quat4f > m_jointRotations;
+    std::vector< unsigned char > m_jointUsesRotation;
+    Vector3f m_rootTranslation;
+    // world transform changed since the mesh was last skinned
+    std::vector< unsigned char > m_jointMoved;
+    // skin every vertex in the next updateMesh()
+    bool m_skinAll;
+
+	SkinnedMesh m_skinned;
+    // see skinningPalette()
+    std::vector< SkinMatrix > m_palette;
+    std::vector< DualQuat > m_dualPalette;
+    SkinningMode m_skinningMode;
+    ThreadPool *m_pool;
 
 	MatrixStack m_matrixStack;
+
+    // Copies of the joint and bone geometry of m_rig for the current
+    // pose (see drawJoints()), redrawn from the buffers until it changes
+    std::vector< Vector3f > m_jointPositions, m_jointNormals;
+    std::vector< Vector3f > m_bonePositions, m_boneNormals;
+    TriangleBuffer m_jointBuffer;
+    TriangleBuffer m_boneBuffer;
+    bool m_jointsStale;
+    bool m_bonesStale;
 };
 
 #endif
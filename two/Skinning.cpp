@@ -0,0 +1,566 @@
+#include "Skinning.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "Trace.h"
+
+#ifdef VECMATH_HAVE_SSE
+#include <xmmintrin.h>
+#endif
+
+using namespace std;
+
+namespace
+{
+	// Blocks per pool task. 13k vertices make a dozen tasks.
+	const size_t CHUNK_BLOCKS = 256;
+
+	// Smallest squared length normalizeLane() divides by, and below which
+	// a blended dual quaternion counts as unweighted
+	const float NORMAL_EPSILON = 1e-30f;
+
+	// Writes the lanes of a block that hold one of the numVertices skinned
+	// vertices back to out. The padding lanes past them are left alone, so
+	// vertices without weight rows keep their bind pose.
+	void storeBlock( vector< Vector3f >& out, size_t first, size_t numVertices,
+		const float* x, const float* y, const float* z )
+	{
+		const size_t n = min( numVertices - first, size_t( SKIN_BLOCK ) );
+		for( size_t l = 0; l < n; ++l )
+		{
+			out[ first + l ] = Vector3f( x[ l ], y[ l ], z[ l ] );
+		}
+	}
+
+	// ( x, y, z ) scaled to unit length, left alone if it is 0
+	void normalizeLane( float& x, float& y, float& z )
+	{
+		const float scale = 1.0f / sqrt( max( x * x + y * y + z * z, NORMAL_EPSILON ) );
+		x *= scale;
+		y *= scale;
+		z *= scale;
+	}
+
+	// Rotates n by the unit quaternion real = ( w, v ):
+	//   n' = n + 2 v x ( v x n + w n )
+	void quaternionRotate( const float* real, float nx, float ny, float nz,
+		float& x, float& y, float& z )
+	{
+		const float w = real[ 0 ], vx = real[ 1 ], vy = real[ 2 ], vz = real[ 3 ];
+		const float cx = ( vy * nz - vz * ny ) + w * nx;
+		const float cy = ( vz * nx - vx * nz ) + w * ny;
+		const float cz = ( vx * ny - vy * nx ) + w * nz;
+		x = nx + 2.0f * ( vy * cz - vz * cy );
+		y = ny + 2.0f * ( vz * cx - vx * cz );
+		z = nz + 2.0f * ( vx * cy - vy * cx );
+	}
+
+	// Applies the blended dual quaternion b = real + eps * dual, already
+	// normalized, to p:
+	//   p' = p + 2 v x ( v x p + w p ) + 2 ( w d - e v + v x d )
+	// with real = ( w, v ) and dual = ( e, d ).
+	void dualQuaternionTransform( const float* real, const float* dual,
+		float px, float py, float pz, float& x, float& y, float& z )
+	{
+		const float w = real[ 0 ], vx = real[ 1 ], vy = real[ 2 ], vz = real[ 3 ];
+		const float e = dual[ 0 ], dx = dual[ 1 ], dy = dual[ 2 ], dz = dual[ 3 ];
+		const float cx = ( vy * pz - vz * py ) + w * px;
+		const float cy = ( vz * px - vx * pz ) + w * py;
+		const float cz = ( vx * py - vy * px ) + w * pz;
+		const float tx = ( w * dx - e * vx ) + ( vy * dz - vz * dy );
+		const float ty = ( w * dy - e * vy ) + ( vz * dx - vx * dz );
+		const float tz = ( w * dz - e * vz ) + ( vx * dy - vy * dx );
+		x = px + 2.0f * ( ( vy * cz - vz * cy ) + tx );
+		y = py + 2.0f * ( ( vz * cx - vx * cz ) + ty );
+		z = pz + 2.0f * ( ( vx * cy - vy * cx ) + tz );
+	}
+}
+
+Skinner::Skinner() :
+	m_numVertices( 0 ), m_numInfluences( 0 )
+{
+}
+
+void Skinner::setup( const Mesh& mesh )
+{
+	const int numInfluences = mesh.influenceCount;
+	m_numVertices = numInfluences == 0 ? 0 :
+		min( mesh.bindVertices.size(), mesh.influenceWeights.size() / numInfluences );
+	m_numInfluences = numInfluences;
+
+	const size_t numBlocks = ( m_numVertices + SKIN_BLOCK - 1 ) / SKIN_BLOCK;
+	m_blocks.assign( numBlocks, Block() );
+	m_influences.assign( numBlocks * numInfluences, BlockInfluence() );
+	for( size_t i = 0; i < m_numVertices; ++i )
+	{
+		const size_t b = i / SKIN_BLOCK, l = i % SKIN_BLOCK;
+		const Vector3f& p = mesh.bindVertices[ i ];
+		m_blocks[ b ].x[ l ] = p.x();
+		m_blocks[ b ].y[ l ] = p.y();
+		m_blocks[ b ].z[ l ] = p.z();
+		if( i < mesh.bindNormals.size() )
+		{
+			const Vector3f& n = mesh.bindNormals[ i ];
+			m_blocks[ b ].nx[ l ] = n.x();
+			m_blocks[ b ].ny[ l ] = n.y();
+			m_blocks[ b ].nz[ l ] = n.z();
+		}
+		for( int k = 0; k < numInfluences; ++k )
+		{
+			BlockInfluence& s = m_influences[ b * numInfluences + k ];
+			s.weight[ l ] = mesh.influenceWeights[ i * numInfluences + k ];
+			s.joint[ l ] = mesh.influenceJoints[ i * numInfluences + k ];
+		}
+	}
+
+	// Invert the influences into the blocks of each joint, counting
+	// every block once per joint
+	vector< vector< size_t > > blocks;
+	for( size_t b = 0; b < numBlocks; ++b )
+	{
+		for( int k = 0; k < numInfluences; ++k )
+		{
+			const BlockInfluence& s = m_influences[ b * numInfluences + k ];
+			for( int l = 0; l < SKIN_BLOCK; ++l )
+			{
+				if( s.weight[ l ] == 0 )
+				{
+					continue;
+				}
+				const size_t j = s.joint[ l ];
+				if( blocks.size() <= j )
+				{
+					blocks.resize( j + 1 );
+				}
+				if( blocks[ j ].empty() || blocks[ j ].back() != b )
+				{
+					blocks[ j ].push_back( b );
+				}
+			}
+		}
+	}
+	m_jointBlockStart.assign( 1, 0 );
+	m_jointBlocks.clear();
+	for( size_t j = 0; j < blocks.size(); ++j )
+	{
+		m_jointBlocks.insert( m_jointBlocks.end(), blocks[ j ].begin(), blocks[ j ].end() );
+		m_jointBlockStart.push_back( m_jointBlocks.size() );
+	}
+}
+
+void Skinner::markBlocks( const unsigned char* moved,
+	vector< unsigned char >& marked ) const
+{
+	if( !moved )
+	{
+		marked.assign( m_blocks.size(), 1 );
+		return;
+	}
+	marked.assign( m_blocks.size(), 0 );
+	for( size_t j = 0; j + 1 < m_jointBlockStart.size(); ++j )
+	{
+		if( moved[ j ] )
+		{
+			for( size_t s = m_jointBlockStart[ j ]; s != m_jointBlockStart[ j + 1 ]; ++s )
+			{
+				marked[ m_jointBlocks[ s ] ] = 1;
+			}
+		}
+	}
+}
+
+void Skinner::skinLinear( const SkinMatrix* palette, vector< Vector3f >& positions,
+	vector< Vector3f >& normals, ThreadPool* pool, const unsigned char* moved ) const
+{
+	const SkinJob job = { this, palette, NULL, &positions, &normals, moved };
+	skinBatch( &job, 1, pool );
+}
+
+void Skinner::skinDualQuaternion( const DualQuat* palette, vector< Vector3f >& positions,
+	vector< Vector3f >& normals, ThreadPool* pool, const unsigned char* moved ) const
+{
+	const SkinJob job = { this, NULL, palette, &positions, &normals, moved };
+	skinBatch( &job, 1, pool );
+}
+
+void Skinner::skinBatch( const SkinJob* jobs, size_t numJobs, ThreadPool* pool )
+{
+	// One task per chunk of blocks with something to skin, over all jobs
+	struct Task
+	{
+		size_t job;
+		size_t begin;
+		size_t end;
+	};
+	vector< vector< unsigned char > > marked( numJobs );
+	vector< Task > tasks;
+	for( size_t i = 0; i < numJobs; ++i )
+	{
+		const SkinJob& job = jobs[ i ];
+		const Skinner& s = *job.skinner;
+		job.positions->resize( max( job.positions->size(), s.m_numVertices ) );
+		job.normals->resize( max( job.normals->size(), s.m_numVertices ) );
+		s.markBlocks( job.moved, marked[ i ] );
+		const unsigned char* m = marked[ i ].data();
+		const size_t numBlocks = s.m_blocks.size();
+		for( size_t begin = 0; begin < numBlocks; begin += CHUNK_BLOCKS )
+		{
+			const size_t end = min( numBlocks, begin + CHUNK_BLOCKS );
+			if( find( m + begin, m + end, 1 ) != m + end )
+			{
+				const Task t = { i, begin, end };
+				tasks.push_back( t );
+			}
+		}
+	}
+	auto run = [&]( size_t k )
+	{
+		TRACE_SCOPE( "Skinner::skinBatch task" );
+		const Task& t = tasks[ k ];
+		const SkinJob& job = jobs[ t.job ];
+		if( job.palette )
+		{
+			job.skinner->linearBlocks( job.palette, *job.positions, *job.normals,
+				marked[ t.job ].data(), t.begin, t.end );
+		}
+		else
+		{
+			job.skinner->dualQuaternionBlocks( job.dualPalette, *job.positions, *job.normals,
+				marked[ t.job ].data(), t.begin, t.end );
+		}
+	};
+	if( pool )
+	{
+		pool->run( tasks.size(), run );
+	}
+	else
+	{
+		for( size_t k = 0; k < tasks.size(); ++k )
+		{
+			run( k );
+		}
+	}
+}
+
+void Skinner::skinLinearReference( const SkinMatrix* palette,
+	vector< Vector3f >& positions, vector< Vector3f >& normals ) const
+{
+	positions.resize( max( positions.size(), m_numVertices ) );
+	normals.resize( max( normals.size(), m_numVertices ) );
+	linearBlocksReference( palette, positions, normals, 0, m_blocks.size() );
+}
+
+void Skinner::skinDualQuaternionReference( const DualQuat* palette,
+	vector< Vector3f >& positions, vector< Vector3f >& normals ) const
+{
+	positions.resize( max( positions.size(), m_numVertices ) );
+	normals.resize( max( normals.size(), m_numVertices ) );
+	dualQuaternionBlocksReference( palette, positions, normals, 0, m_blocks.size() );
+}
+
+void Skinner::linearBlocksReference( const SkinMatrix* palette,
+	vector< Vector3f >& positions, vector< Vector3f >& normals,
+	size_t begin, size_t end ) const
+{
+	for( size_t b = begin; b < end; ++b )
+	{
+		const Block& p = m_blocks[ b ];
+		const BlockInfluence* s = &m_influences[ b * m_numInfluences ];
+		float x[ SKIN_BLOCK ], y[ SKIN_BLOCK ], z[ SKIN_BLOCK ];
+		float nx[ SKIN_BLOCK ], ny[ SKIN_BLOCK ], nz[ SKIN_BLOCK ];
+		for( int l = 0; l < SKIN_BLOCK; ++l )
+		{
+			x[ l ] = y[ l ] = z[ l ] = 0.0f;
+			nx[ l ] = ny[ l ] = nz[ l ] = 0.0f;
+			// weights are sorted, the first 0 ends the list
+			for( int k = 0; k < m_numInfluences && s[ k ].weight[ l ] != 0; ++k )
+			{
+				const float ( *m )[ 4 ] = palette[ s[ k ].joint[ l ] ].m;
+				const float w = s[ k ].weight[ l ];
+				x[ l ] += w * ( m[ 0 ][ 0 ] * p.x[ l ] + m[ 0 ][ 1 ] * p.y[ l ] + m[ 0 ][ 2 ] * p.z[ l ] + m[ 0 ][ 3 ] );
+				y[ l ] += w * ( m[ 1 ][ 0 ] * p.x[ l ] + m[ 1 ][ 1 ] * p.y[ l ] + m[ 1 ][ 2 ] * p.z[ l ] + m[ 1 ][ 3 ] );
+				z[ l ] += w * ( m[ 2 ][ 0 ] * p.x[ l ] + m[ 2 ][ 1 ] * p.y[ l ] + m[ 2 ][ 2 ] * p.z[ l ] + m[ 2 ][ 3 ] );
+				// the palette is rigid, so its rotation part also
+				// transforms normals
+				nx[ l ] += w * ( m[ 0 ][ 0 ] * p.nx[ l ] + m[ 0 ][ 1 ] * p.ny[ l ] + m[ 0 ][ 2 ] * p.nz[ l ] );
+				ny[ l ] += w * ( m[ 1 ][ 0 ] * p.nx[ l ] + m[ 1 ][ 1 ] * p.ny[ l ] + m[ 1 ][ 2 ] * p.nz[ l ] );
+				nz[ l ] += w * ( m[ 2 ][ 0 ] * p.nx[ l ] + m[ 2 ][ 1 ] * p.ny[ l ] + m[ 2 ][ 2 ] * p.nz[ l ] );
+			}
+			normalizeLane( nx[ l ], ny[ l ], nz[ l ] );
+		}
+		storeBlock( positions, b * SKIN_BLOCK, m_numVertices, x, y, z );
+		storeBlock( normals, b * SKIN_BLOCK, m_numVertices, nx, ny, nz );
+	}
+}
+
+void Skinner::dualQuaternionBlocksReference( const DualQuat* palette,
+	vector< Vector3f >& positions, vector< Vector3f >& normals,
+	size_t begin, size_t end ) const
+{
+	for( size_t b = begin; b < end; ++b )
+	{
+		const Block& p = m_blocks[ b ];
+		const BlockInfluence* s = &m_influences[ b * m_numInfluences ];
+		float x[ SKIN_BLOCK ], y[ SKIN_BLOCK ], z[ SKIN_BLOCK ];
+		float nx[ SKIN_BLOCK ], ny[ SKIN_BLOCK ], nz[ SKIN_BLOCK ];
+		for( int l = 0; l < SKIN_BLOCK; ++l )
+		{
+			float real[ 4 ] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			float dual[ 4 ] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			// q and -q are the same rotation, blend every entry in the
+			// hemisphere of the heaviest one
+			const float* pivot = palette[ s[ 0 ].joint[ l ] ].real;
+			for( int k = 0; k < m_numInfluences && s[ k ].weight[ l ] != 0; ++k )
+			{
+				const DualQuat& q = palette[ s[ k ].joint[ l ] ];
+				float w = s[ k ].weight[ l ];
+				if( q.real[ 0 ] * pivot[ 0 ] + q.real[ 1 ] * pivot[ 1 ] +
+					q.real[ 2 ] * pivot[ 2 ] + q.real[ 3 ] * pivot[ 3 ] < 0 )
+				{
+					w = -w;
+				}
+				for( int c = 0; c < 4; ++c )
+				{
+					real[ c ] += w * q.real[ c ];
+					dual[ c ] += w * q.dual[ c ];
+				}
+			}
+			const float len2 = real[ 0 ] * real[ 0 ] + real[ 1 ] * real[ 1 ] +
+				real[ 2 ] * real[ 2 ] + real[ 3 ] * real[ 3 ];
+			if( len2 < NORMAL_EPSILON )
+			{
+				// no influences: 0, as the linear blend gives
+				x[ l ] = y[ l ] = z[ l ] = 0.0f;
+				nx[ l ] = ny[ l ] = nz[ l ] = 0.0f;
+				continue;
+			}
+			const float scale = 1.0f / sqrt( len2 );
+			for( int c = 0; c < 4; ++c )
+			{
+				real[ c ] *= scale;
+				dual[ c ] *= scale;
+			}
+			dualQuaternionTransform( real, dual, p.x[ l ], p.y[ l ], p.z[ l ],
+				x[ l ], y[ l ], z[ l ] );
+			quaternionRotate( real, p.nx[ l ], p.ny[ l ], p.nz[ l ],
+				nx[ l ], ny[ l ], nz[ l ] );
+		}
+		storeBlock( positions, b * SKIN_BLOCK, m_numVertices, x, y, z );
+		storeBlock( normals, b * SKIN_BLOCK, m_numVertices, nx, ny, nz );
+	}
+}
+
+#ifdef VECMATH_HAVE_SSE
+
+namespace
+{
+	// SSE versions of the helpers above, over the four lanes of a block
+
+	void normalizeLanes( __m128& x, __m128& y, __m128& z )
+	{
+		__m128 len2 = _mm_mul_ps( x, x );
+		len2 = _mm_add_ps( len2, _mm_mul_ps( y, y ) );
+		len2 = _mm_add_ps( len2, _mm_mul_ps( z, z ) );
+		const __m128 scale = _mm_div_ps( _mm_set1_ps( 1.0f ),
+			_mm_sqrt_ps( _mm_max_ps( len2, _mm_set1_ps( NORMAL_EPSILON ) ) ) );
+		x = _mm_mul_ps( x, scale );
+		y = _mm_mul_ps( y, scale );
+		z = _mm_mul_ps( z, scale );
+	}
+
+	// ( x, y, z ) = v x ( v x n + w n ), the rotation term shared by
+	// dualQuaternionTransform() and quaternionRotate()
+	void quaternionTwist( __m128 w, __m128 vx, __m128 vy, __m128 vz,
+		__m128 nx, __m128 ny, __m128 nz, __m128& x, __m128& y, __m128& z )
+	{
+		const __m128 cx = _mm_add_ps( _mm_sub_ps( _mm_mul_ps( vy, nz ), _mm_mul_ps( vz, ny ) ), _mm_mul_ps( w, nx ) );
+		const __m128 cy = _mm_add_ps( _mm_sub_ps( _mm_mul_ps( vz, nx ), _mm_mul_ps( vx, nz ) ), _mm_mul_ps( w, ny ) );
+		const __m128 cz = _mm_add_ps( _mm_sub_ps( _mm_mul_ps( vx, ny ), _mm_mul_ps( vy, nx ) ), _mm_mul_ps( w, nz ) );
+		x = _mm_sub_ps( _mm_mul_ps( vy, cz ), _mm_mul_ps( vz, cy ) );
+		y = _mm_sub_ps( _mm_mul_ps( vz, cx ), _mm_mul_ps( vx, cz ) );
+		z = _mm_sub_ps( _mm_mul_ps( vx, cy ), _mm_mul_ps( vy, cx ) );
+	}
+
+	void storeLanes( vector< Vector3f >& out, size_t first, size_t numVertices,
+		__m128 x, __m128 y, __m128 z )
+	{
+		alignas( 16 ) float rx[ SKIN_BLOCK ], ry[ SKIN_BLOCK ], rz[ SKIN_BLOCK ];
+		_mm_store_ps( rx, x );
+		_mm_store_ps( ry, y );
+		_mm_store_ps( rz, z );
+		storeBlock( out, first, numVertices, rx, ry, rz );
+	}
+}
+
+void Skinner::linearBlocks( const SkinMatrix* palette, vector< Vector3f >& positions,
+	vector< Vector3f >& normals, const unsigned char* marked,
+	size_t begin, size_t end ) const
+{
+	const __m128 zero = _mm_setzero_ps();
+	for( size_t b = begin; b < end; ++b )
+	{
+		if( !marked[ b ] )
+		{
+			continue;
+		}
+		const Block& p = m_blocks[ b ];
+		const BlockInfluence* s = &m_influences[ b * m_numInfluences ];
+		const __m128 x = _mm_load_ps( p.x ), y = _mm_load_ps( p.y ), z = _mm_load_ps( p.z );
+		const __m128 nx = _mm_load_ps( p.nx ), ny = _mm_load_ps( p.ny ), nz = _mm_load_ps( p.nz );
+		__m128 acc[ 3 ] = { zero, zero, zero };
+		__m128 nacc[ 3 ] = { zero, zero, zero };
+		for( int k = 0; k < m_numInfluences; ++k )
+		{
+			const __m128 w = _mm_load_ps( s[ k ].weight );
+			// slots are sorted, stop once no lane has weight left
+			if( _mm_movemask_ps( _mm_cmpneq_ps( w, zero ) ) == 0 )
+			{
+				break;
+			}
+			const float ( *m0 )[ 4 ] = palette[ s[ k ].joint[ 0 ] ].m;
+			const float ( *m1 )[ 4 ] = palette[ s[ k ].joint[ 1 ] ].m;
+			const float ( *m2 )[ 4 ] = palette[ s[ k ].joint[ 2 ] ].m;
+			const float ( *m3 )[ 4 ] = palette[ s[ k ].joint[ 3 ] ].m;
+			for( int r = 0; r < 3; ++r )
+			{
+				// row r of the four matrices, transposed to one column per
+				// element: c0 = ( m0[ r ][ 0 ], m1[ r ][ 0 ], ... ) etc.
+				__m128 c0 = _mm_load_ps( m0[ r ] ), c1 = _mm_load_ps( m1[ r ] ),
+					c2 = _mm_load_ps( m2[ r ] ), c3 = _mm_load_ps( m3[ r ] );
+				_MM_TRANSPOSE4_PS( c0, c1, c2, c3 );
+				__m128 t = _mm_mul_ps( c0, x );
+				t = _mm_add_ps( t, _mm_mul_ps( c1, y ) );
+				t = _mm_add_ps( t, _mm_mul_ps( c2, z ) );
+				t = _mm_add_ps( t, c3 );
+				acc[ r ] = _mm_add_ps( acc[ r ], _mm_mul_ps( w, t ) );
+				__m128 n = _mm_mul_ps( c0, nx );
+				n = _mm_add_ps( n, _mm_mul_ps( c1, ny ) );
+				n = _mm_add_ps( n, _mm_mul_ps( c2, nz ) );
+				nacc[ r ] = _mm_add_ps( nacc[ r ], _mm_mul_ps( w, n ) );
+			}
+		}
+		normalizeLanes( nacc[ 0 ], nacc[ 1 ], nacc[ 2 ] );
+		storeLanes( positions, b * SKIN_BLOCK, m_numVertices, acc[ 0 ], acc[ 1 ], acc[ 2 ] );
+		storeLanes( normals, b * SKIN_BLOCK, m_numVertices, nacc[ 0 ], nacc[ 1 ], nacc[ 2 ] );
+	}
+}
+
+void Skinner::dualQuaternionBlocks( const DualQuat* palette, vector< Vector3f >& positions,
+	vector< Vector3f >& normals, const unsigned char* marked,
+	size_t begin, size_t end ) const
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 sign = _mm_set1_ps( -0.0f );
+	const __m128 two = _mm_set1_ps( 2.0f );
+	for( size_t b = begin; b < end; ++b )
+	{
+		if( !marked[ b ] )
+		{
+			continue;
+		}
+		const BlockInfluence* s = &m_influences[ b * m_numInfluences ];
+		// real[ c ], dual[ c ] hold component c of the four blends
+		__m128 real[ 4 ] = { zero, zero, zero, zero };
+		__m128 dual[ 4 ] = { zero, zero, zero, zero };
+		__m128 pivot[ 4 ];
+		for( int k = 0; k < m_numInfluences; ++k )
+		{
+			__m128 w = _mm_load_ps( s[ k ].weight );
+			if( _mm_movemask_ps( _mm_cmpneq_ps( w, zero ) ) == 0 )
+			{
+				break;
+			}
+			const DualQuat* q[ SKIN_BLOCK ];
+			for( int l = 0; l < SKIN_BLOCK; ++l )
+			{
+				q[ l ] = &palette[ s[ k ].joint[ l ] ];
+			}
+			__m128 r[ 4 ] = { _mm_load_ps( q[ 0 ]->real ), _mm_load_ps( q[ 1 ]->real ),
+				_mm_load_ps( q[ 2 ]->real ), _mm_load_ps( q[ 3 ]->real ) };
+			__m128 d[ 4 ] = { _mm_load_ps( q[ 0 ]->dual ), _mm_load_ps( q[ 1 ]->dual ),
+				_mm_load_ps( q[ 2 ]->dual ), _mm_load_ps( q[ 3 ]->dual ) };
+			_MM_TRANSPOSE4_PS( r[ 0 ], r[ 1 ], r[ 2 ], r[ 3 ] );
+			_MM_TRANSPOSE4_PS( d[ 0 ], d[ 1 ], d[ 2 ], d[ 3 ] );
+			if( k == 0 )
+			{
+				copy( r, r + 4, pivot );
+			}
+			// flip the lanes that are in the other hemisphere of the pivot
+			__m128 dot = _mm_mul_ps( r[ 0 ], pivot[ 0 ] );
+			dot = _mm_add_ps( dot, _mm_mul_ps( r[ 1 ], pivot[ 1 ] ) );
+			dot = _mm_add_ps( dot, _mm_mul_ps( r[ 2 ], pivot[ 2 ] ) );
+			dot = _mm_add_ps( dot, _mm_mul_ps( r[ 3 ], pivot[ 3 ] ) );
+			w = _mm_xor_ps( w, _mm_and_ps( _mm_cmplt_ps( dot, zero ), sign ) );
+			for( int c = 0; c < 4; ++c )
+			{
+				real[ c ] = _mm_add_ps( real[ c ], _mm_mul_ps( w, r[ c ] ) );
+				dual[ c ] = _mm_add_ps( dual[ c ], _mm_mul_ps( w, d[ c ] ) );
+			}
+		}
+		__m128 len2 = _mm_mul_ps( real[ 0 ], real[ 0 ] );
+		len2 = _mm_add_ps( len2, _mm_mul_ps( real[ 1 ], real[ 1 ] ) );
+		len2 = _mm_add_ps( len2, _mm_mul_ps( real[ 2 ], real[ 2 ] ) );
+		len2 = _mm_add_ps( len2, _mm_mul_ps( real[ 3 ], real[ 3 ] ) );
+		const __m128 epsilon = _mm_set1_ps( NORMAL_EPSILON );
+		const __m128 scale = _mm_div_ps( _mm_set1_ps( 1.0f ), _mm_sqrt_ps( _mm_max_ps( len2, epsilon ) ) );
+		// lanes without influences are 0, as in dualQuaternionBlocksReference()
+		const __m128 weighted = _mm_cmpge_ps( len2, epsilon );
+
+		// same steps as dualQuaternionTransform() and quaternionRotate()
+		const Block& p = m_blocks[ b ];
+		const __m128 px = _mm_load_ps( p.x ), py = _mm_load_ps( p.y ), pz = _mm_load_ps( p.z );
+		const __m128 w = _mm_mul_ps( real[ 0 ], scale ), vx = _mm_mul_ps( real[ 1 ], scale ),
+			vy = _mm_mul_ps( real[ 2 ], scale ), vz = _mm_mul_ps( real[ 3 ], scale );
+		const __m128 e = _mm_mul_ps( dual[ 0 ], scale ), dx = _mm_mul_ps( dual[ 1 ], scale ),
+			dy = _mm_mul_ps( dual[ 2 ], scale ), dz = _mm_mul_ps( dual[ 3 ], scale );
+		const __m128 tx = _mm_add_ps( _mm_sub_ps( _mm_mul_ps( w, dx ), _mm_mul_ps( e, vx ) ),
+			_mm_sub_ps( _mm_mul_ps( vy, dz ), _mm_mul_ps( vz, dy ) ) );
+		const __m128 ty = _mm_add_ps( _mm_sub_ps( _mm_mul_ps( w, dy ), _mm_mul_ps( e, vy ) ),
+			_mm_sub_ps( _mm_mul_ps( vz, dx ), _mm_mul_ps( vx, dz ) ) );
+		const __m128 tz = _mm_add_ps( _mm_sub_ps( _mm_mul_ps( w, dz ), _mm_mul_ps( e, vz ) ),
+			_mm_sub_ps( _mm_mul_ps( vx, dy ), _mm_mul_ps( vy, dx ) ) );
+		__m128 rx, ry, rz;
+		quaternionTwist( w, vx, vy, vz, px, py, pz, rx, ry, rz );
+		storeLanes( positions, b * SKIN_BLOCK, m_numVertices,
+			_mm_and_ps( weighted, _mm_add_ps( px, _mm_mul_ps( two, _mm_add_ps( rx, tx ) ) ) ),
+			_mm_and_ps( weighted, _mm_add_ps( py, _mm_mul_ps( two, _mm_add_ps( ry, ty ) ) ) ),
+			_mm_and_ps( weighted, _mm_add_ps( pz, _mm_mul_ps( two, _mm_add_ps( rz, tz ) ) ) ) );
+		const __m128 nx = _mm_load_ps( p.nx ), ny = _mm_load_ps( p.ny ), nz = _mm_load_ps( p.nz );
+		quaternionTwist( w, vx, vy, vz, nx, ny, nz, rx, ry, rz );
+		storeLanes( normals, b * SKIN_BLOCK, m_numVertices,
+			_mm_and_ps( weighted, _mm_add_ps( nx, _mm_mul_ps( two, rx ) ) ),
+			_mm_and_ps( weighted, _mm_add_ps( ny, _mm_mul_ps( two, ry ) ) ),
+			_mm_and_ps( weighted, _mm_add_ps( nz, _mm_mul_ps( two, rz ) ) ) );
+	}
+}
+
+#else
+
+void Skinner::linearBlocks( const SkinMatrix* palette, vector< Vector3f >& positions,
+	vector< Vector3f >& normals, const unsigned char* marked,
+	size_t begin, size_t end ) const
+{
+	for( size_t b = begin; b < end; ++b )
+	{
+		if( marked[ b ] )
+		{
+			linearBlocksReference( palette, positions, normals, b, b + 1 );
+		}
+	}
+}
+
+void Skinner::dualQuaternionBlocks( const DualQuat* palette, vector< Vector3f >& positions,
+	vector< Vector3f >& normals, const unsigned char* marked,
+	size_t begin, size_t end ) const
+{
+	for( size_t b = begin; b < end; ++b )
+	{
+		if( marked[ b ] )
+		{
+			dualQuaternionBlocksReference( palette, positions, normals, b, b + 1 );
+		}
+	}
+}
+
+#endif
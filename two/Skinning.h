@@ -0,0 +1,184 @@
+#ifndef SKINNING_H
+#define SKINNING_H
+
+#include <cstddef>
+#include <vector>
+#include <vecmath.h>
+
+#include "Mesh.h"
+#include "ThreadPool.h"
+
+// One entry of a skinning palette: the affine joint transform
+// T_j * B_j^-1 stored as three row-major rows of four floats, so
+// x' = m[ 0 ][ 0 ] * x + m[ 0 ][ 1 ] * y + m[ 0 ][ 2 ] * z + m[ 0 ][ 3 ]
+// and so on. The last row is always ( 0, 0, 0, 1 ) and is not stored.
+//
+// Rows are 16-byte aligned and entries are packed back to back, so a
+// palette is one contiguous block of 12 floats per joint.
+struct alignas( 16 ) SkinMatrix
+{
+	float m[ 3 ][ 4 ];
+
+	void set( const Matrix4f& a )
+	{
+		for( int i = 0; i < 3; ++i )
+		{
+			for( int j = 0; j < 4; ++j )
+			{
+				m[ i ][ j ] = a( i, j );
+			}
+		}
+	}
+};
+
+static_assert( sizeof( SkinMatrix ) == 12 * sizeof( float ),
+	"SkinMatrix must pack into 12 floats" );
+// std::vector< SkinMatrix > relies on operator new for the alignment
+static_assert( alignof( SkinMatrix ) <= alignof( std::max_align_t ),
+	"SkinMatrix is over-aligned for the default allocator" );
+
+// One entry of a dual quaternion palette: the rigid joint transform
+// T_j * B_j^-1 as the unit dual quaternion real + eps * dual, both parts
+// stored w, x, y, z. Eight floats per joint against the twelve of a
+// SkinMatrix.
+struct alignas( 16 ) DualQuat
+{
+	float real[ 4 ];
+	float dual[ 4 ];
+
+	// a must be rigid: a rotation followed by a translation
+	void set( const Matrix4f& a )
+	{
+		Quat4f q = Quat4f::fromRotationMatrix( a.getSubmatrix3x3( 0, 0 ) );
+		Vector3f t = a.getCol( 3 ).xyz();
+		// dual = t * real / 2, with t as a pure quaternion
+		real[ 0 ] = q.w();
+		real[ 1 ] = q.x();
+		real[ 2 ] = q.y();
+		real[ 3 ] = q.z();
+		dual[ 0 ] = -0.5f * ( t.x() * q.x() + t.y() * q.y() + t.z() * q.z() );
+		dual[ 1 ] = 0.5f * ( t.x() * q.w() + t.y() * q.z() - t.z() * q.y() );
+		dual[ 2 ] = 0.5f * ( t.y() * q.w() + t.z() * q.x() - t.x() * q.z() );
+		dual[ 3 ] = 0.5f * ( t.z() * q.w() + t.x() * q.y() - t.y() * q.x() );
+	}
+};
+
+// Skinning of one mesh against a palette of joint transforms.
+//
+// setup() repacks the bind pose and the influences of the mesh into
+// blocks of SKIN_BLOCK vertices in SoA order, so the kernels transform a
+// whole block per SSE instruction. The skin functions hand fixed chunks
+// of blocks to a ThreadPool and return once all of them are done. Every
+// block writes only its own vertices, so the result does not depend on
+// the pool.
+const int SKIN_BLOCK = 4;
+
+class Skinner;
+
+// One mesh to skin in a Skinner::skinBatch()
+struct SkinJob
+{
+	const Skinner* skinner;
+	// linear blend skinning with palette, or dual quaternion skinning
+	// with dualPalette if palette is NULL
+	const SkinMatrix* palette;
+	const DualQuat* dualPalette;
+	std::vector< Vector3f >* positions;
+	std::vector< Vector3f >* normals;
+	// see Skinner::skinLinear()
+	const unsigned char* moved;
+};
+
+class Skinner
+{
+public:
+	Skinner();
+
+	void setup( const Mesh& mesh );
+
+	// Linear blend skinning,
+	// positions[ i ] = \sum_k w_ik palette[ j_ik ] * bindVertices[ i ],
+	// and normals[ i ] the same blend of the rotation parts applied to
+	// bindNormals[ i ], renormalized.
+	// pool may be NULL, the blocks then run on the calling thread.
+	//
+	// If moved is not NULL, only blocks with a vertex influenced by a
+	// joint j with moved[ j ] != 0 are skinned, the rest of the output
+	// is kept.
+	void skinLinear( const SkinMatrix* palette, std::vector< Vector3f >& positions,
+		std::vector< Vector3f >& normals, ThreadPool* pool,
+		const unsigned char* moved = NULL ) const;
+
+	// Dual quaternion skinning: the palette entries of a vertex are
+	// blended into one dual quaternion, renormalized and applied to the
+	// bind position, its rotation to the bind normal. Blending rigid
+	// transforms this way keeps the volume around twisting joints, where
+	// linear blending collapses it.
+	void skinDualQuaternion( const DualQuat* palette, std::vector< Vector3f >& positions,
+		std::vector< Vector3f >& normals, ThreadPool* pool,
+		const unsigned char* moved = NULL ) const;
+
+	// Runs numJobs skin calls, of any mix of skinners and modes, as one
+	// set of pool tasks, so many small meshes keep all threads busy and
+	// share one wait for the pool
+	static void skinBatch( const SkinJob* jobs, size_t numJobs, ThreadPool* pool );
+
+	// Same results one vertex at a time with plain floats, to check the
+	// SSE kernels
+	void skinLinearReference( const SkinMatrix* palette,
+		std::vector< Vector3f >& positions, std::vector< Vector3f >& normals ) const;
+	void skinDualQuaternionReference( const DualQuat* palette,
+		std::vector< Vector3f >& positions, std::vector< Vector3f >& normals ) const;
+
+	size_t numVertices() const { return m_numVertices; }
+
+private:
+
+	struct alignas( 16 ) Block
+	{
+		float x[ SKIN_BLOCK ];
+		float y[ SKIN_BLOCK ];
+		float z[ SKIN_BLOCK ];
+		float nx[ SKIN_BLOCK ];
+		float ny[ SKIN_BLOCK ];
+		float nz[ SKIN_BLOCK ];
+	};
+
+	// Slot k of every vertex in a block. Padding lanes and unused slots
+	// have weight 0 and joint 0.
+	struct alignas( 16 ) BlockInfluence
+	{
+		float weight[ SKIN_BLOCK ];
+		int joint[ SKIN_BLOCK ];
+	};
+
+	// Flags the blocks influenced by a joint in moved, all of them if
+	// moved is NULL
+	void markBlocks( const unsigned char* moved, std::vector< unsigned char >& marked ) const;
+
+	// The block loops skip blocks b with marked[ b ] == 0
+	void linearBlocks( const SkinMatrix* palette, std::vector< Vector3f >& positions,
+		std::vector< Vector3f >& normals, const unsigned char* marked,
+		size_t begin, size_t end ) const;
+	void linearBlocksReference( const SkinMatrix* palette,
+		std::vector< Vector3f >& positions, std::vector< Vector3f >& normals,
+		size_t begin, size_t end ) const;
+	void dualQuaternionBlocks( const DualQuat* palette, std::vector< Vector3f >& positions,
+		std::vector< Vector3f >& normals, const unsigned char* marked,
+		size_t begin, size_t end ) const;
+	void dualQuaternionBlocksReference( const DualQuat* palette,
+		std::vector< Vector3f >& positions, std::vector< Vector3f >& normals,
+		size_t begin, size_t end ) const;
+
+	size_t m_numVertices;
+	int m_numInfluences;
+	std::vector< Block > m_blocks;
+	// m_numInfluences slots per block
+	std::vector< BlockInfluence > m_influences;
+	// blocks influenced by joint j, m_jointBlocks[ m_jointBlockStart[ j ] ..
+	// m_jointBlockStart[ j + 1 ] )
+	std::vector< size_t > m_jointBlockStart;
+	std::vector< size_t > m_jointBlocks;
+};
+
+#endif
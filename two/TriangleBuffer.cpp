@@ -0,0 +1,214 @@
+// glGenBuffers and friends are GL 1.5, only declared with this
+#define GL_GLEXT_PROTOTYPES
+#include "TriangleBuffer.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifndef WIN32
+#define TRIANGLEBUFFER_USE_VBO 1
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979f
+#endif
+
+using namespace std;
+
+TriangleList TriangleList::sphere( float radius, int slices, int stacks )
+{
+	// ( stacks + 1 ) rings of slices + 1 vertices from the +z pole down,
+	// the last vertex of a ring repeating the first
+	TriangleList s;
+	for( int i = 0; i <= stacks; ++i )
+	{
+		const float theta = float( M_PI ) * i / stacks;
+		for( int j = 0; j <= slices; ++j )
+		{
+			const float phi = 2.0f * float( M_PI ) * j / slices;
+			Vector3f n( sin( theta ) * cos( phi ), sin( theta ) * sin( phi ), cos( theta ) );
+			s.positions.push_back( radius * n );
+			s.normals.push_back( n );
+		}
+	}
+	// counter-clockwise seen from outside: south, then east
+	const int ring = slices + 1;
+	for( int i = 0; i < stacks; ++i )
+	{
+		for( int j = 0; j < slices; ++j )
+		{
+			const GLuint a = i * ring + j, b = a + ring;
+			const GLuint quad[ 6 ] = { a, b, b + 1, a, b + 1, a + 1 };
+			s.indices.insert( s.indices.end(), quad, quad + 6 );
+		}
+	}
+	return s;
+}
+
+TriangleList TriangleList::cube( float size )
+{
+	// four vertices of their own per face, so the normals stay flat
+	TriangleList c;
+	const float h = 0.5f * size;
+	for( int axis = 0; axis < 3; ++axis )
+	{
+		for( int sign = -1; sign <= 1; sign += 2 )
+		{
+			Vector3f n( 0, 0, 0 ), u( 0, 0, 0 ), v( 0, 0, 0 );
+			n[ axis ] = float( sign );
+			u[ ( axis + 1 ) % 3 ] = 1;
+			v[ ( axis + 2 ) % 3 ] = 1;
+			// u x v points along +axis, flip the winding for the -axis face
+			if( sign < 0 )
+			{
+				swap( u, v );
+			}
+			const GLuint first = c.positions.size();
+			const Vector3f corners[ 4 ] = { n - u - v, n + u - v, n + u + v, n - u + v };
+			for( int k = 0; k < 4; ++k )
+			{
+				c.positions.push_back( h * corners[ k ] );
+				c.normals.push_back( n );
+			}
+			const GLuint quad[ 6 ] = { first, first + 1, first + 2, first, first + 2, first + 3 };
+			c.indices.insert( c.indices.end(), quad, quad + 6 );
+		}
+	}
+	return c;
+}
+
+void TriangleList::instanceIndices( size_t count, vector< GLuint >& out ) const
+{
+	out.clear();
+	out.reserve( count * indices.size() );
+	for( size_t k = 0; k < count; ++k )
+	{
+		const GLuint offset = GLuint( k * positions.size() );
+		for( size_t i = 0; i < indices.size(); ++i )
+		{
+			out.push_back( offset + indices[ i ] );
+		}
+	}
+}
+
+void TriangleList::placeInstance( const Matrix4f& m, size_t k,
+	vector< Vector3f >& outPositions, vector< Vector3f >& outNormals ) const
+{
+	const size_t n = positions.size();
+	outPositions.resize( max( outPositions.size(), ( k + 1 ) * n ) );
+	outNormals.resize( max( outNormals.size(), ( k + 1 ) * n ) );
+	m.transformPoints( positions.data(), &outPositions[ k * n ], int( n ) );
+	m.transformDirections( normals.data(), &outNormals[ k * n ], int( n ) );
+}
+
+IndexBuffer::IndexBuffer() :
+	m_buffer( 0 ), m_stale( true )
+{
+}
+
+IndexBuffer::~IndexBuffer()
+{
+#ifdef TRIANGLEBUFFER_USE_VBO
+	if( m_buffer != 0 )
+	{
+		glDeleteBuffers( 1, &m_buffer );
+	}
+#endif
+}
+
+void IndexBuffer::set( const vector< GLuint >& indices )
+{
+	m_indices = indices;
+	m_stale = true;
+}
+
+const GLvoid* IndexBuffer::bind() const
+{
+#ifdef TRIANGLEBUFFER_USE_VBO
+	if( m_buffer == 0 )
+	{
+		glGenBuffers( 1, &m_buffer );
+	}
+	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, m_buffer );
+	if( m_stale )
+	{
+		glBufferData( GL_ELEMENT_ARRAY_BUFFER, m_indices.size() * sizeof( GLuint ),
+			m_indices.data(), GL_STATIC_DRAW );
+		m_stale = false;
+	}
+	// offset into the bound buffer
+	return NULL;
+#else
+	return m_indices.data();
+#endif
+}
+
+void IndexBuffer::unbind() const
+{
+#ifdef TRIANGLEBUFFER_USE_VBO
+	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+#endif
+}
+
+TriangleBuffer::TriangleBuffer() :
+	m_verticesStale( true ), m_vertexBuffer( 0 )
+{
+}
+
+TriangleBuffer::~TriangleBuffer()
+{
+#ifdef TRIANGLEBUFFER_USE_VBO
+	if( m_vertexBuffer != 0 )
+	{
+		glDeleteBuffers( 1, &m_vertexBuffer );
+	}
+#endif
+}
+
+void TriangleBuffer::draw( const IndexBuffer& indices, const vector< Vector3f >& positions,
+	const vector< Vector3f >& normals )
+{
+	if( indices.size() == 0 )
+	{
+		return;
+	}
+	// Vector3f may be padded to four floats (VECMATH_SIMD), so the
+	// arrays use its size as the stride
+	const GLsizei stride = sizeof( Vector3f );
+	const size_t bytes = positions.size() * sizeof( Vector3f );
+#ifdef TRIANGLEBUFFER_USE_VBO
+	if( m_vertexBuffer == 0 )
+	{
+		glGenBuffers( 1, &m_vertexBuffer );
+	}
+	glBindBuffer( GL_ARRAY_BUFFER, m_vertexBuffer );
+	if( m_verticesStale )
+	{
+		// orphan the old storage instead of waiting for the GPU to
+		// finish with it
+		glBufferData( GL_ARRAY_BUFFER, 2 * bytes, NULL, GL_STREAM_DRAW );
+		glBufferSubData( GL_ARRAY_BUFFER, 0, bytes, positions.data() );
+		glBufferSubData( GL_ARRAY_BUFFER, bytes, bytes, normals.data() );
+		m_verticesStale = false;
+	}
+	// offsets into the bound buffer
+	const GLvoid* vertexBase = NULL;
+	const GLvoid* normalBase = reinterpret_cast< const GLvoid* >( bytes );
+#else
+	const GLvoid* vertexBase = positions.data();
+	const GLvoid* normalBase = normals.data();
+	(void) bytes;
+#endif
+	const GLvoid* indexBase = indices.bind();
+	glEnableClientState( GL_VERTEX_ARRAY );
+	glEnableClientState( GL_NORMAL_ARRAY );
+	glVertexPointer( 3, GL_FLOAT, stride, vertexBase );
+	glNormalPointer( GL_FLOAT, stride, normalBase );
+	glDrawElements( GL_TRIANGLES, GLsizei( indices.size() ), GL_UNSIGNED_INT, indexBase );
+	glDisableClientState( GL_NORMAL_ARRAY );
+	glDisableClientState( GL_VERTEX_ARRAY );
+	indices.unbind();
+#ifdef TRIANGLEBUFFER_USE_VBO
+	glBindBuffer( GL_ARRAY_BUFFER, 0 );
+#endif
+}
@@ -0,0 +1,95 @@
+#ifndef TRIANGLEBUFFER_H
+#define TRIANGLEBUFFER_H
+
+#include <cstddef>
+#include <vector>
+#include <vecmath.h>
+#ifdef WIN32
+#include "GL/freeglut.h"
+#else
+#include <GL/glut.h>
+#endif
+
+// Indexed triangles with one normal per vertex
+struct TriangleList
+{
+	std::vector< Vector3f > positions;
+	std::vector< Vector3f > normals;
+	std::vector< GLuint > indices;
+
+	// Same layout as glutSolidSphere( radius, slices, stacks )
+	static TriangleList sphere( float radius, int slices, int stacks );
+	// Same as glutSolidCube( size ), centered on the origin
+	static TriangleList cube( float size );
+
+	// Indices of count copies of this list, copy k using vertices
+	// [ k * n, ( k + 1 ) * n ) where n = positions.size()
+	void instanceIndices( size_t count, std::vector< GLuint >& out ) const;
+
+	// Writes copy k of this list, transformed by m, to the vertex range
+	// instanceIndices() gave it. Normals go through m as directions, which
+	// is right for rotations and for scalings along the axes of the
+	// faces; GL_NORMALIZE takes care of their length.
+	void placeInstance( const Matrix4f& m, size_t k,
+		std::vector< Vector3f >& outPositions, std::vector< Vector3f >& outNormals ) const;
+};
+
+// GL objects below are created by their first draw, so the other calls
+// do not need a current context. On WIN32, where opengl32 only exports
+// GL 1.1, the same calls draw from client-side arrays instead.
+
+// Static index buffer: 0-based vertex indices, three per triangle,
+// uploaded once. Any number of TriangleBuffers with the same topology
+// can draw with one IndexBuffer.
+class IndexBuffer
+{
+public:
+	IndexBuffer();
+	~IndexBuffer();
+
+	void set( const std::vector< GLuint >& indices );
+	size_t size() const { return m_indices.size(); }
+
+	// Binds the buffer, uploading it the first time, and returns the
+	// indices argument for glDrawElements
+	const GLvoid* bind() const;
+	void unbind() const;
+
+private:
+	IndexBuffer( const IndexBuffer& );
+	IndexBuffer& operator=( const IndexBuffer& );
+
+	std::vector< GLuint > m_indices;
+	// created by the first bind(), which a const IndexBuffer allows
+	mutable GLuint m_buffer;
+	mutable bool m_stale;
+};
+
+// Triangles drawn from GL buffer objects in one glDrawElements call: the
+// indices of an IndexBuffer and one vertex buffer of this object holding
+// all positions followed by all normals, streamed again whenever
+// invalidate() was called.
+class TriangleBuffer
+{
+public:
+	TriangleBuffer();
+	~TriangleBuffer();
+
+	// The vertex data changed since the last draw()
+	void invalidate() { m_verticesStale = true; }
+
+	// Draws indices with positions[ i ] and normals[ i ] as vertex i.
+	// They must stay the same vectors, and the same size, until the
+	// next invalidate().
+	void draw( const IndexBuffer& indices, const std::vector< Vector3f >& positions,
+		const std::vector< Vector3f >& normals );
+
+private:
+	TriangleBuffer( const TriangleBuffer& );
+	TriangleBuffer& operator=( const TriangleBuffer& );
+
+	bool m_verticesStale;
+	GLuint m_vertexBuffer;
+};
+
+#endif
@@ -0,0 +1,92 @@
+// Converts skin weights to the quantized binary format:
+//
+//   a2attachb [-bits 8|16] PREFIX...
+//
+// reads PREFIX.skel for the number of joints and PREFIX.attach, and
+// writes PREFIX.attachb with 16 bit weights (the default) or 8 bit ones
+// (see AttachLoader.h). The viewer, a2bench and a2bake load that instead
+// of PREFIX.attach when it exists (see Rig::attachmentsFile()). Every
+// PREFIX reports the size of both files and the largest difference of a
+// weight read back from PREFIX.attachb.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <AttachLoader.h>
+
+#include "Rig.h"
+
+using namespace std;
+
+namespace
+{
+	long fileSize( const string& filename )
+	{
+		FILE* fp = fopen( filename.c_str(), "rb" );
+		if( !fp )
+		{
+			return -1;
+		}
+		fseek( fp, 0, SEEK_END );
+		const long size = ftell( fp );
+		fclose( fp );
+		return size;
+	}
+}
+
+int main( int argc, char* argv[] )
+{
+	int bits = 16;
+	vector< string > prefixes;
+	for( int i = 1; i < argc; ++i )
+	{
+		if( strcmp( argv[ i ], "-bits" ) == 0 && i + 1 < argc )
+		{
+			bits = atoi( argv[ ++i ] );
+		}
+		else
+		{
+			prefixes.push_back( argv[ i ] );
+		}
+	}
+	if( prefixes.empty() || ( bits != 8 && bits != 16 ) )
+	{
+		printf( "Usage: %s [-bits 8|16] PREFIX...\n", argv[ 0 ] );
+		return -1;
+	}
+
+	int result = 0;
+	for( size_t m = 0; m != prefixes.size(); ++m )
+	{
+		const string& prefix = prefixes[ m ];
+		const string textFile = prefix + ".attach", binaryFile = prefix + ".attachb";
+		Rig rig;
+		rig.loadSkeleton( ( prefix + ".skel" ).c_str() );
+		const int numJoints = int( rig.numJoints() );
+		AttachLoader text, binary;
+		if( numJoints == 0 ||
+			!text.load( textFile.c_str(), numJoints, MAX_INFLUENCES ) ||
+			!text.writeBinary( binaryFile.c_str(), numJoints, bits ) ||
+			!binary.loadBinary( binaryFile.c_str(), numJoints ) ||
+			binary.joints != text.joints )
+		{
+			printf( "Failed to convert %s\n", prefix.c_str() );
+			result = -1;
+			continue;
+		}
+		float maxError = 0;
+		for( size_t s = 0; s != text.weights.size(); ++s )
+		{
+			maxError = max( maxError, fabs( binary.weights[ s ] - text.weights[ s ] ) );
+		}
+		printf( "%-24s %zu vertices, %d influences: %ld bytes --> %ld bytes, largest error %g\n",
+			prefix.c_str(), text.numVertices(), text.influenceCount,
+			fileSize( textFile ), fileSize( binaryFile ), maxError );
+	}
+	return result;
+}
@@ -0,0 +1,141 @@
+// Headless clip baker, no FLTK and no window:
+//
+//   a2bake [-fps N] [-slerp] [-threads N] PREFIX CLIP OUTPREFIX
+//
+// loads PREFIX.skel, PREFIX.obj and PREFIX.attach (or .attachb), plays
+// CLIP (a .anim file, see AnimationClip.h) once at N frames per second
+// (30 by default) and writes the skinned mesh of every frame to
+// OUTPREFIX_0000.obj, OUTPREFIX_0001.obj, ... with vertex normals.
+// Poses are interpolated with squad like the viewer does, or with slerp.
+// All poses are sampled in one batch, then skinned a group of frames at
+// a time, one model sharing the rig per frame of the group.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "AnimationClip.h"
+#include "SkeletalModel.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+namespace
+{
+	// Frames skinned together by SkeletalModel::updateMeshes()
+	const size_t GROUP_FRAMES = 16;
+
+	bool writeObj( const char* filename, const Mesh& mesh, const SkinnedMesh& skinned )
+	{
+		FILE* fp = fopen( filename, "w" );
+		if( !fp )
+		{
+			return false;
+		}
+		for( size_t i = 0; i != skinned.currentVertices.size(); ++i )
+		{
+			const Vector3f& v = skinned.currentVertices[ i ];
+			fprintf( fp, "v %f %f %f\n", v.x(), v.y(), v.z() );
+		}
+		for( size_t i = 0; i != skinned.currentNormals.size(); ++i )
+		{
+			const Vector3f& n = skinned.currentNormals[ i ];
+			fprintf( fp, "vn %f %f %f\n", n.x(), n.y(), n.z() );
+		}
+		for( size_t i = 0; i != mesh.faces.size(); ++i )
+		{
+			const Tuple3u& f = mesh.faces[ i ];
+			fprintf( fp, "f %u//%u %u//%u %u//%u\n", f[ 0 ], f[ 0 ], f[ 1 ], f[ 1 ], f[ 2 ], f[ 2 ] );
+		}
+		return fclose( fp ) == 0;
+	}
+}
+
+int main( int argc, char* argv[] )
+{
+	float fps = 30.0f;
+	ClipInterpolation interpolation = CLIP_SQUAD;
+	unsigned numThreads = 0;
+	vector< string > args;
+	for( int i = 1; i < argc; ++i )
+	{
+		if( !strcmp( argv[ i ], "-fps" ) && i + 1 < argc )
+		{
+			fps = float( atof( argv[ ++i ] ) );
+		}
+		else if( !strcmp( argv[ i ], "-slerp" ) )
+		{
+			interpolation = CLIP_SLERP;
+		}
+		else if( !strcmp( argv[ i ], "-threads" ) && i + 1 < argc )
+		{
+			numThreads = atoi( argv[ ++i ] );
+		}
+		else
+		{
+			args.push_back( argv[ i ] );
+		}
+	}
+	if( args.size() != 3 || fps <= 0 )
+	{
+		printf( "Usage: %s [-fps N] [-slerp] [-threads N] PREFIX CLIP OUTPREFIX\n", argv[ 0 ] );
+		return -1;
+	}
+	const string& prefix = args[ 0 ];
+
+	shared_ptr< const AnimationClip > clip = AnimationClip::load( args[ 1 ].c_str() );
+	if( !clip )
+	{
+		printf( "Failed to load clip %s\n", args[ 1 ].c_str() );
+		return -1;
+	}
+	ThreadPool pool( numThreads );
+	shared_ptr< const Rig > rig = Rig::load( ( prefix + ".skel" ).c_str(),
+		( prefix + ".obj" ).c_str(), Rig::attachmentsFile( prefix ).c_str() );
+
+	// one loop of the clip, without the last key that repeats the first
+	const size_t numFrames = max( size_t( 1 ),
+		size_t( ( clip->endTime() - clip->startTime() ) * fps + 0.5f ) );
+	vector< Pose > poses( numFrames );
+	vector< ClipSample > samples( numFrames );
+	for( size_t f = 0; f != numFrames; ++f )
+	{
+		ClipSample sample = { clip.get(), clip->startTime() + f / fps, &poses[ f ] };
+		samples[ f ] = sample;
+	}
+	AnimationClip::sampleBatch( samples.data(), numFrames, interpolation, &pool );
+
+	vector< unique_ptr< SkeletalModel > > instances;
+	vector< SkeletalModel* > models;
+	for( size_t i = 0; i != min( numFrames, GROUP_FRAMES ); ++i )
+	{
+		instances.push_back( unique_ptr< SkeletalModel >( new SkeletalModel( rig, &pool ) ) );
+		models.push_back( instances.back().get() );
+	}
+	for( size_t first = 0; first < numFrames; first += models.size() )
+	{
+		const size_t count = min( models.size(), numFrames - first );
+		for( size_t i = 0; i != count; ++i )
+		{
+			models[ i ]->setPose( poses[ first + i ] );
+			models[ i ]->updateCurrentJointToWorldTransforms();
+		}
+		SkeletalModel::updateMeshes( models.data(), count, &pool );
+		for( size_t i = 0; i != count; ++i )
+		{
+			char filename[ 1024 ];
+			snprintf( filename, sizeof( filename ), "%s_%04u.obj", args[ 2 ].c_str(), unsigned( first + i ) );
+			if( !writeObj( filename, rig->mesh, models[ i ]->skinnedMesh() ) )
+			{
+				printf( "Failed to write %s\n", filename );
+				return -1;
+			}
+		}
+	}
+	printf( "%u frames, %zu vertices each\n", unsigned( numFrames ), rig->mesh.bindVertices.size() );
+	return 0;
+}
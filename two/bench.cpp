@@ -0,0 +1,276 @@
+// Headless skinning benchmark, no FLTK and no window:
+//
+//   a2bench [-frames N] [-threads N] [-instances N]
+//           [-pos FILE]... [-clip FILE] PREFIX...
+//
+// loads PREFIX.skel, PREFIX.obj and PREFIX.attach (or .attachb) for every
+// PREFIX and skins the same poses with linear blend and with dual
+// quaternion skinning. -threads 0 (the default) uses one thread per hardware thread.
+// -instances N animates N models sharing the rig, each in its own pose,
+// and skins them together with SkeletalModel::updateMeshes().
+//
+// The poses are random unless recorded ones are given: -pos plays the
+// slider values saved by the viewer (File > Save), one file per frame
+// and cycled over the frames; -clip plays a .anim clip at 30 frames per
+// second.
+//
+// Every line reports the time per frame of forward kinematics (posing
+// the joints included), of the skinning palette and of skinning, the
+// skinning throughput, and a checksum of the skinned vertices of the
+// last frame to compare between changes and machines.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "AnimationClip.h"
+#include "SkeletalModel.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+namespace
+{
+	typedef chrono::steady_clock Clock;
+
+	// Frame rate of -clip
+	const float CLIP_FPS = 30.0f;
+
+	double msSince( Clock::time_point t0 )
+	{
+		return chrono::duration< double, milli >( Clock::now() - t0 ).count();
+	}
+
+	// The poses of the frames, either slider values like the viewer sets
+	// them (three angles per joint, then the root translation) or
+	// sampled from a clip
+	struct PoseSequence
+	{
+		size_t numJoints;
+		// ( numJoints + 1 ) * 3 per pose
+		vector< float > sliders;
+		// used instead of sliders if not empty
+		vector< Pose > poses;
+
+		size_t size() const
+		{
+			return poses.empty() ? sliders.size() / ( ( numJoints + 1 ) * 3 ) : poses.size();
+		}
+
+		void apply( size_t i, SkeletalModel& model ) const
+		{
+			if( !poses.empty() )
+			{
+				model.setPose( poses[ i ] );
+				return;
+			}
+			const float* a = &sliders[ i * ( numJoints + 1 ) * 3 ];
+			const float* t = a + numJoints * 3;
+			model.setRootTranslation( t[ 0 ], t[ 1 ], t[ 2 ] );
+			for( size_t j = 0; j != numJoints; ++j )
+			{
+				model.setJointTransform( int( j ), a[ 3 * j ], a[ 3 * j + 1 ], a[ 3 * j + 2 ] );
+			}
+		}
+	};
+
+	// Three angles in [ -1, 1 ] radians per joint and frame, the same
+	// sequence on every run
+	void randomPoses( size_t numFrames, PoseSequence& seq )
+	{
+		seq.sliders.assign( numFrames * ( seq.numJoints + 1 ) * 3, 0.0f );
+		srand( 6837 );
+		for( size_t f = 0; f != numFrames; ++f )
+		{
+			float* a = &seq.sliders[ f * ( seq.numJoints + 1 ) * 3 ];
+			for( size_t i = 0; i != seq.numJoints * 3; ++i )
+			{
+				a[ i ] = 2.0f * rand() / RAND_MAX - 1.0f;
+			}
+		}
+	}
+
+	// A .pos file holds "index value" lines for every slider of the
+	// viewer: the angles of all models, then their root translations.
+	// Only the first model is used.
+	bool loadPos( const char* filename, PoseSequence& seq )
+	{
+		ifstream ifs( filename );
+		vector< float > values;
+		int index;
+		float value;
+		while( ifs >> index >> value )
+		{
+			if( index >= 0 )
+			{
+				values.resize( max( values.size(), size_t( index ) + 1 ), 0.0f );
+				values[ index ] = value;
+			}
+		}
+		const size_t perModel = ( seq.numJoints + 1 ) * 3;
+		const size_t numModels = values.size() / perModel;
+		if( numModels == 0 )
+		{
+			return false;
+		}
+		seq.sliders.insert( seq.sliders.end(), values.begin(), values.begin() + seq.numJoints * 3 );
+		const size_t t = numModels * seq.numJoints * 3;
+		seq.sliders.insert( seq.sliders.end(), values.begin() + t, values.begin() + t + 3 );
+		return true;
+	}
+}
+
+int main( int argc, char* argv[] )
+{
+	int numFrames = 200;
+	unsigned numThreads = 0;
+	int numInstances = 1;
+	vector< string > posFiles;
+	string clipFile;
+	vector< string > prefixes;
+	for( int i = 1; i < argc; ++i )
+	{
+		if( !strcmp( argv[ i ], "-frames" ) && i + 1 < argc )
+		{
+			numFrames = atoi( argv[ ++i ] );
+		}
+		else if( !strcmp( argv[ i ], "-threads" ) && i + 1 < argc )
+		{
+			numThreads = atoi( argv[ ++i ] );
+		}
+		else if( !strcmp( argv[ i ], "-instances" ) && i + 1 < argc )
+		{
+			numInstances = atoi( argv[ ++i ] );
+		}
+		else if( !strcmp( argv[ i ], "-pos" ) && i + 1 < argc )
+		{
+			posFiles.push_back( argv[ ++i ] );
+		}
+		else if( !strcmp( argv[ i ], "-clip" ) && i + 1 < argc )
+		{
+			clipFile = argv[ ++i ];
+		}
+		else
+		{
+			prefixes.push_back( argv[ i ] );
+		}
+	}
+	if( prefixes.empty() || numFrames <= 0 || numInstances <= 0 ||
+		( !posFiles.empty() && !clipFile.empty() ) )
+	{
+		printf( "Usage: %s [-frames N] [-threads N] [-instances N] "
+			"[-pos FILE]... [-clip FILE] PREFIX...\n", argv[ 0 ] );
+		return -1;
+	}
+	shared_ptr< const AnimationClip > clip;
+	if( !clipFile.empty() )
+	{
+		clip = AnimationClip::load( clipFile.c_str() );
+		if( !clip )
+		{
+			printf( "Failed to load clip %s\n", clipFile.c_str() );
+			return -1;
+		}
+	}
+
+	ThreadPool pool( numThreads );
+	printf( "threads %u, %d frames, %d instances, %s poses\n", pool.size(), numFrames,
+		numInstances, clip ? clipFile.c_str() : posFiles.empty() ? "random" : "recorded" );
+	printf( "%-24s %-4s %9s %9s %9s %10s %16s\n", "model", "mode",
+		"fk ms", "pal ms", "skin ms", "Mverts/s", "checksum" );
+
+	const SkinningMode modes[] = { LINEAR_BLEND_SKINNING, DUAL_QUATERNION_SKINNING };
+	const char* modeNames[] = { "lbs", "dqs" };
+	for( size_t m = 0; m != prefixes.size(); ++m )
+	{
+		const string& prefix = prefixes[ m ];
+		shared_ptr< const Rig > rig = Rig::load( ( prefix + ".skel" ).c_str(),
+			( prefix + ".obj" ).c_str(), Rig::attachmentsFile( prefix ).c_str() );
+		vector< unique_ptr< SkeletalModel > > instances;
+		vector< SkeletalModel* > models;
+		for( int i = 0; i != numInstances; ++i )
+		{
+			instances.push_back( unique_ptr< SkeletalModel >( new SkeletalModel( rig, &pool ) ) );
+			models.push_back( instances.back().get() );
+		}
+		const size_t numVertices = rig->mesh.bindVertices.size() * numInstances;
+
+		PoseSequence seq;
+		seq.numJoints = rig->numJoints();
+		if( clip )
+		{
+			const float length = clip->endTime() - clip->startTime();
+			const size_t numPoses = max( size_t( 1 ), size_t( length * CLIP_FPS + 0.5f ) );
+			seq.poses.resize( numPoses );
+			vector< ClipSample > samples( numPoses );
+			for( size_t f = 0; f != numPoses; ++f )
+			{
+				ClipSample sample = { clip.get(), clip->startTime() + f / CLIP_FPS, &seq.poses[ f ] };
+				samples[ f ] = sample;
+			}
+			AnimationClip::sampleBatch( samples.data(), numPoses, CLIP_SQUAD, &pool );
+		}
+		else if( posFiles.empty() )
+		{
+			randomPoses( numFrames, seq );
+		}
+		for( size_t p = 0; p != posFiles.size(); ++p )
+		{
+			if( !loadPos( posFiles[ p ].c_str(), seq ) )
+			{
+				printf( "Failed to load poses %s\n", posFiles[ p ].c_str() );
+				return -1;
+			}
+		}
+		const size_t numPoses = seq.size();
+
+		for( int k = 0; k != 2; ++k )
+		{
+			double fkMs = 0, paletteMs = 0, skinMs = 0;
+			for( int i = 0; i != numInstances; ++i )
+			{
+				models[ i ]->setSkinningMode( modes[ k ] );
+			}
+			for( int f = 0; f != numFrames; ++f )
+			{
+				// instance i plays the poses i frames ahead
+				Clock::time_point t0 = Clock::now();
+				for( int i = 0; i != numInstances; ++i )
+				{
+					seq.apply( ( f + i ) % numPoses, *models[ i ] );
+					models[ i ]->updateWorldTransforms();
+				}
+				fkMs += msSince( t0 );
+				t0 = Clock::now();
+				for( int i = 0; i != numInstances; ++i )
+				{
+					models[ i ]->updateSkinningPalette();
+				}
+				paletteMs += msSince( t0 );
+				t0 = Clock::now();
+				SkeletalModel::updateMeshes( models.data(), models.size(), &pool );
+				skinMs += msSince( t0 );
+			}
+
+			double checksum = 0;
+			for( int i = 0; i != numInstances; ++i )
+			{
+				const vector< Vector3f >& v = models[ i ]->skinnedMesh().currentVertices;
+				for( size_t n = 0; n != v.size(); ++n )
+				{
+					checksum += double( v[ n ].x() ) + v[ n ].y() + v[ n ].z();
+				}
+			}
+			printf( "%-24s %-4s %9.4f %9.4f %9.4f %10.2f %16.6f\n", prefix.c_str(), modeNames[ k ],
+				fkMs / numFrames, paletteMs / numFrames, skinMs / numFrames,
+				numVertices * numFrames / ( skinMs * 1e3 ), checksum );
+		}
+	}
+	return 0;
+}
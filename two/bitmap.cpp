@@ -71,19 +71,23 @@ unsigned char *readBMP(char *fname, int &width, int &height)
     // shuffle bitmap data such that it is (R,G,B) tuples in row-major order
     int i, j;
     j = 0;
-    unsigned char temp;
+    unsigned char r, g, b;
     unsigned char *in;
     unsigned char *out;
 
     in = data;
     out = data;
 
+    // once rows are padded out trails in, so in is read before out is
+    // written
     for (j = 0; j < height; ++j) {
 	for (i = 0; i < width; ++i) {
-	    out[1] = in[1];
-	    temp = in[2];
-	    out[2] = in[0];
-	    out[0] = temp;
+	    b = in[0];
+	    g = in[1];
+	    r = in[2];
+	    out[0] = r;
+	    out[1] = g;
+	    out[2] = b;
 
 	    in += 3;
 	    out += 3;
@@ -94,60 +98,119 @@ unsigned char *readBMP(char *fname, int &width, int &height)
     return data;
 }
 
-void writeBMP(char *iname, int width, int height, unsigned char *data)
+static void put16(std::vector<unsigned char> &out, unsigned value)
 {
-    int bytes, pad;
-    bytes = width * 3;
-    pad = (bytes % 4) ? 4 - (bytes % 4) : 0;
-    bytes += pad;
-    bytes *= height;
-
-    bmfh.bfType = 0x4d42;	// "BM"
-    bmfh.bfSize =
-	sizeof(BMP_BITMAPFILEHEADER) + sizeof(BMP_BITMAPINFOHEADER) +
-	bytes;
-    bmfh.bfReserved1 = 0;
-    bmfh.bfReserved2 = 0;
-    bmfh.bfOffBits =		/*hack sizeof(BMP_BITMAPFILEHEADER)=14, sizeof doesn't work? */
-	14 + sizeof(BMP_BITMAPINFOHEADER);
-
-    bmih.biSize = sizeof(BMP_BITMAPINFOHEADER);
-    bmih.biWidth = width;
-    bmih.biHeight = height;
-    bmih.biPlanes = 1;
-    bmih.biBitCount = 24;
-    bmih.biCompression = BMP_BI_RGB;
-    bmih.biSizeImage = 0;
-    bmih.biXPelsPerMeter = (int) (100 / 2.54 * 72);
-    bmih.biYPelsPerMeter = (int) (100 / 2.54 * 72);
-    bmih.biClrUsed = 0;
-    bmih.biClrImportant = 0;
-
-    // "w+b", not "wb" -- Eugene
-    FILE *foo = fopen(iname, "w+b");
-
-    //      fwrite(&bmfh, sizeof(BMP_BITMAPFILEHEADER), 1, foo);
-    fwrite(&(bmfh.bfType), 2, 1, foo);
-    fwrite(&(bmfh.bfSize), 4, 1, foo);
-    fwrite(&(bmfh.bfReserved1), 2, 1, foo);
-    fwrite(&(bmfh.bfReserved2), 2, 1, foo);
-    fwrite(&(bmfh.bfOffBits), 4, 1, foo);
+    out.push_back(value & 0xff);
+    out.push_back((value >> 8) & 0xff);
+}
 
-    fwrite(&bmih, sizeof(BMP_BITMAPINFOHEADER), 1, foo);
+static void put32(std::vector<unsigned char> &out, unsigned value)
+{
+    put16(out, value & 0xffff);
+    put16(out, value >> 16);
+}
 
-    bytes /= height;
-    unsigned char *scanline = new unsigned char[bytes];
+void encodeBMP(int width, int height, const unsigned char *data,
+	       std::vector<unsigned char> &out)
+{
+    int rowBytes = width * 3;
+    int pad = (rowBytes % 4) ? 4 - (rowBytes % 4) : 0;
+    // the file header is 14 bytes on disk, whatever its sizeof is
+    const unsigned headerBytes = 14 + 40;
+    const unsigned bytes = (rowBytes + pad) * height;
+
+    out.clear();
+    out.reserve(headerBytes + bytes);
+    put16(out, 0x4d42);		// "BM"
+    put32(out, headerBytes + bytes);
+    put16(out, 0);
+    put16(out, 0);
+    put32(out, headerBytes);
+
+    put32(out, 40);
+    put32(out, width);
+    put32(out, height);
+    put16(out, 1);
+    put16(out, 24);
+    put32(out, BMP_BI_RGB);
+    put32(out, 0);
+    put32(out, (int) (100 / 2.54 * 72));
+    put32(out, (int) (100 / 2.54 * 72));
+    put32(out, 0);
+    put32(out, 0);
+
+    // (B,G,R) on disk, rows padded to 4 bytes
+    out.resize(headerBytes + bytes);
+    unsigned char *scanline = &out[headerBytes];
     for (int j = 0; j < height; ++j) {
-	memcpy(scanline, data + j * 3 * width, bytes);
+	const unsigned char *in = data + j * rowBytes;
 	for (int i = 0; i < width; ++i) {
-	    unsigned char temp = scanline[i * 3];
-	    scanline[i * 3] = scanline[i * 3 + 2];
-	    scanline[i * 3 + 2] = temp;
+	    scanline[i * 3] = in[i * 3 + 2];
+	    scanline[i * 3 + 1] = in[i * 3 + 1];
+	    scanline[i * 3 + 2] = in[i * 3];
+	}
+	memset(scanline + rowBytes, 0, pad);
+	scanline += rowBytes + pad;
+    }
+}
+
+void encodeTGA(int width, int height, const unsigned char *data,
+	       std::vector<unsigned char> &out)
+{
+    out.clear();
+    out.push_back(0);		// no image id
+    out.push_back(0);		// no color map
+    out.push_back(10);		// run-length encoded true color
+    for (int k = 0; k < 5; ++k)
+	out.push_back(0);	// color map specification
+    put16(out, 0);		// origin
+    put16(out, 0);
+    put16(out, width);
+    put16(out, height);
+    out.push_back(24);
+    out.push_back(0);		// bottom row first, like BMP
+
+    // Packets of up to 128 pixels that stay within a row: a run of one
+    // repeated pixel, or a stretch of pixels stored as they are
+    for (int j = 0; j < height; ++j) {
+	const unsigned char *row = data + j * width * 3;
+	int i = 0;
+	while (i < width) {
+	    int run = 1;
+	    while (i + run < width && run < 128 &&
+		   memcmp(row + i * 3, row + (i + run) * 3, 3) == 0)
+		++run;
+	    int count = 1;
+	    if (run > 1) {
+		out.push_back(0x80 | (run - 1));
+	    } else {
+		// up to the next pixel that starts a run
+		while (i + count < width && count < 128 &&
+		       !(i + count + 1 < width &&
+			 memcmp(row + (i + count) * 3, row + (i + count + 1) * 3, 3) == 0))
+		    ++count;
+		out.push_back(count - 1);
+	    }
+	    for (int k = 0; k < count; ++k) {
+		const unsigned char *p = row + (i + k) * 3;
+		out.push_back(p[2]);
+		out.push_back(p[1]);
+		out.push_back(p[0]);
+	    }
+	    i += run > 1 ? run : count;
 	}
-	fwrite(scanline, bytes, 1, foo);
     }
+}
 
-    delete[]scanline;
+void writeBMP(char *iname, int width, int height, unsigned char *data)
+{
+    std::vector<unsigned char> file;
+    encodeBMP(width, height, data, file);
 
+    // "w+b", not "wb" -- Eugene
+    FILE *foo = fopen(iname, "w+b");
+    if (!foo)
+	return;
+    fwrite(file.data(), file.size(), 1, foo);
     fclose(foo);
 }
@@ -10,6 +10,7 @@
   
 #include <cstdio>
 #include <cstring>
+#include <vector>
   
 #define BMP_BI_RGB        0L
 typedef unsigned short BMP_WORD;
@@ -43,4 +44,14 @@ extern unsigned char *readBMP (char *fname, int &width, int &height);
 extern void writeBMP (char *iname, int width, int height,
                       unsigned char *data);
 
+// The whole file for an image of (R,G,B) tuples in row-major order,
+// bottom row first, as readBMP() returns it. These touch no globals, so
+// any thread may call them.
+extern void encodeBMP (int width, int height, const unsigned char *data,
+                       std::vector<unsigned char> &out);
+// The same as a run-length encoded 24 bit TGA file (image type 10),
+// much smaller for renderings with a flat background
+extern void encodeTGA (int width, int height, const unsigned char *data,
+                       std::vector<unsigned char> &out);
+
 #endif
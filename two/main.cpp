@@ -17,6 +17,7 @@
 
 #include "modelerapp.h"
 #include "ModelerView.h"
+#include "Trace.h"
 
 using namespace std;
 
@@ -82,6 +83,10 @@ int main( int argc, char* argv[] )
 	);
 
     // Run the modeler application.
+#ifdef TRACE
+    // 't' in the view writes it on demand
+    Trace::writeAtExit( "a2_trace.json" );
+#endif
     int ret = ModelerApplication::Instance()->Run();
 
     // This line is reached when you close the program.
@@ -0,0 +1,160 @@
+// Headless clip renderer, no FLTK and no GL context:
+//
+//   a2render [-size WxH] [-fps N] [-slerp] [-threads N] PREFIX CLIP OUTPREFIX
+//
+// loads PREFIX.skel, PREFIX.obj and PREFIX.attach (or .attachb), plays
+// CLIP (a .anim file, see AnimationClip.h) once at N frames per second
+// (30 by default) and renders the skinned mesh of every frame with
+// SoftRasterizer, as the viewer shows it with its initial camera, to
+// OUTPREFIX_0000.bmp, OUTPREFIX_0001.bmp, ... (640x480 by default).
+// Poses are sampled and skinned in groups of frames as in a2bake.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "AnimationClip.h"
+#include "SkeletalModel.h"
+#include "SoftRasterizer.h"
+#include "ThreadPool.h"
+#include "bitmap.h"
+#include "camera.h"
+
+using namespace std;
+
+namespace
+{
+	// Frames skinned together by SkeletalModel::updateMeshes()
+	const size_t GROUP_FRAMES = 16;
+}
+
+int main( int argc, char* argv[] )
+{
+	int width = 640;
+	int height = 480;
+	float fps = 30.0f;
+	ClipInterpolation interpolation = CLIP_SQUAD;
+	unsigned numThreads = 0;
+	vector< string > args;
+	for( int i = 1; i < argc; ++i )
+	{
+		if( !strcmp( argv[ i ], "-size" ) && i + 1 < argc )
+		{
+			if( sscanf( argv[ ++i ], "%dx%d", &width, &height ) != 2 )
+			{
+				width = 0;
+			}
+		}
+		else if( !strcmp( argv[ i ], "-fps" ) && i + 1 < argc )
+		{
+			fps = float( atof( argv[ ++i ] ) );
+		}
+		else if( !strcmp( argv[ i ], "-slerp" ) )
+		{
+			interpolation = CLIP_SLERP;
+		}
+		else if( !strcmp( argv[ i ], "-threads" ) && i + 1 < argc )
+		{
+			numThreads = atoi( argv[ ++i ] );
+		}
+		else
+		{
+			args.push_back( argv[ i ] );
+		}
+	}
+	if( args.size() != 3 || fps <= 0 || width <= 0 || height <= 0 )
+	{
+		printf( "Usage: %s [-size WxH] [-fps N] [-slerp] [-threads N] PREFIX CLIP OUTPREFIX\n", argv[ 0 ] );
+		return -1;
+	}
+	const string& prefix = args[ 0 ];
+
+	shared_ptr< const AnimationClip > clip = AnimationClip::load( args[ 1 ].c_str() );
+	if( !clip )
+	{
+		printf( "Failed to load clip %s\n", args[ 1 ].c_str() );
+		return -1;
+	}
+	ThreadPool pool( numThreads );
+	shared_ptr< const Rig > rig = Rig::load( ( prefix + ".skel" ).c_str(),
+		( prefix + ".obj" ).c_str(), Rig::attachmentsFile( prefix ).c_str() );
+	const Mesh& mesh = rig->mesh;
+	vector< unsigned > indices;
+	indices.reserve( 3 * mesh.faces.size() );
+	for( size_t i = 0; i != mesh.faces.size(); ++i )
+	{
+		for( int k = 0; k != 3; ++k )
+		{
+			indices.push_back( mesh.faces[ i ][ k ] - 1 );
+		}
+	}
+
+	// the camera and lighting of ModelerView
+	Camera camera;
+	camera.SetDimensions( width, height );
+	camera.SetViewport( 0, 0, width, height );
+	camera.SetPerspective( 50.0f );
+	camera.SetDistance( 2 );
+	camera.SetCenter( Vector3f( 0.5, 0.5, 0.5 ) );
+	SoftRasterizer raster( width, height, numThreads );
+	raster.setProjection( camera.projectionMatrix() );
+	raster.setModelView( camera.viewMatrix() );
+
+	// one loop of the clip, without the last key that repeats the first
+	const size_t numFrames = max( size_t( 1 ),
+		size_t( ( clip->endTime() - clip->startTime() ) * fps + 0.5f ) );
+	vector< Pose > poses( numFrames );
+	vector< ClipSample > samples( numFrames );
+	for( size_t f = 0; f != numFrames; ++f )
+	{
+		ClipSample sample = { clip.get(), clip->startTime() + f / fps, &poses[ f ] };
+		samples[ f ] = sample;
+	}
+	AnimationClip::sampleBatch( samples.data(), numFrames, interpolation, &pool );
+
+	vector< unique_ptr< SkeletalModel > > instances;
+	vector< SkeletalModel* > models;
+	for( size_t i = 0; i != min( numFrames, GROUP_FRAMES ); ++i )
+	{
+		instances.push_back( unique_ptr< SkeletalModel >( new SkeletalModel( rig, &pool ) ) );
+		models.push_back( instances.back().get() );
+	}
+	// one BMP file, reused for every frame
+	vector< unsigned char > file;
+	for( size_t first = 0; first < numFrames; first += models.size() )
+	{
+		const size_t count = min( models.size(), numFrames - first );
+		for( size_t i = 0; i != count; ++i )
+		{
+			models[ i ]->setPose( poses[ first + i ] );
+			models[ i ]->updateCurrentJointToWorldTransforms();
+		}
+		SkeletalModel::updateMeshes( models.data(), count, &pool );
+		for( size_t i = 0; i != count; ++i )
+		{
+			const SkinnedMesh& skinned = models[ i ]->skinnedMesh();
+			raster.clear( 0, 0, 0 );
+			raster.drawTriangles( &skinned.currentVertices[ 0 ], &skinned.currentNormals[ 0 ], sizeof( Vector3f ),
+				skinned.currentVertices.size(), indices.data(), mesh.faces.size() );
+
+			// encodeBMP() rather than writeBMP(), which cannot fail
+			char filename[ 1024 ];
+			snprintf( filename, sizeof( filename ), "%s_%04u.bmp", args[ 2 ].c_str(), unsigned( first + i ) );
+			encodeBMP( width, height, raster.pixels(), file );
+			FILE* fp = fopen( filename, "wb" );
+			bool ok = fp && fwrite( file.data(), file.size(), 1, fp ) == 1;
+			ok = fp && fclose( fp ) == 0 && ok;
+			if( !ok )
+			{
+				printf( "Failed to write %s\n", filename );
+				return -1;
+			}
+		}
+	}
+	printf( "%u frames of %dx%d, %zu triangles each\n", unsigned( numFrames ), width, height, mesh.faces.size() );
+	return 0;
+}
@@ -2,15 +2,17 @@
 #define MATRIX4F_H
 
 #include <cstdio>
+#include <cstring>
+
+#include "vecmath_simd.h"
+#include "Vector4f.h"
 
 class Matrix2f;
 class Matrix3f;
 class Quat4f;
-class Vector3f;
-class Vector4f;
 
 // 4x4 Matrix, stored in column major order (OpenGL style)
-class Matrix4f
+class VECMATH_ALIGN Matrix4f
 {
 public:
 
@@ -59,9 +61,37 @@ public:
 	float determinant() const;
 	Matrix4f inverse( bool* pbIsSingular = NULL, float epsilon = 0.f ) const;
 
+	// Inverses of transforms whose last row is ( 0 0 0 1 ), much cheaper
+	// than inverse(). Builds with DEBUG defined assert that the matrix
+	// has that form.
+
+	// Affine: the upper left 3x3 block A is inverted on its own and the
+	// translation t becomes -A^-1 t
+	Matrix4f inverseAffine( bool* pbIsSingular = NULL, float epsilon = 0.f ) const;
+	// Rigid (rotation and translation): A^-1 is A transposed, asserted
+	// with Matrix3f::isOrthonormal()
+	Matrix4f inverseRigid() const;
+
 	void transpose();
 	Matrix4f transposed() const;
 
+	// ---- Batch transforms ----
+	// Transform n xyz triples from in to out (which may be the same
+	// array). Consecutive triples are inStride / outStride floats apart.
+
+	// points: w = 1, no perspective divide
+	void transformPoints( const float* in, float* out, int n, int inStride = 3, int outStride = 3 ) const;
+	void transformPoints( const Vector3f* in, Vector3f* out, int n ) const;
+
+	// directions: w = 0
+	void transformDirections( const float* in, float* out, int n, int inStride = 3, int outStride = 3 ) const;
+	void transformDirections( const Vector3f* in, Vector3f* out, int n ) const;
+
+	// normals: multiplied by the inverse transpose of the upper left 3x3
+	// block, not renormalized
+	void transformNormals( const float* in, float* out, int n, int inStride = 3, int outStride = 3 ) const;
+	void transformNormals( const Vector3f* in, Vector3f* out, int n ) const;
+
 	// ---- Utility ----
 	operator float* (); // automatic type conversion for GL
 	operator const float* () const; // automatic type conversion for GL
@@ -106,4 +136,154 @@ Vector4f operator * ( const Matrix4f& m, const Vector4f& v );
 // Matrix-Matrix multiplication
 Matrix4f operator * ( const Matrix4f& x, const Matrix4f& y );
 
+//////////////////////////////////////////////////////////////////////////
+// Inline definitions
+//////////////////////////////////////////////////////////////////////////
+
+inline Matrix4f::Matrix4f( float fill )
+{
+	for( int i = 0; i < 16; ++i )
+	{
+		m_elements[ i ] = fill;
+	}
+}
+
+inline Matrix4f::Matrix4f( const Matrix4f& rm )
+{
+	memcpy( m_elements, rm.m_elements, 16 * sizeof( float ) );
+}
+
+inline Matrix4f& Matrix4f::operator = ( const Matrix4f& rm )
+{
+	if( this != &rm )
+	{
+		memcpy( m_elements, rm.m_elements, 16 * sizeof( float ) );
+	}
+	return *this;
+}
+
+inline const float& Matrix4f::operator () ( int i, int j ) const
+{
+	return m_elements[ j * 4 + i ];
+}
+
+inline float& Matrix4f::operator () ( int i, int j )
+{
+	return m_elements[ j * 4 + i ];
+}
+
+inline Vector4f Matrix4f::getRow( int i ) const
+{
+	return Vector4f
+	(
+		m_elements[ i ],
+		m_elements[ i + 4 ],
+		m_elements[ i + 8 ],
+		m_elements[ i + 12 ]
+	);
+}
+
+inline void Matrix4f::setRow( int i, const Vector4f& v )
+{
+	m_elements[ i ] = v.x();
+	m_elements[ i + 4 ] = v.y();
+	m_elements[ i + 8 ] = v.z();
+	m_elements[ i + 12 ] = v.w();
+}
+
+inline Vector4f Matrix4f::getCol( int j ) const
+{
+	int colStart = 4 * j;
+
+	return Vector4f
+	(
+		m_elements[ colStart ],
+		m_elements[ colStart + 1 ],
+		m_elements[ colStart + 2 ],
+		m_elements[ colStart + 3 ]
+	);
+}
+
+inline void Matrix4f::setCol( int j, const Vector4f& v )
+{
+	int colStart = 4 * j;
+
+	m_elements[ colStart ] = v.x();
+	m_elements[ colStart + 1 ] = v.y();
+	m_elements[ colStart + 2 ] = v.z();
+	m_elements[ colStart + 3 ] = v.w();
+}
+
+inline Matrix4f::operator float* ()
+{
+	return m_elements;
+}
+
+inline Matrix4f::operator const float* ()const
+{
+	return m_elements;
+}
+
+inline void Matrix4f::transformPoints( const Vector3f* in, Vector3f* out, int n ) const
+{
+	const int stride = sizeof( Vector3f ) / sizeof( float );
+	transformPoints( reinterpret_cast< const float* >( in ), reinterpret_cast< float* >( out ), n, stride, stride );
+}
+
+inline void Matrix4f::transformDirections( const Vector3f* in, Vector3f* out, int n ) const
+{
+	const int stride = sizeof( Vector3f ) / sizeof( float );
+	transformDirections( reinterpret_cast< const float* >( in ), reinterpret_cast< float* >( out ), n, stride, stride );
+}
+
+inline void Matrix4f::transformNormals( const Vector3f* in, Vector3f* out, int n ) const
+{
+	const int stride = sizeof( Vector3f ) / sizeof( float );
+	transformNormals( reinterpret_cast< const float* >( in ), reinterpret_cast< float* >( out ), n, stride, stride );
+}
+
+inline Vector4f operator * ( const Matrix4f& m, const Vector4f& v )
+{
+	Vector4f output( 0, 0, 0, 0 );
+#ifdef VECMATH_USE_SSE
+	_mm_store_ps( output, vecmath_mulColumns( m, v ) );
+#else
+	for( int i = 0; i < 4; ++i )
+	{
+		for( int j = 0; j < 4; ++j )
+		{
+			output[ i ] += m( i, j ) * v[ j ];
+		}
+	}
+#endif
+
+	return output;
+}
+
+inline Matrix4f operator * ( const Matrix4f& x, const Matrix4f& y )
+{
+	Matrix4f product; // zeroes
+#ifdef VECMATH_USE_SSE
+	const float* py = y;
+	float* pp = product;
+	for( int k = 0; k < 16; k += 4 )
+	{
+		_mm_store_ps( pp + k, vecmath_mulColumns( x, py + k ) );
+	}
+#else
+	for( int i = 0; i < 4; ++i )
+	{
+		for( int j = 0; j < 4; ++j )
+		{
+			for( int k = 0; k < 4; ++k )
+			{
+				product( i, k ) += x( i, j ) * y( j, k );
+			}
+		}
+	}
+#endif
+
+	return product;
+}
+
 #endif // MATRIX4F_H
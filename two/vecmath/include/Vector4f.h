@@ -1,10 +1,14 @@
 #ifndef VECTOR_4F_H
 #define VECTOR_4F_H
 
+#include <cmath>
+
+#include "vecmath_simd.h"
+#include "Vector3f.h"
+
 class Vector2f;
-class Vector3f;
 
-class Vector4f
+class VECMATH_ALIGN Vector4f
 {
 public:
 
@@ -99,4 +103,281 @@ Vector4f operator / ( const Vector4f& v, float f );
 bool operator == ( const Vector4f& v0, const Vector4f& v1 );
 bool operator != ( const Vector4f& v0, const Vector4f& v1 );
 
+//////////////////////////////////////////////////////////////////////////
+// Inline definitions
+//////////////////////////////////////////////////////////////////////////
+
+#ifdef VECMATH_USE_SSE
+inline __m128 vecmath_load( const Vector4f& v )
+{
+	return _mm_load_ps( v );
+}
+
+inline Vector4f vecmath_store4( __m128 a )
+{
+	Vector4f out;
+	_mm_store_ps( out, a );
+	return out;
+}
+#endif
+
+inline Vector4f::Vector4f( float f )
+{
+	m_elements[ 0 ] = f;
+	m_elements[ 1 ] = f;
+	m_elements[ 2 ] = f;
+	m_elements[ 3 ] = f;
+}
+
+inline Vector4f::Vector4f( float fx, float fy, float fz, float fw )
+{
+	m_elements[0] = fx;
+	m_elements[1] = fy;
+	m_elements[2] = fz;
+	m_elements[3] = fw;
+}
+
+inline Vector4f::Vector4f( const Vector3f& xyz, float w )
+{
+	m_elements[0] = xyz.x();
+	m_elements[1] = xyz.y();
+	m_elements[2] = xyz.z();
+	m_elements[3] = w;
+}
+
+inline Vector3f Vector4f::xyz() const
+{
+	return Vector3f( m_elements[0], m_elements[1], m_elements[2] );
+}
+
+inline Vector4f::Vector4f( const Vector4f& rv )
+{
+#ifdef VECMATH_USE_SSE
+	_mm_store_ps( m_elements, _mm_load_ps( rv.m_elements ) );
+#else
+	m_elements[0] = rv.m_elements[0];
+	m_elements[1] = rv.m_elements[1];
+	m_elements[2] = rv.m_elements[2];
+	m_elements[3] = rv.m_elements[3];
+#endif
+}
+
+inline Vector4f& Vector4f::operator = ( const Vector4f& rv )
+{
+#ifdef VECMATH_USE_SSE
+	_mm_store_ps( m_elements, _mm_load_ps( rv.m_elements ) );
+#else
+	if( this != &rv )
+	{
+		m_elements[0] = rv.m_elements[0];
+		m_elements[1] = rv.m_elements[1];
+		m_elements[2] = rv.m_elements[2];
+		m_elements[3] = rv.m_elements[3];
+	}
+#endif
+	return *this;
+}
+
+inline const float& Vector4f::operator [] ( int i ) const
+{
+	return m_elements[ i ];
+}
+
+inline float& Vector4f::operator [] ( int i )
+{
+	return m_elements[ i ];
+}
+
+inline float& Vector4f::x()
+{
+	return m_elements[ 0 ];
+}
+
+inline float& Vector4f::y()
+{
+	return m_elements[ 1 ];
+}
+
+inline float& Vector4f::z()
+{
+	return m_elements[ 2 ];
+}
+
+inline float& Vector4f::w()
+{
+	return m_elements[ 3 ];
+}
+
+inline float Vector4f::x() const
+{
+	return m_elements[0];
+}
+
+inline float Vector4f::y() const
+{
+	return m_elements[1];
+}
+
+inline float Vector4f::z() const
+{
+	return m_elements[2];
+}
+
+inline float Vector4f::w() const
+{
+	return m_elements[3];
+}
+
+inline float Vector4f::abs() const
+{
+	return sqrt( m_elements[0] * m_elements[0] + m_elements[1] * m_elements[1] + m_elements[2] * m_elements[2] + m_elements[3] * m_elements[3] );
+}
+
+inline float Vector4f::absSquared() const
+{
+#ifdef VECMATH_USE_SSE
+	__m128 a = _mm_load_ps( m_elements );
+	return vecmath_hsum( _mm_mul_ps( a, a ) );
+#else
+	return( m_elements[0] * m_elements[0] + m_elements[1] * m_elements[1] + m_elements[2] * m_elements[2] + m_elements[3] * m_elements[3] );
+#endif
+}
+
+inline void Vector4f::normalize()
+{
+	float norm = sqrt( m_elements[0] * m_elements[0] + m_elements[1] * m_elements[1] + m_elements[2] * m_elements[2] + m_elements[3] * m_elements[3] );
+	m_elements[0] = m_elements[0] / norm;
+	m_elements[1] = m_elements[1] / norm;
+	m_elements[2] = m_elements[2] / norm;
+	m_elements[3] = m_elements[3] / norm;
+}
+
+inline Vector4f Vector4f::normalized() const
+{
+	float length = abs();
+	return Vector4f
+		(
+			m_elements[0] / length,
+			m_elements[1] / length,
+			m_elements[2] / length,
+			m_elements[3] / length
+		);
+}
+
+inline void Vector4f::negate()
+{
+	m_elements[0] = -m_elements[0];
+	m_elements[1] = -m_elements[1];
+	m_elements[2] = -m_elements[2];
+	m_elements[3] = -m_elements[3];
+}
+
+inline Vector4f::operator const float* () const
+{
+	return m_elements;
+}
+
+inline Vector4f::operator float* ()
+{
+	return m_elements;
+}
+
+// static
+inline float Vector4f::dot( const Vector4f& v0, const Vector4f& v1 )
+{
+#ifdef VECMATH_USE_SSE
+	return vecmath_hsum( _mm_mul_ps( vecmath_load( v0 ), vecmath_load( v1 ) ) );
+#else
+	return v0.x() * v1.x() + v0.y() * v1.y() + v0.z() * v1.z() + v0.w() * v1.w();
+#endif
+}
+
+// static
+inline Vector4f Vector4f::lerp( const Vector4f& v0, const Vector4f& v1, float alpha )
+{
+	return alpha * ( v1 - v0 ) + v0;
+}
+
+inline Vector4f operator + ( const Vector4f& v0, const Vector4f& v1 )
+{
+#ifdef VECMATH_USE_SSE
+	return vecmath_store4( _mm_add_ps( vecmath_load( v0 ), vecmath_load( v1 ) ) );
+#else
+	return Vector4f( v0.x() + v1.x(), v0.y() + v1.y(), v0.z() + v1.z(), v0.w() + v1.w() );
+#endif
+}
+
+inline Vector4f operator - ( const Vector4f& v0, const Vector4f& v1 )
+{
+#ifdef VECMATH_USE_SSE
+	return vecmath_store4( _mm_sub_ps( vecmath_load( v0 ), vecmath_load( v1 ) ) );
+#else
+	return Vector4f( v0.x() - v1.x(), v0.y() - v1.y(), v0.z() - v1.z(), v0.w() - v1.w() );
+#endif
+}
+
+inline Vector4f operator * ( const Vector4f& v0, const Vector4f& v1 )
+{
+#ifdef VECMATH_USE_SSE
+	return vecmath_store4( _mm_mul_ps( vecmath_load( v0 ), vecmath_load( v1 ) ) );
+#else
+	return Vector4f( v0.x() * v1.x(), v0.y() * v1.y(), v0.z() * v1.z(), v0.w() * v1.w() );
+#endif
+}
+
+inline Vector4f operator / ( const Vector4f& v0, const Vector4f& v1 )
+{
+#ifdef VECMATH_USE_SSE
+	return vecmath_store4( _mm_div_ps( vecmath_load( v0 ), vecmath_load( v1 ) ) );
+#else
+	return Vector4f( v0.x() / v1.x(), v0.y() / v1.y(), v0.z() / v1.z(), v0.w() / v1.w() );
+#endif
+}
+
+inline Vector4f operator - ( const Vector4f& v )
+{
+#ifdef VECMATH_USE_SSE
+	return vecmath_store4( _mm_xor_ps( vecmath_load( v ), _mm_set1_ps( -0.f ) ) );
+#else
+	return Vector4f( -v.x(), -v.y(), -v.z(), -v.w() );
+#endif
+}
+
+inline Vector4f operator * ( float f, const Vector4f& v )
+{
+#ifdef VECMATH_USE_SSE
+	return vecmath_store4( _mm_mul_ps( vecmath_load( v ), _mm_set1_ps( f ) ) );
+#else
+	return Vector4f( f * v.x(), f * v.y(), f * v.z(), f * v.w() );
+#endif
+}
+
+inline Vector4f operator * ( const Vector4f& v, float f )
+{
+#ifdef VECMATH_USE_SSE
+	return vecmath_store4( _mm_mul_ps( vecmath_load( v ), _mm_set1_ps( f ) ) );
+#else
+	return Vector4f( f * v.x(), f * v.y(), f * v.z(), f * v.w() );
+#endif
+}
+
+inline Vector4f operator / ( const Vector4f& v, float f )
+{
+#ifdef VECMATH_USE_SSE
+	return vecmath_store4( _mm_div_ps( vecmath_load( v ), _mm_set1_ps( f ) ) );
+#else
+    return Vector4f( v[0] / f, v[1] / f, v[2] / f, v[3] / f );
+#endif
+}
+
+inline bool operator == ( const Vector4f& v0, const Vector4f& v1 )
+{
+    return( v0.x() == v1.x() && v0.y() == v1.y() && v0.z() == v1.z() && v0.w() == v1.w() );
+}
+
+inline bool operator != ( const Vector4f& v0, const Vector4f& v1 )
+{
+    return !( v0 == v1 );
+}
+
 #endif // VECTOR_4F_H
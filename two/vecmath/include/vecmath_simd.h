@@ -0,0 +1,65 @@
+#ifndef VECMATH_SIMD_H
+#define VECMATH_SIMD_H
+
+// Compile with -DVECMATH_SIMD (make SIMD=1) to back Vector3f, Vector4f and
+// Matrix4f with 16-byte aligned storage and SSE kernels.
+//
+// Vector3f is padded to four floats in this mode, with the fourth lane
+// always 0, so the library and every program linking it must be built
+// with the same setting.
+//
+// The batch transforms (Matrix4f::transformPoints etc.) do not depend on
+// the storage layout and use SSE whenever the target has it.
+#if defined( __SSE2__ )
+#define VECMATH_HAVE_SSE 1
+#endif
+
+#if defined( VECMATH_SIMD ) && defined( VECMATH_HAVE_SSE )
+#define VECMATH_USE_SSE 1
+#endif
+
+#ifdef VECMATH_USE_SSE
+#define VECMATH_ALIGN alignas( 16 )
+#else
+#define VECMATH_ALIGN
+#endif
+
+#ifdef VECMATH_HAVE_SSE
+
+#include <emmintrin.h>
+
+// Clears the w lane, used to keep the Vector3f pad at 0
+inline __m128 vecmath_mask3( __m128 a )
+{
+	return _mm_and_ps( a, _mm_castsi128_ps( _mm_set_epi32( 0, -1, -1, -1 ) ) );
+}
+
+// a.x + a.y + a.z + a.w
+inline float vecmath_hsum( __m128 a )
+{
+	__m128 t = _mm_add_ps( a, _mm_movehl_ps( a, a ) );
+	t = _mm_add_ss( t, _mm_shuffle_ps( t, t, _MM_SHUFFLE( 1, 1, 1, 1 ) ) );
+	return _mm_cvtss_f32( t );
+}
+
+// Writes lanes x, y, z of a to out[ 0 .. 2 ], leaving out[ 3 ] alone
+inline void vecmath_storeXYZ( float* out, __m128 a )
+{
+	_mm_storel_pi( reinterpret_cast< __m64* >( out ), a );
+	_mm_store_ss( out + 2, _mm_movehl_ps( a, a ) );
+}
+
+// m * v for a column-major 4x4 m, as a sum of the columns of m scaled by
+// the lanes of v, adding the terms in the same order as the scalar loops
+inline __m128 vecmath_mulColumns( const float* m, const float* v )
+{
+	__m128 r = _mm_mul_ps( _mm_load_ps( m ), _mm_set1_ps( v[ 0 ] ) );
+	r = _mm_add_ps( r, _mm_mul_ps( _mm_load_ps( m + 4 ), _mm_set1_ps( v[ 1 ] ) ) );
+	r = _mm_add_ps( r, _mm_mul_ps( _mm_load_ps( m + 8 ), _mm_set1_ps( v[ 2 ] ) ) );
+	r = _mm_add_ps( r, _mm_mul_ps( _mm_load_ps( m + 12 ), _mm_set1_ps( v[ 3 ] ) ) );
+	return r;
+}
+
+#endif
+
+#endif // VECMATH_SIMD_H
@@ -9,14 +9,6 @@
 #include "Quat4f.h"
 #include "Vector3f.h"
 
-Matrix3f::Matrix3f( float fill )
-{
-	for( int i = 0; i < 9; ++i )
-	{
-		m_elements[ i ] = fill;
-	}
-}
-
 Matrix3f::Matrix3f( float m00, float m01, float m02,
 				   float m10, float m11, float m12,
 				   float m20, float m21, float m22 )
@@ -50,68 +42,6 @@ Matrix3f::Matrix3f( const Vector3f& v0, const Vector3f& v1, const Vector3f& v2,
 	}
 }
 
-Matrix3f::Matrix3f( const Matrix3f& rm )
-{
-	memcpy( m_elements, rm.m_elements, 9 * sizeof( float ) );
-}
-
-Matrix3f& Matrix3f::operator = ( const Matrix3f& rm )
-{
-	if( this != &rm )
-	{
-		memcpy( m_elements, rm.m_elements, 9 * sizeof( float ) );
-	}
-	return *this;
-}
-
-const float& Matrix3f::operator () ( int i, int j ) const
-{
-	return m_elements[ j * 3 + i ];
-}
-
-float& Matrix3f::operator () ( int i, int j )
-{
-	return m_elements[ j * 3 + i ];
-}
-
-Vector3f Matrix3f::getRow( int i ) const
-{
-	return Vector3f
-	(
-		m_elements[ i ],
-		m_elements[ i + 3 ],
-		m_elements[ i + 6 ]
-	);
-}
-
-void Matrix3f::setRow( int i, const Vector3f& v )
-{
-	m_elements[ i ] = v.x();
-	m_elements[ i + 3 ] = v.y();
-	m_elements[ i + 6 ] = v.z();
-}
-
-Vector3f Matrix3f::getCol( int j ) const
-{
-	int colStart = 3 * j;
-
-	return Vector3f
-	(
-		m_elements[ colStart ],
-		m_elements[ colStart + 1 ],
-		m_elements[ colStart + 2 ]			
-	);
-}
-
-void Matrix3f::setCol( int j, const Vector3f& v )
-{
-	int colStart = 3 * j;
-
-	m_elements[ colStart ] = v.x();
-	m_elements[ colStart + 1 ] = v.y();
-	m_elements[ colStart + 2 ] = v.z();
-}
-
 Matrix2f Matrix3f::getSubmatrix2x2( int i0, int j0 ) const
 {
 	Matrix2f out;
@@ -218,6 +148,31 @@ void Matrix3f::transpose()
 	}
 }
 
+Matrix3f Matrix3f::inverseOrthonormal() const
+{
+#ifdef DEBUG
+	assert( isOrthonormal() );
+#endif
+	return transposed();
+}
+
+bool Matrix3f::isOrthonormal( float epsilon ) const
+{
+	for( int i = 0; i < 3; ++i )
+	{
+		for( int j = i; j < 3; ++j )
+		{
+			float d = Vector3f::dot( getCol( i ), getCol( j ) );
+			if( fabs( d - ( i == j ? 1.f : 0.f ) ) > epsilon )
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
 Matrix3f Matrix3f::transposed() const
 {
 	Matrix3f out;
@@ -232,9 +187,39 @@ Matrix3f Matrix3f::transposed() const
 	return out;
 }
 
-Matrix3f::operator float* ()
+void Matrix3f::transform( const float* in, float* out, int n, int inStride, int outStride ) const
 {
-	return m_elements;
+	const float* m = m_elements;
+#ifdef VECMATH_HAVE_SSE
+	__m128 c0 = _mm_setr_ps( m[ 0 ], m[ 1 ], m[ 2 ], 0 );
+	__m128 c1 = _mm_setr_ps( m[ 3 ], m[ 4 ], m[ 5 ], 0 );
+	__m128 c2 = _mm_setr_ps( m[ 6 ], m[ 7 ], m[ 8 ], 0 );
+	for( int k = 0; k < n; ++k )
+	{
+		const float* p = in + k * inStride;
+		__m128 r = _mm_mul_ps( c0, _mm_set1_ps( p[ 0 ] ) );
+		r = _mm_add_ps( r, _mm_mul_ps( c1, _mm_set1_ps( p[ 1 ] ) ) );
+		r = _mm_add_ps( r, _mm_mul_ps( c2, _mm_set1_ps( p[ 2 ] ) ) );
+		vecmath_storeXYZ( out + k * outStride, r );
+	}
+#else
+	for( int k = 0; k < n; ++k )
+	{
+		const float* p = in + k * inStride;
+		float* q = out + k * outStride;
+		float x = p[ 0 ];
+		float y = p[ 1 ];
+		float z = p[ 2 ];
+		q[ 0 ] = m[ 0 ] * x + m[ 3 ] * y + m[ 6 ] * z;
+		q[ 1 ] = m[ 1 ] * x + m[ 4 ] * y + m[ 7 ] * z;
+		q[ 2 ] = m[ 2 ] * x + m[ 5 ] * y + m[ 8 ] * z;
+	}
+#endif
+}
+
+void Matrix3f::transformNormals( const float* in, float* out, int n, int inStride, int outStride ) const
+{
+	inverse().transposed().transform( in, out, n, inStride, outStride );
 }
 
 void Matrix3f::print()
@@ -282,7 +267,6 @@ Matrix3f Matrix3f::identity()
 	return m;
 }
 
-
 // static
 Matrix3f Matrix3f::rotateX( float radians )
 {
@@ -392,40 +376,3 @@ Matrix3f Matrix3f::rotation( const Quat4f& rq )
 			2.0f * ( xz - yw ),				2.0f * ( yz + xw ),				1.0f - 2.0f * ( xx + yy )
 		);
 }
-
-//////////////////////////////////////////////////////////////////////////
-// Operators
-//////////////////////////////////////////////////////////////////////////
-
-Vector3f operator * ( const Matrix3f& m, const Vector3f& v )
-{
-	Vector3f output( 0, 0, 0 );
-
-	for( int i = 0; i < 3; ++i )
-	{
-		for( int j = 0; j < 3; ++j )
-		{
-			output[ i ] += m( i, j ) * v[ j ];
-		}
-	}
-
-	return output;
-}
-
-Matrix3f operator * ( const Matrix3f& x, const Matrix3f& y )
-{
-	Matrix3f product; // zeroes
-
-	for( int i = 0; i < 3; ++i )
-	{
-		for( int j = 0; j < 3; ++j )
-		{
-			for( int k = 0; k < 3; ++k )
-			{
-				product( i, k ) += x( i, j ) * y( j, k );
-			}
-		}
-	}
-
-	return product;
-}
@@ -0,0 +1,673 @@
+// vecmath microbenchmark and accuracy checks:
+//
+//   vecmathbench [-seconds S] [-csv]
+//
+// Built by "make bench" in vecmath/, which compiles the library sources
+// together with this file using OPT (-O2 by default), so compilers and
+// -O levels can be compared without touching lib/. "make SIMD=1 bench"
+// builds vecmathbench_simd with the SSE storage of vecmath_simd.h.
+//
+// Throughput: the time per operation of the hot functions, called one
+// element at a time ("scalar") and through the batch transforms
+// ("batch") where vecmath has them. Every timing is the best of
+// several runs of about S / 10 seconds each (S is 1 by default).
+//
+// Accuracy: the errors against the same computation in double
+// precision on the same (float) inputs, in units of FLT_EPSILON
+// relative to the magnitude of the result, as the maximum and the mean
+// over all samples. The batch transforms must agree with the scalar
+// operators to within BATCH_TOLERANCE, otherwise the exit code is 1.
+//
+// The inputs come from a fixed generator, so the checksums and errors
+// are the same from one run, compiler or machine to the next as long as
+// the arithmetic is.
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <vecmath.h>
+
+#ifndef VECMATH_BENCH_OPT
+#define VECMATH_BENCH_OPT "?"
+#endif
+
+using namespace std;
+
+namespace
+{
+	typedef chrono::steady_clock Clock;
+
+	// Elements per timed call: the arrays stay in the L1 or L2 cache
+	const size_t NUM_ELEMENTS = 1024;
+	const size_t NUM_MATRICES = 256;
+	// Samples per accuracy check
+	const size_t NUM_SAMPLES = 20000;
+	// Runs per timing, the best one counts
+	const int NUM_RUNS = 5;
+	// Allowed disagreement of a batch transform with the scalar operator,
+	// in FLT_EPSILON relative to the magnitude of the terms
+	const double BATCH_TOLERANCE = 4.0;
+
+	// xorshift64*, the same numbers everywhere
+	struct Random
+	{
+		explicit Random( unsigned long long seed ) : state( seed ) { }
+
+		// in [ lo, hi )
+		float uniform( float lo = 0.0f, float hi = 1.0f )
+		{
+			state ^= state >> 12;
+			state ^= state << 25;
+			state ^= state >> 27;
+			const unsigned long long x = state * 2685821657736338717ULL;
+			return lo + ( hi - lo ) * float( ( x >> 40 ) * ( 1.0 / 16777216.0 ) );
+		}
+
+		Vector3f direction()
+		{
+			Vector3f v;
+			do
+			{
+				v = Vector3f( uniform( -1, 1 ), uniform( -1, 1 ), uniform( -1, 1 ) );
+			}
+			while( v.absSquared() > 1.0f || v.absSquared() < 1e-4f );
+			return v.normalized();
+		}
+
+		Quat4f rotation()
+		{
+			return Quat4f::randomRotation( uniform( -1, 1 ), uniform(), uniform() ).normalized();
+		}
+
+		// rotation * scale, then translation
+		Matrix4f affine( float minScale, float maxScale )
+		{
+			Matrix4f m = Matrix4f::rotation( rotation() ) *
+				Matrix4f::scaling( uniform( minScale, maxScale ), uniform( minScale, maxScale ), uniform( minScale, maxScale ) );
+			m.setCol( 3, Vector4f( uniform( -10, 10 ), uniform( -10, 10 ), uniform( -10, 10 ), 1 ) );
+			return m;
+		}
+
+		Matrix4f general()
+		{
+			Matrix4f m;
+			for( int k = 0; k != 16; ++k )
+			{
+				m( k % 4, k / 4 ) = uniform( -1, 1 );
+			}
+			return m;
+		}
+
+		unsigned long long state;
+	};
+
+	// ---- Timing ----
+
+	// Nanoseconds per operation of fn(), which performs opsPerCall
+	// operations
+	template< class F >
+	double nsPerOp( F fn, size_t opsPerCall, double seconds )
+	{
+		size_t calls = 1;
+		for( ;; )
+		{
+			const Clock::time_point t0 = Clock::now();
+			for( size_t c = 0; c != calls; ++c )
+			{
+				fn();
+			}
+			if( chrono::duration< double >( Clock::now() - t0 ).count() >= seconds / 10 || calls >= ( size_t( 1 ) << 30 ) )
+			{
+				break;
+			}
+			calls *= 2;
+		}
+		double best = 1e30;
+		for( int r = 0; r != NUM_RUNS; ++r )
+		{
+			const Clock::time_point t0 = Clock::now();
+			for( size_t c = 0; c != calls; ++c )
+			{
+				fn();
+			}
+			best = min( best, chrono::duration< double >( Clock::now() - t0 ).count() );
+		}
+		return best * 1e9 / ( double( calls ) * opsPerCall );
+	}
+
+	// Sums the outputs, so that they are computed, and to compare runs
+	double checksum( const float* p, size_t n )
+	{
+		double s = 0;
+		for( size_t i = 0; i != n; ++i )
+		{
+			s += p[ i ];
+		}
+		return s;
+	}
+
+	// ---- Double precision references, column-major like Matrix4f ----
+
+	struct Mat4d
+	{
+		double m[ 16 ];
+
+		explicit Mat4d( const Matrix4f& f )
+		{
+			for( int k = 0; k != 16; ++k )
+			{
+				m[ k ] = f( k % 4, k / 4 );
+			}
+		}
+
+		Mat4d() { fill( m, m + 16, 0.0 ); }
+
+		double& operator()( int i, int j ) { return m[ j * 4 + i ]; }
+		double operator()( int i, int j ) const { return m[ j * 4 + i ]; }
+	};
+
+	// Gauss-Jordan with partial pivoting
+	Mat4d inverse( const Mat4d& a )
+	{
+		double w[ 4 ][ 8 ];
+		for( int i = 0; i != 4; ++i )
+		{
+			for( int j = 0; j != 4; ++j )
+			{
+				w[ i ][ j ] = a( i, j );
+				w[ i ][ j + 4 ] = i == j ? 1.0 : 0.0;
+			}
+		}
+		for( int c = 0; c != 4; ++c )
+		{
+			int pivot = c;
+			for( int r = c + 1; r != 4; ++r )
+			{
+				if( fabs( w[ r ][ c ] ) > fabs( w[ pivot ][ c ] ) )
+				{
+					pivot = r;
+				}
+			}
+			for( int j = 0; j != 8; ++j )
+			{
+				swap( w[ c ][ j ], w[ pivot ][ j ] );
+			}
+			const double s = 1.0 / w[ c ][ c ];
+			for( int j = 0; j != 8; ++j )
+			{
+				w[ c ][ j ] *= s;
+			}
+			for( int r = 0; r != 4; ++r )
+			{
+				if( r != c )
+				{
+					const double f = w[ r ][ c ];
+					for( int j = 0; j != 8; ++j )
+					{
+						w[ r ][ j ] -= f * w[ c ][ j ];
+					}
+				}
+			}
+		}
+		Mat4d inv;
+		for( int i = 0; i != 4; ++i )
+		{
+			for( int j = 0; j != 4; ++j )
+			{
+				inv( i, j ) = w[ i ][ j + 4 ];
+			}
+		}
+		return inv;
+	}
+
+	// slerp along the shorter arc, as Quat4f::slerp() with allowFlip
+	void slerp( const Quat4f& a, const Quat4f& b, float t, double out[ 4 ] )
+	{
+		double qa[ 4 ], qb[ 4 ], d = 0;
+		for( int k = 0; k != 4; ++k )
+		{
+			qa[ k ] = a[ k ];
+			qb[ k ] = b[ k ];
+			d += qa[ k ] * qb[ k ];
+		}
+		const double sign = d < 0 ? -1.0 : 1.0;
+		const double angle = acos( min( 1.0, fabs( d ) ) );
+		double c1 = 1 - t, c2 = t;
+		if( angle > 1e-6 )
+		{
+			c1 = sin( angle * ( 1 - t ) ) / sin( angle );
+			c2 = sin( angle * t ) / sin( angle );
+		}
+		for( int k = 0; k != 4; ++k )
+		{
+			out[ k ] = sign * c1 * qa[ k ] + c2 * qb[ k ];
+		}
+	}
+
+	// ---- Reporting ----
+
+	struct ErrorStats
+	{
+		ErrorStats() : max( 0 ), sum( 0 ), count( 0 ) { }
+
+		// err and scale in the same units; err / scale in FLT_EPSILON
+		void add( double err, double scale )
+		{
+			const double e = scale > 0 ? err / ( scale * FLT_EPSILON ) : 0;
+			max = std::max( max, e );
+			sum += e;
+			++count;
+		}
+
+		double max;
+		double sum;
+		size_t count;
+	};
+
+	bool g_csv = false;
+
+	void printThroughput( const char* name, const char* variant, double ns, double sum )
+	{
+		if( g_csv )
+		{
+			printf( "throughput,%s,%s,%.3f,%.17g\n", name, variant, ns, sum );
+		}
+		else
+		{
+			printf( "  %-34s %-6s %9.2f ns %9.1f M/s   checksum %.9g\n", name, variant, ns, 1e3 / ns, sum );
+		}
+	}
+
+	void printAccuracy( const char* name, const ErrorStats& s )
+	{
+		if( g_csv )
+		{
+			printf( "accuracy,%s,%.3f,%.3f\n", name, s.max, s.count ? s.sum / s.count : 0.0 );
+		}
+		else
+		{
+			printf( "  %-42s %12.2f %10.3f\n", name, s.max, s.count ? s.sum / s.count : 0.0 );
+		}
+	}
+
+	// ---- Throughput ----
+
+	void throughput( double seconds )
+	{
+		Random rng( 6837 );
+		vector< Matrix4f > ma( NUM_MATRICES ), mb( NUM_MATRICES ), mc( NUM_MATRICES ), mr( NUM_MATRICES );
+		for( size_t i = 0; i != NUM_MATRICES; ++i )
+		{
+			ma[ i ] = rng.affine( 0.5f, 2.0f );
+			mb[ i ] = rng.affine( 0.5f, 2.0f );
+			mr[ i ] = rng.affine( 1, 1 );
+		}
+		vector< Vector3f > v( NUM_ELEMENTS ), out( NUM_ELEMENTS );
+		vector< Quat4f > qa( NUM_ELEMENTS ), qb( NUM_ELEMENTS ), qc( NUM_ELEMENTS );
+		vector< float > t( NUM_ELEMENTS );
+		for( size_t i = 0; i != NUM_ELEMENTS; ++i )
+		{
+			v[ i ] = rng.direction() * rng.uniform( 0.1f, 10.0f );
+			qa[ i ] = rng.rotation();
+			qb[ i ] = rng.rotation();
+			t[ i ] = rng.uniform();
+		}
+		const Matrix4f m = ma[ 0 ];
+		const Matrix3f m3 = m.getSubmatrix3x3( 0, 0 );
+		const float* outFloats = reinterpret_cast< const float* >( out.data() );
+		const size_t outSize = out.size() * sizeof( Vector3f ) / sizeof( float );
+
+		if( !g_csv )
+		{
+			printf( "throughput\n" );
+		}
+
+		double ns = nsPerOp( [&]
+		{
+			for( size_t i = 0; i != NUM_MATRICES; ++i )
+			{
+				mc[ i ] = ma[ i ] * mb[ i ];
+			}
+		}, NUM_MATRICES, seconds );
+		printThroughput( "Matrix4f * Matrix4f", "scalar", ns,
+			checksum( reinterpret_cast< const float* >( mc.data() ), 16 * NUM_MATRICES ) );
+
+		ns = nsPerOp( [&]
+		{
+			for( size_t i = 0; i != NUM_MATRICES; ++i )
+			{
+				mc[ i ] = ma[ i ].inverse();
+			}
+		}, NUM_MATRICES, seconds );
+		printThroughput( "Matrix4f::inverse", "scalar", ns,
+			checksum( reinterpret_cast< const float* >( mc.data() ), 16 * NUM_MATRICES ) );
+
+		ns = nsPerOp( [&]
+		{
+			for( size_t i = 0; i != NUM_MATRICES; ++i )
+			{
+				mc[ i ] = ma[ i ].inverseAffine();
+			}
+		}, NUM_MATRICES, seconds );
+		printThroughput( "Matrix4f::inverseAffine", "scalar", ns,
+			checksum( reinterpret_cast< const float* >( mc.data() ), 16 * NUM_MATRICES ) );
+
+		ns = nsPerOp( [&]
+		{
+			for( size_t i = 0; i != NUM_MATRICES; ++i )
+			{
+				mc[ i ] = mr[ i ].inverseRigid();
+			}
+		}, NUM_MATRICES, seconds );
+		printThroughput( "Matrix4f::inverseRigid", "scalar", ns,
+			checksum( reinterpret_cast< const float* >( mc.data() ), 16 * NUM_MATRICES ) );
+
+		ns = nsPerOp( [&]
+		{
+			for( size_t i = 0; i != NUM_ELEMENTS; ++i )
+			{
+				out[ i ] = ( m * Vector4f( v[ i ], 1 ) ).xyz();
+			}
+		}, NUM_ELEMENTS, seconds );
+		printThroughput( "Matrix4f * point", "scalar", ns, checksum( outFloats, outSize ) );
+
+		ns = nsPerOp( [&] { m.transformPoints( v.data(), out.data(), int( NUM_ELEMENTS ) ); }, NUM_ELEMENTS, seconds );
+		printThroughput( "Matrix4f * point", "batch", ns, checksum( outFloats, outSize ) );
+
+		ns = nsPerOp( [&]
+		{
+			for( size_t i = 0; i != NUM_ELEMENTS; ++i )
+			{
+				out[ i ] = ( m * Vector4f( v[ i ], 0 ) ).xyz();
+			}
+		}, NUM_ELEMENTS, seconds );
+		printThroughput( "Matrix4f * direction", "scalar", ns, checksum( outFloats, outSize ) );
+
+		ns = nsPerOp( [&] { m.transformDirections( v.data(), out.data(), int( NUM_ELEMENTS ) ); }, NUM_ELEMENTS, seconds );
+		printThroughput( "Matrix4f * direction", "batch", ns, checksum( outFloats, outSize ) );
+
+		ns = nsPerOp( [&]
+		{
+			const Matrix3f n = m3.inverse().transposed();
+			for( size_t i = 0; i != NUM_ELEMENTS; ++i )
+			{
+				out[ i ] = n * v[ i ];
+			}
+		}, NUM_ELEMENTS, seconds );
+		printThroughput( "Matrix4f normal transform", "scalar", ns, checksum( outFloats, outSize ) );
+
+		ns = nsPerOp( [&] { m.transformNormals( v.data(), out.data(), int( NUM_ELEMENTS ) ); }, NUM_ELEMENTS, seconds );
+		printThroughput( "Matrix4f normal transform", "batch", ns, checksum( outFloats, outSize ) );
+
+		ns = nsPerOp( [&]
+		{
+			for( size_t i = 0; i != NUM_ELEMENTS; ++i )
+			{
+				out[ i ] = m3 * v[ i ];
+			}
+		}, NUM_ELEMENTS, seconds );
+		printThroughput( "Matrix3f * Vector3f", "scalar", ns, checksum( outFloats, outSize ) );
+
+		ns = nsPerOp( [&]
+		{
+			m3.transform( reinterpret_cast< const float* >( v.data() ), reinterpret_cast< float* >( out.data() ),
+				int( NUM_ELEMENTS ), int( sizeof( Vector3f ) / sizeof( float ) ), int( sizeof( Vector3f ) / sizeof( float ) ) );
+		}, NUM_ELEMENTS, seconds );
+		printThroughput( "Matrix3f * Vector3f", "batch", ns, checksum( outFloats, outSize ) );
+
+		ns = nsPerOp( [&]
+		{
+			for( size_t i = 0; i != NUM_ELEMENTS; ++i )
+			{
+				out[ i ] = v[ i ].normalized();
+			}
+		}, NUM_ELEMENTS, seconds );
+		printThroughput( "Vector3f::normalized", "scalar", ns, checksum( outFloats, outSize ) );
+
+		ns = nsPerOp( [&]
+		{
+			for( size_t i = 0; i != NUM_ELEMENTS; ++i )
+			{
+				out[ i ] = Vector3f::cross( v[ i ], v[ ( i + 1 ) % NUM_ELEMENTS ] );
+			}
+		}, NUM_ELEMENTS, seconds );
+		printThroughput( "Vector3f::cross", "scalar", ns, checksum( outFloats, outSize ) );
+
+		ns = nsPerOp( [&]
+		{
+			for( size_t i = 0; i != NUM_ELEMENTS; ++i )
+			{
+				qc[ i ] = Quat4f::slerp( qa[ i ], qb[ i ], t[ i ] );
+			}
+		}, NUM_ELEMENTS, seconds );
+		printThroughput( "Quat4f::slerp", "scalar", ns,
+			checksum( reinterpret_cast< const float* >( qc.data() ), 4 * NUM_ELEMENTS ) );
+	}
+
+	// ---- Accuracy ----
+
+	// Returns false if a batch transform disagrees with its operator
+	bool accuracy()
+	{
+		Random rng( 2012 );
+		bool ok = true;
+		if( !g_csv )
+		{
+			printf( "accuracy vs double, in FLT_EPSILON             max       mean\n" );
+		}
+
+		// products: each entry relative to sum_k | a_ik b_kj |
+		ErrorStats product;
+		for( size_t s = 0; s != NUM_SAMPLES / 16; ++s )
+		{
+			const Matrix4f a = rng.general(), b = rng.general();
+			const Matrix4f c = a * b;
+			const Mat4d da( a ), db( b );
+			for( int i = 0; i != 4; ++i )
+			{
+				for( int j = 0; j != 4; ++j )
+				{
+					double exact = 0, scale = 0;
+					for( int k = 0; k != 4; ++k )
+					{
+						exact += da( i, k ) * db( k, j );
+						scale += fabs( da( i, k ) * db( k, j ) );
+					}
+					product.add( fabs( c( i, j ) - exact ), scale );
+				}
+			}
+		}
+		printAccuracy( "Matrix4f * Matrix4f", product );
+
+		// inverses, relative to the largest entry of the exact inverse
+		const char* inverseNames[] =
+		{
+			"Matrix4f::inverse rigid",
+			"Matrix4f::inverse affine (scale 0.1..10)",
+			"Matrix4f::inverse general",
+			"Matrix4f::inverseRigid",
+			"Matrix4f::inverseAffine (scale 0.1..10)"
+		};
+		for( int kind = 0; kind != 5; ++kind )
+		{
+			ErrorStats stats;
+			for( size_t s = 0; s != NUM_SAMPLES / 16; ++s )
+			{
+				const Matrix4f a = kind % 3 == 0 ? rng.affine( 1, 1 ) : kind % 3 == 1 ? rng.affine( 0.1f, 10 ) : rng.general();
+				bool singular = false;
+				const Matrix4f inv = kind == 3 ? a.inverseRigid() :
+					kind == 4 ? a.inverseAffine( &singular ) : a.inverse( &singular );
+				if( singular )
+				{
+					continue;
+				}
+				const Mat4d exact = inverse( Mat4d( a ) );
+				double err = 0, scale = 0;
+				for( int k = 0; k != 16; ++k )
+				{
+					err = max( err, fabs( inv( k % 4, k / 4 ) - exact.m[ k ] ) );
+					scale = max( scale, fabs( exact.m[ k ] ) );
+				}
+				stats.add( err, scale );
+			}
+			printAccuracy( inverseNames[ kind ], stats );
+		}
+
+		// normalized, over lengths from 1e-3 to 1e3
+		ErrorStats normalized;
+		for( size_t s = 0; s != NUM_SAMPLES; ++s )
+		{
+			const Vector3f v = rng.direction() * pow( 10.0f, rng.uniform( -3, 3 ) );
+			const Vector3f n = v.normalized();
+			const double length = sqrt( double( v.x() ) * v.x() + double( v.y() ) * v.y() + double( v.z() ) * v.z() );
+			double err = 0;
+			for( int k = 0; k != 3; ++k )
+			{
+				err = max( err, fabs( n[ k ] - v[ k ] / length ) );
+			}
+			normalized.add( err, 1 );
+		}
+		printAccuracy( "Vector3f::normalized", normalized );
+
+		// slerp, split where Quat4f::slerp() switches to a plain lerp: at a
+		// dot product of 0.99, a rotation by 16 degrees between a and b
+		ErrorStats slerpNear, slerpFar;
+		for( size_t s = 0; s != NUM_SAMPLES; ++s )
+		{
+			const Quat4f a = rng.rotation();
+			// half of them close to a
+			Quat4f b = rng.rotation();
+			if( s % 2 )
+			{
+				b = ( a + 0.1f * rng.uniform() * b ).normalized();
+			}
+			const float t = rng.uniform();
+			const Quat4f q = Quat4f::slerp( a, b, t );
+			double exact[ 4 ];
+			slerp( a, b, t, exact );
+			double err = 0;
+			for( int k = 0; k != 4; ++k )
+			{
+				err = max( err, fabs( q[ k ] - exact[ k ] ) );
+			}
+			( 1.0f - fabs( Quat4f::dot( a, b ) ) < 0.01f ? slerpNear : slerpFar ).add( err, 1 );
+		}
+		printAccuracy( "Quat4f::slerp (rotation < 16 degrees)", slerpNear );
+		printAccuracy( "Quat4f::slerp (rotation >= 16 degrees)", slerpFar );
+
+		// batch transforms against double, and against the operators
+		ErrorStats points, normals, batchPoints, batchNormals;
+		for( size_t s = 0; s != NUM_SAMPLES / NUM_ELEMENTS + 1; ++s )
+		{
+			const Matrix4f m = rng.affine( 0.1f, 10 );
+			vector< Vector3f > v( NUM_ELEMENTS ), p( NUM_ELEMENTS ), n( NUM_ELEMENTS );
+			for( size_t i = 0; i != NUM_ELEMENTS; ++i )
+			{
+				v[ i ] = rng.direction() * rng.uniform( 0.1f, 10.0f );
+			}
+			m.transformPoints( v.data(), p.data(), int( NUM_ELEMENTS ) );
+			m.transformNormals( v.data(), n.data(), int( NUM_ELEMENTS ) );
+			const Mat4d dm( m );
+			const Mat4d dn = inverse( dm );
+			const Matrix3f normalMatrix = m.getSubmatrix3x3( 0, 0 ).inverse().transposed();
+			for( size_t i = 0; i != NUM_ELEMENTS; ++i )
+			{
+				const Vector3f op = ( m * Vector4f( v[ i ], 1 ) ).xyz();
+				const Vector3f on = normalMatrix * v[ i ];
+				double pErr = 0, pScale = 0, nErr = 0, nScale = 0, opErr = 0, onErr = 0;
+				for( int r = 0; r != 3; ++r )
+				{
+					double exactP = dm( r, 3 ), scaleP = fabs( dm( r, 3 ) ), exactN = 0, scaleN = 0;
+					for( int k = 0; k != 3; ++k )
+					{
+						exactP += dm( r, k ) * v[ i ][ k ];
+						scaleP += fabs( dm( r, k ) * v[ i ][ k ] );
+						// the inverse transpose: row r of it is column r of the inverse
+						exactN += dn( k, r ) * v[ i ][ k ];
+						scaleN += fabs( dn( k, r ) * v[ i ][ k ] );
+					}
+					pErr = max( pErr, fabs( p[ i ][ r ] - exactP ) );
+					nErr = max( nErr, fabs( n[ i ][ r ] - exactN ) );
+					opErr = max( opErr, double( fabs( p[ i ][ r ] - op[ r ] ) ) );
+					onErr = max( onErr, double( fabs( n[ i ][ r ] - on[ r ] ) ) );
+					pScale = max( pScale, scaleP );
+					nScale = max( nScale, scaleN );
+				}
+				points.add( pErr, pScale );
+				normals.add( nErr, nScale );
+				batchPoints.add( opErr, pScale );
+				batchNormals.add( onErr, nScale );
+			}
+		}
+		printAccuracy( "Matrix4f::transformPoints", points );
+		printAccuracy( "Matrix4f::transformNormals", normals );
+		printAccuracy( "transformPoints vs operator *", batchPoints );
+		printAccuracy( "transformNormals vs Matrix3f operator *", batchNormals );
+		if( batchPoints.max > BATCH_TOLERANCE || batchNormals.max > BATCH_TOLERANCE )
+		{
+			printf( "FAILED: a batch transform differs from its operator by more than %g FLT_EPSILON\n",
+				BATCH_TOLERANCE );
+			ok = false;
+		}
+		return ok;
+	}
+}
+
+int main( int argc, char* argv[] )
+{
+	double seconds = 1.0;
+	for( int i = 1; i < argc; ++i )
+	{
+		if( !strcmp( argv[ i ], "-seconds" ) && i + 1 < argc )
+		{
+			seconds = atof( argv[ ++i ] );
+		}
+		else if( !strcmp( argv[ i ], "-csv" ) )
+		{
+			g_csv = true;
+		}
+		else
+		{
+			printf( "Usage: %s [-seconds S] [-csv]\n", argv[ 0 ] );
+			return -1;
+		}
+	}
+
+	string compiler = "unknown compiler";
+#if defined( __clang__ )
+	compiler = "clang " __clang_version__;
+#elif defined( __GNUC__ )
+	compiler = "g++ " __VERSION__;
+#elif defined( _MSC_VER )
+	compiler = "MSVC " + to_string( _MSC_VER );
+#endif
+#if defined( VECMATH_USE_SSE )
+	const char* storage = "SSE storage (VECMATH_SIMD)";
+#else
+	const char* storage = "scalar storage";
+#endif
+#if defined( VECMATH_HAVE_SSE )
+	const char* kernels = "SSE batch kernels";
+#else
+	const char* kernels = "scalar batch kernels";
+#endif
+	if( g_csv )
+	{
+		printf( "config,%s,%s,%s,%s\n", compiler.c_str(), VECMATH_BENCH_OPT, storage, kernels );
+	}
+	else
+	{
+		printf( "vecmath: %s, %s, %s, %s, sizeof( Vector3f ) %u\n", compiler.c_str(), VECMATH_BENCH_OPT,
+			storage, kernels, unsigned( sizeof( Vector3f ) ) );
+	}
+
+	throughput( seconds );
+	return accuracy() ? 0 : 1;
+}
@@ -1,22 +1,40 @@
 #include "GL/freeglut.h"
 #include <cmath>
 #include <iostream>
-#include <sstream>
 #include <vector>
 #include <string>
+#include <cstdio>
+#include <unordered_map>
 #include "vecmath.h"
+#include "MeshCache.h"
+#include "ObjLoader.h"
+#include "Trace.h"
 using namespace std;
 
 // Globals
 
-// This is the list of points (3D vectors)
-vector<Vector3f> vecv;
+// The mesh as vertex arrays. Every distinct position/normal pair of
+// the OBJ file is one vertex, so a single index addresses both.
 
-// This is the list of normals (also 3D vectors)
-vector<Vector3f> vecn;
+// This is the list of points, 3 floats per vertex
+vector<GLfloat> vecv;
 
-// This is the list of faces (indices into vecv and vecn)
-vector<vector<unsigned> > vecf;
+// This is the list of normals, 3 floats per vertex
+vector<GLfloat> vecn;
+
+// This is the list of faces, 3 indices into vecv and vecn per triangle
+vector<GLuint> vecf;
+
+// What drawScene draws: the arrays above, or the same arrays straight
+// from the memory-mapped cache of the OBJ file (see loadInput())
+MeshCache meshCache;
+const GLfloat *meshPositions = NULL;
+const GLfloat *meshNormals = NULL;
+const GLuint *meshIndices = NULL;
+size_t numIndices = 0;
+
+// Sections of the cache
+enum { CACHE_POSITIONS, CACHE_NORMALS, CACHE_INDICES };
 
 
 // You will need more global variables to implement color and position changes
@@ -148,6 +166,11 @@ void keyboardFunc( unsigned char key, int x, int y )
         glGetFloatv(GL_MODELVIEW_MATRIX, matf);
         display_modelview(matf);
         break;
+#endif
+#ifdef TRACE
+    case 't':
+        Trace::write("a0_trace.json");
+        break;
 #endif
     default:
         cout << "Unhandled key press " << key << "." << endl;        
@@ -218,6 +241,7 @@ void mouseFunc( int button, int state, int x, int y)
 // This function is responsible for displaying the object.
 void drawScene(void)
 {
+    TRACE_SCOPE("drawScene");
     int i;
 
     // Clear the rendering window
@@ -265,18 +289,16 @@ void drawScene(void)
 	// This GLUT method draws a teapot.  You should replace
 	// it with code which draws the object you loaded.
 	// glutSolidTeapot(1.0);
-    glBegin(GL_TRIANGLES);
-    for (size_t ind = 0; ind < vecf.size(); ++ind) {
-        unsigned a = vecf[ind][0], c = vecf[ind][2], d = vecf[ind][3],
-                 f = vecf[ind][5], g = vecf[ind][6], i = vecf[ind][8];
-        glNormal(vecn[c-1]);
-        glVertex(vecv[a-1]);
-        glNormal(vecn[f-1]);
-        glVertex(vecv[d-1]);
-        glNormal(vecn[i-1]);
-        glVertex(vecv[g-1]);
+    // The whole mesh is one call from the vertex arrays
+    if (numIndices) {
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_NORMAL_ARRAY);
+        glVertexPointer(3, GL_FLOAT, 0, meshPositions);
+        glNormalPointer(GL_FLOAT, 0, meshNormals);
+        glDrawElements(GL_TRIANGLES, GLsizei(numIndices), GL_UNSIGNED_INT, meshIndices);
+        glDisableClientState(GL_NORMAL_ARRAY);
+        glDisableClientState(GL_VERTEX_ARRAY);
     }
-    glEnd();
     
     // Dump the image to the screen.
     glutSwapBuffers();
@@ -310,34 +332,102 @@ void reshapeFunc(int w, int h)
     gluPerspective(50.0, 1.0, 1.0, 100.0);
 }
 
-void loadInput()
+// Whether all n indices are below numVertices, so that glDrawElements()
+// reads nothing past the arrays
+bool indicesBelow(const GLuint *indices, size_t n, size_t numVertices)
+{
+    for (size_t i = 0; i != n; ++i)
+        if (indices[i] >= numVertices)
+            return false;
+    return true;
+}
+
+void loadInput(const char *filename)
 {
+    TRACE_SCOPE("loadInput");
 	// load the OBJ file here
-    string buf;
-    while(getline(cin, buf)) {
-        stringstream ss(buf);
-        string s;
-        Vector3f v;
-        ss >> s;
-        if (s == "v") {
-            ss >> v[0] >> v[1] >> v[2];
-            vecv.push_back(v);
-        } else if (s == "vn") {
-            ss >> v[0] >> v[1] >> v[2];
-            vecn.push_back(v);
-        } else if (s == "f") {
-            string token;
-            vector<unsigned> f;
-            for (size_t i = 0; i < 3; ++i) {
-                ss >> token;
-                stringstream ss2(token);
-                for (size_t j = 0; j < 3; ++j) {
-                    getline(ss2, token, '/');
-                    f.push_back(atoi(token.c_str()));
-                } // end for
-            } // end for
-            vecf.push_back(f);
-        } // end if 
+    // A file named on the command line has a binary cache next to it,
+    // FILE.a0cache, written by the first run. Later runs map it and draw
+    // from it directly. A cache that does not hold whole vertices, or
+    // indexes past them, is parsed again.
+    if (filename && meshCache.open(filename, "a0cache", 0)) {
+        size_t positionCount, normalCount;
+        meshPositions = meshCache.array<GLfloat>(CACHE_POSITIONS, positionCount);
+        meshNormals = meshCache.array<GLfloat>(CACHE_NORMALS, normalCount);
+        meshIndices = meshCache.array<GLuint>(CACHE_INDICES, numIndices);
+        if (meshPositions && meshNormals && meshIndices &&
+                positionCount == normalCount && positionCount % 3 == 0 &&
+                indicesBelow(meshIndices, numIndices, positionCount / 3))
+            return;
+        meshCache.close();
+        numIndices = 0;
+    }
+
+    // ObjLoader maps the file (or stdin when it is redirected from one)
+    // and parses it in place, instead of a stringstream per line and per
+    // corner.
+    ObjLoader obj;
+    if (!(filename ? obj.load(filename) : obj.load(stdin)))
+        return;
+
+    // De-index: the file indexes positions and normals separately, give
+    // each v/vn pair one vertex. A corner without a normal gets the
+    // normal of its face and a vertex of its own.
+    vecv.clear();
+    vecn.clear();
+    vecf.resize(obj.corners.size());
+    unordered_map<unsigned long long, GLuint> vertexOf;
+    vertexOf.reserve(obj.numPositions());
+    vecv.reserve(3 * obj.numPositions());
+    vecn.reserve(3 * obj.numPositions());
+    for (size_t ind = 0; ind < obj.corners.size(); ++ind) {
+        const ObjLoader::Corner &c = obj.corners[ind];
+        const GLuint next = GLuint(vecv.size() / 3);
+        if (c.normal >= 0) {
+            const unsigned long long key =
+                (unsigned long long)c.position << 32 | unsigned(c.normal);
+            std::pair<unordered_map<unsigned long long, GLuint>::iterator, bool> found =
+                vertexOf.insert(std::make_pair(key, next));
+            vecf[ind] = found.first->second;
+            if (!found.second)
+                continue;
+        } else {
+            vecf[ind] = next;
+        }
+        const float *p = &obj.positions[3*c.position];
+        vecv.insert(vecv.end(), p, p + 3);
+        if (c.normal >= 0) {
+            const float *n = &obj.normals[3*c.normal];
+            vecn.insert(vecn.end(), n, n + 3);
+        } else {
+            const ObjLoader::Corner *t = &obj.corners[ind - ind % 3];
+            Vector3f corner[3];
+            for (int k = 0; k < 3; ++k) {
+                const float *q = &obj.positions[3*t[k].position];
+                corner[k] = Vector3f(q[0], q[1], q[2]);
+            }
+            Vector3f n = Vector3f::cross(corner[1] - corner[0], corner[2] - corner[0]);
+            if (n.absSquared() > 0)
+                n.normalize();
+            vecn.push_back(n.x());
+            vecn.push_back(n.y());
+            vecn.push_back(n.z());
+        }
+    }
+    meshPositions = vecv.data();
+    meshNormals = vecn.data();
+    meshIndices = vecf.data();
+    numIndices = vecf.size();
+
+    if (filename) {
+        vector<MeshCache::Section> sections(3);
+        MeshCache::Section positions = { CACHE_POSITIONS, sizeof(GLfloat), vecv.size(), vecv.data() },
+                           normals = { CACHE_NORMALS, sizeof(GLfloat), vecn.size(), vecn.data() },
+                           indices = { CACHE_INDICES, sizeof(GLuint), vecf.size(), vecf.data() };
+        sections[CACHE_POSITIONS] = positions;
+        sections[CACHE_NORMALS] = normals;
+        sections[CACHE_INDICES] = indices;
+        MeshCache::write(filename, "a0cache", 0, sections);
     }
 }
 
@@ -345,10 +435,15 @@ void loadInput()
 // Set up OpenGL, define the callbacks and start the main loop
 int main( int argc, char** argv )
 {
-    loadInput();
-
+#ifdef TRACE
+    Trace::writeAtExit("a0_trace.json");
+#endif
+    // glutInit() removes the GLUT options (-display etc.) from argv
     glutInit(&argc,argv);
 
+    // a0 FILE, or a0 < FILE without the cache
+    loadInput(argc > 1 ? argv[1] : NULL);
+
     // We're going to animate it, so double buffer 
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH );
 